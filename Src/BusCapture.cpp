@@ -0,0 +1,122 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <stdlib.h>
+
+#include "BusCapture.h"
+#include "Logging.h"
+
+static const char* s_logChannel = "BusCapture";
+
+const char* BusCapture::s_header = "# universalsearch capture 1";
+
+static BusCapture* s_instance = NULL;
+
+BusCapture* BusCapture::instance()
+{
+	if (!s_instance)
+		s_instance = new BusCapture();
+
+	return s_instance;
+}
+
+BusCapture::BusCapture()
+{
+	m_file = NULL;
+	m_start = g_get_monotonic_time();
+	m_suspended = false;
+
+	const char* path = getenv("UNIVERSALSEARCH_CAPTURE");
+	if (!path || !path[0])
+		return;
+
+	m_file = fopen(path, "w");
+	if (!m_file) {
+		luna_critical(s_logChannel, "Failed to open %s, not capturing", path);
+		return;
+	}
+
+	fprintf(m_file, "%s\n", s_header);
+	fflush(m_file);
+	luna_critical(s_logChannel, "Capturing bus traffic to %s", path);
+}
+
+void BusCapture::record(const char* handler, LSMessage* message)
+{
+	if (!m_file || m_suspended)
+		return;
+
+	const char* payload = LSMessageGetPayload(message);
+	std::string escaped = escape(payload ? payload : "");
+
+	fprintf(m_file, "%lld\t%s\t%c\t", (long long) (g_get_monotonic_time() - m_start), handler,
+			LSMessageIsSubscription(message) ? 's' : '-');
+	fwrite(escaped.data(), 1, escaped.size(), m_file);
+	fputc('\n', m_file);
+
+	//One line per message, so a capture cut short by a crash is still usable.
+	fflush(m_file);
+}
+
+void BusCapture::close()
+{
+	if (!m_file)
+		return;
+
+	fclose(m_file);
+	m_file = NULL;
+}
+
+std::string BusCapture::escape(const char* payload)
+{
+	std::string result;
+
+	for (const char* c = payload; *c; c++) {
+		switch (*c) {
+		case '\\': result += "\\\\"; break;
+		case '\t': result += "\\t"; break;
+		case '\r': result += "\\r"; break;
+		case '\n': result += "\\n"; break;
+		default: result += *c; break;
+		}
+	}
+
+	return result;
+}
+
+std::string BusCapture::unescape(const char* data, gsize length)
+{
+	std::string result;
+	result.reserve(length);
+
+	for (gsize i = 0; i < length; i++) {
+		if (data[i] != '\\' || i + 1 == length) {
+			result += data[i];
+			continue;
+		}
+
+		switch (data[++i]) {
+		case 't': result += '\t'; break;
+		case 'r': result += '\r'; break;
+		case 'n': result += '\n'; break;
+		default: result += data[i]; break;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,199 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <string.h>
+
+#include "CatalogueSnapshot.h"
+#include "Logging.h"
+
+static const char* s_logChannel = "CatalogueSnapshot";
+
+static const char s_magic[4] = { 'U', 'S', 'C', 'S' };
+static const gsize s_headerLength = 20;
+
+static void writeUInt(char* out, guint32 value)
+{
+	out[0] = (char) (value & 0xff);
+	out[1] = (char) ((value >> 8) & 0xff);
+	out[2] = (char) ((value >> 16) & 0xff);
+	out[3] = (char) ((value >> 24) & 0xff);
+}
+
+static guint32 readUInt(const char* in)
+{
+	const guchar* bytes = (const guchar*) in;
+	return (guint32) bytes[0] | ((guint32) bytes[1] << 8) | ((guint32) bytes[2] << 16) | ((guint32) bytes[3] << 24);
+}
+
+void CatalogueSnapshot::Writer::putUInt(guint32 value)
+{
+	char buffer[4];
+	writeUInt(buffer, value);
+	m_data.append(buffer, 4);
+}
+
+void CatalogueSnapshot::Writer::putBool(bool value)
+{
+	m_data += value ? '\1' : '\0';
+}
+
+void CatalogueSnapshot::Writer::putString(const std::string& value)
+{
+	putUInt((guint32) value.size());
+	m_data += value;
+}
+
+bool CatalogueSnapshot::Reader::getUInt(guint32& value)
+{
+	if (m_end - m_pos < 4)
+		return false;
+
+	value = readUInt(m_pos);
+	m_pos += 4;
+	return true;
+}
+
+bool CatalogueSnapshot::Reader::getBool(bool& value)
+{
+	if (m_pos == m_end)
+		return false;
+
+	value = *m_pos++ != '\0';
+	return true;
+}
+
+bool CatalogueSnapshot::Reader::getString(std::string& value)
+{
+	guint32 length;
+	if (!getUInt(length) || (gsize) (m_end - m_pos) < length)
+		return false;
+
+	value.assign(m_pos, length);
+	m_pos += length;
+	return true;
+}
+
+CatalogueSnapshot::CatalogueSnapshot()
+{
+	m_file = NULL;
+	m_payload = NULL;
+	m_payloadLength = 0;
+}
+
+CatalogueSnapshot::~CatalogueSnapshot()
+{
+	if (m_file)
+		g_mapped_file_unref(m_file);
+}
+
+guint32 CatalogueSnapshot::checksum(guint32 hash, const char* data, gsize length)
+{
+	const guchar* bytes = (const guchar*) data;
+	for (gsize i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+bool CatalogueSnapshot::save(const std::string& path, const std::string& key, const Writer& payload)
+{
+	const std::string& data = payload.data();
+	std::string contents;
+	char header[s_headerLength];
+	GError* error = NULL;
+
+	guint32 sum = checksum(2166136261u, key.data(), key.size());
+	sum = checksum(sum, data.data(), data.size());
+
+	memcpy(header, s_magic, 4);
+	writeUInt(header + 4, s_formatVersion);
+	writeUInt(header + 8, (guint32) key.size());
+	writeUInt(header + 12, (guint32) data.size());
+	writeUInt(header + 16, sum);
+
+	contents.reserve(s_headerLength + key.size() + data.size());
+	contents.append(header, s_headerLength);
+	contents += key;
+	contents += data;
+
+	//Written to a temporary file and renamed, readers never see half a snapshot.
+	if (!g_file_set_contents(path.c_str(), contents.data(), contents.size(), &error)) {
+		luna_critical(s_logChannel, "Failed to write %s: %s", path.c_str(), error ? error->message : "unknown error");
+		if (error)
+			g_error_free(error);
+		return false;
+	}
+
+	return true;
+}
+
+bool CatalogueSnapshot::load(const std::string& path, const std::string& key)
+{
+	const char* contents = NULL;
+	gsize length = 0;
+	guint32 keyLength, payloadLength;
+
+	if (m_file) {
+		g_mapped_file_unref(m_file);
+		m_file = NULL;
+	}
+
+	m_file = g_mapped_file_new(path.c_str(), FALSE, NULL);
+	if (!m_file)
+		return false;
+
+	contents = g_mapped_file_get_contents(m_file);
+	length = g_mapped_file_get_length(m_file);
+
+	if (length < s_headerLength || memcmp(contents, s_magic, 4) != 0) {
+		luna_critical(s_logChannel, "%s is not a snapshot", path.c_str());
+		goto Fail;
+	}
+
+	if (readUInt(contents + 4) != s_formatVersion) {
+		luna_log(s_logChannel, "%s has format version %u", path.c_str(), readUInt(contents + 4));
+		goto Fail;
+	}
+
+	keyLength = readUInt(contents + 8);
+	payloadLength = readUInt(contents + 12);
+	if (length - s_headerLength != (gsize) keyLength + payloadLength) {
+		luna_critical(s_logChannel, "%s is truncated", path.c_str());
+		goto Fail;
+	}
+
+	if (checksum(2166136261u, contents + s_headerLength, keyLength + payloadLength) != readUInt(contents + 16)) {
+		luna_critical(s_logChannel, "%s has a bad checksum", path.c_str());
+		goto Fail;
+	}
+
+	if (keyLength != key.size() || memcmp(contents + s_headerLength, key.data(), keyLength) != 0) {
+		luna_log(s_logChannel, "%s is out of date", path.c_str());
+		goto Fail;
+	}
+
+	m_payload = contents + s_headerLength + keyLength;
+	m_payloadLength = payloadLength;
+	return true;
+
+Fail:
+	g_mapped_file_unref(m_file);
+	m_file = NULL;
+	return false;
+}
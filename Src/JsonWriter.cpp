@@ -0,0 +1,183 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "JsonWriter.h"
+
+/*
+ * Escape of every byte: 0 if it goes out as it is, the letter after the backslash
+ * for the short escapes and 'u' for the other control characters.
+ */
+static const char s_escapes[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+static const char s_hexDigits[] = "0123456789abcdef";
+
+JsonWriter::JsonWriter()
+{
+	m_hasElements.push_back(false);
+	m_afterKey = false;
+}
+
+void JsonWriter::clear()
+{
+	m_buffer.clear();
+	m_hasElements.clear();
+	m_hasElements.push_back(false);
+	m_afterKey = false;
+}
+
+//Comma before every element but the first one of its object or array.
+void JsonWriter::separate()
+{
+	if (m_afterKey) {
+		m_afterKey = false;
+		return;
+	}
+
+	m_buffer += m_hasElements.back() ? ", " : (m_hasElements.size() > 1 ? " " : "");
+	m_hasElements.back() = true;
+}
+
+JsonWriter& JsonWriter::beginObject()
+{
+	separate();
+	m_buffer += '{';
+	m_hasElements.push_back(false);
+	return *this;
+}
+
+JsonWriter& JsonWriter::endObject()
+{
+	m_buffer += " }";
+	m_hasElements.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::beginArray()
+{
+	separate();
+	m_buffer += '[';
+	m_hasElements.push_back(false);
+	return *this;
+}
+
+JsonWriter& JsonWriter::endArray()
+{
+	m_buffer += " ]";
+	m_hasElements.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name)
+{
+	separate();
+	quote(m_buffer, name, strlen(name));
+	m_buffer += ": ";
+	m_afterKey = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* text)
+{
+	return value(text, strlen(text));
+}
+
+JsonWriter& JsonWriter::value(const char* text, size_t length)
+{
+	separate();
+	quote(m_buffer, text, length);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag)
+{
+	separate();
+	m_buffer += flag ? "true" : "false";
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(int number)
+{
+	char buffer[16];
+
+	separate();
+	m_buffer.append(buffer, snprintf(buffer, sizeof(buffer), "%d", number));
+	return *this;
+}
+
+JsonWriter& JsonWriter::null()
+{
+	separate();
+	m_buffer += "null";
+	return *this;
+}
+
+JsonWriter& JsonWriter::raw(const std::string& json)
+{
+	separate();
+	m_buffer += json;
+	return *this;
+}
+
+/*
+ * Copies the runs of bytes that need no escape in one go; names, ids and URLs
+ * usually are a single run.
+ */
+void JsonWriter::quote(std::string& out, const char* text, size_t length)
+{
+	const unsigned char* bytes = (const unsigned char*) text;
+	size_t run = 0;
+
+	out += '"';
+	for (size_t i = 0; i < length; i++) {
+		char escape = s_escapes[bytes[i]];
+		if (!escape)
+			continue;
+
+		out.append(text + run, i - run);
+		run = i + 1;
+
+		out += '\\';
+		out += escape;
+		if (escape == 'u') {
+			out += "00";
+			out += s_hexDigits[bytes[i] >> 4];
+			out += s_hexDigits[bytes[i] & 0xf];
+		}
+	}
+	out.append(text + run, length - run);
+	out += '"';
+}
+
+std::string JsonWriter::quote(const std::string& text)
+{
+	std::string out;
+
+	out.reserve(text.size() + 2);
+	quote(out, text.data(), text.size());
+	return out;
+}
@@ -0,0 +1,164 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <stdlib.h>
+
+#include "NotificationScheduler.h"
+#include "UniversalSearchService.h"
+#include "Logging.h"
+#include "ServiceStats.h"
+
+static const char* s_logChannel = "NotificationScheduler";
+
+static const guint s_defaultWindowMs = 50;
+static const guint s_defaultMaxDelayMs = 250;
+
+NotificationScheduler::NotificationScheduler()
+{
+	m_windowMs = readInterval("UNIVERSALSEARCH_NOTIFY_WINDOW_MS", s_defaultWindowMs);
+	m_maxDelayMs = readInterval("UNIVERSALSEARCH_NOTIFY_MAX_DELAY_MS", s_defaultMaxDelayMs);
+	if (m_maxDelayMs < m_windowMs)
+		m_maxDelayMs = m_windowMs;
+
+	m_dirty = 0;
+	m_pendingChanges = 0;
+	m_firstPending = 0;
+	m_sourceId = 0;
+}
+
+NotificationScheduler::~NotificationScheduler()
+{
+	if (m_sourceId)
+		g_source_remove(m_sourceId);
+}
+
+guint NotificationScheduler::readInterval(const char* name, guint defaultValue)
+{
+	const char* value = getenv(name);
+	if (!value || !*value)
+		return defaultValue;
+
+	char* end = NULL;
+	long interval = strtol(value, &end, 10);
+	if (*end != '\0' || interval < 0) {
+		luna_critical(s_logChannel, "Ignoring invalid %s=%s", name, value);
+		return defaultValue;
+	}
+	return (guint) interval;
+}
+
+void NotificationScheduler::markSearchListDirty(const char* eventName)
+{
+	//Keep the event name if the whole burst agrees on it, otherwise it is a generic update.
+	if (!(m_dirty & DirtySearchList))
+		m_searchListEvent = eventName;
+	else if (m_searchListEvent != eventName)
+		m_searchListEvent = "update";
+
+	markDirty(DirtySearchList);
+}
+
+void NotificationScheduler::markOptionalSearchListDirty()
+{
+	markDirty(DirtyOptionalSearchList);
+}
+
+void NotificationScheduler::markSearchPreferenceDirty()
+{
+	markDirty(DirtySearchPreference);
+}
+
+void NotificationScheduler::markDirty(unsigned int dirty)
+{
+	if (!m_dirty)
+		m_firstPending = g_get_monotonic_time();
+
+	m_dirty |= dirty;
+	m_pendingChanges++;
+	STATS_COUNT("notificationChanges");
+
+	schedule();
+}
+
+/*
+ * Every change pushes the flush back by the window (debounce), but not past the
+ * maximum delay counted from the first pending change.
+ */
+void NotificationScheduler::schedule()
+{
+	if (m_sourceId) {
+		g_source_remove(m_sourceId);
+		m_sourceId = 0;
+	}
+
+	if (m_windowMs == 0) {
+		m_sourceId = g_idle_add(cbFlush, this);
+		return;
+	}
+
+	gint64 elapsedMs = (g_get_monotonic_time() - m_firstPending) / 1000;
+	guint delayMs = m_windowMs;
+	if (elapsedMs >= m_maxDelayMs)
+		delayMs = 0;
+	else if (elapsedMs + delayMs > m_maxDelayMs)
+		delayMs = m_maxDelayMs - (guint) elapsedMs;
+
+	m_sourceId = g_timeout_add(delayMs, cbFlush, this);
+}
+
+gboolean NotificationScheduler::cbFlush(gpointer user_data)
+{
+	NotificationScheduler* scheduler = (NotificationScheduler*) user_data;
+
+	scheduler->m_sourceId = 0;
+	scheduler->flush();
+
+	return FALSE;
+}
+
+void NotificationScheduler::flush()
+{
+	if (m_sourceId) {
+		g_source_remove(m_sourceId);
+		m_sourceId = 0;
+	}
+
+	if (!m_dirty)
+		return;
+
+	//Reset first, a broadcast may mark new changes.
+	unsigned int dirty = m_dirty;
+	unsigned int pendingChanges = m_pendingChanges;
+	std::string eventName = m_searchListEvent;
+	gint64 start = g_get_monotonic_time();
+	m_dirty = 0;
+	m_pendingChanges = 0;
+
+	UniversalSearchService* service = UniversalSearchService::instance();
+	if (dirty & DirtySearchList)
+		service->broadcastSearchListChange(eventName.c_str());
+	if (dirty & DirtyOptionalSearchList)
+		service->broadcastOptionalSearchListChange();
+	if (dirty & DirtySearchPreference)
+		service->broadcastSearchPreferenceChange();
+
+	gint64 end = g_get_monotonic_time();
+	STATS_RECORD("notificationFlush", ServiceStats::Latency, end - start);
+	luna_log(s_logChannel, "Flushed %u changes (mask 0x%x) after %lld ms in %lld us", pendingChanges, dirty,
+			(long long) ((start - m_firstPending) / 1000), (long long) (end - start));
+}
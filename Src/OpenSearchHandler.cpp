@@ -30,6 +30,8 @@
 #include "SearchItemsManager.h"
 #include "UniversalSearchService.h"
 #include "USUtils.h"
+#include "ServiceStats.h"
+#include "BusCapture.h"
 
 #define GENRIC_ICON "/usr/lib/luna/system/luna-applauncher/images/search-icon-generic.png"
 
@@ -43,6 +45,7 @@ OpenSearchHandler* OpenSearchHandler::instance() {
 }
 
 OpenSearchHandler::OpenSearchHandler() {
+	m_generation = 0;
 #if defined (TARGET_DESKTOP)
 	m_searchPluginPath = std::string(getenv("HOME"))+std::string("/downloads/searchplugins");
 #else
@@ -57,20 +60,30 @@ OpenSearchHandler::OpenSearchHandler() {
 #endif
 	g_mkdir_with_parents (m_searchPluginIconPath.c_str(), 0755);
 	
+	//The plugin files are parsed on the startup pool; libxml2 wants its init on the main thread.
+	xmlInitParser();
 }
 
 void OpenSearchHandler::scanExistingPlugins()
+{
+    std::vector<OpenSearchInfo> plugins;
+
+    readPluginDirectory (m_searchPluginPath, plugins);
+    addScannedPlugins (plugins);
+}
+
+void OpenSearchHandler::readPluginDirectory (const std::string& path, std::vector<OpenSearchInfo>& plugins)
 {
     DIR	*dir;
     struct dirent* pluginFile;
-    if (m_searchPluginPath.empty()) {
+    if (path.empty()) {
 	g_warning ("empty plugin path, ignoring");
 	return;
     }
 
-    dir = opendir (m_searchPluginPath.c_str());
+    dir = opendir (path.c_str());
     if (!dir) {
-	g_warning ("Unable to open the directory %s", m_searchPluginPath.c_str());
+	g_warning ("Unable to open the directory %s", path.c_str());
 	return;
     }
 
@@ -80,15 +93,23 @@ void OpenSearchHandler::scanExistingPlugins()
 	if (fileName == "." || fileName == "..")
 	    continue;
 
-	std::string pluginFilePath = m_searchPluginPath + std::string ("/") + fileName;
+	std::string pluginFilePath = path + std::string ("/") + fileName;
 
 	g_debug ("Scanning file %s", pluginFilePath.c_str());
-	parseXml (pluginFilePath, true);
+	OpenSearchInfo info;
+	if (readPluginFile (pluginFilePath, info))
+	    plugins.push_back (info);
     }
 
     closedir (dir);
 }
 
+void OpenSearchHandler::addScannedPlugins (std::vector<OpenSearchInfo>& plugins)
+{
+    for (unsigned int i = 0; i < plugins.size(); i++)
+	addPlugin (plugins[i], true);
+}
+
 bool OpenSearchHandler::downloadXml (LSHandle* lshandle, const std::string& xmlUrl) 
 {
     LSError lserror;
@@ -118,11 +139,22 @@ bool OpenSearchHandler::downloadXml (LSHandle* lshandle, const std::string& xmlU
 }
 
 bool OpenSearchHandler::parseXml (const std::string& xmlFile, bool scanningDir)
+{
+    OpenSearchInfo info;
+
+    if (!readPluginFile (xmlFile, info))
+	return false;
+
+    return addPlugin (info, scanningDir);
+}
+
+/*
+ * Only reads the file, so it is safe off the main thread.
+ */
+bool OpenSearchHandler::readPluginFile (const std::string& xmlFile, OpenSearchInfo& info)
 {
     xmlDocPtr doc;
     xmlNodePtr cur;
-    OpenSearchInfo info;
-    bool itemExist = false;
 
     doc = xmlParseFile (xmlFile.c_str());
 
@@ -257,11 +289,20 @@ bool OpenSearchHandler::parseXml (const std::string& xmlFile, bool scanningDir)
     g_debug ("search info -\n\tid: %s\n\tdisplayName: %s\n\tsearchUrl: %s\n\tsuggestionUrl: %s\n\timageData: %s\n",
 	    info.id.c_str(), info.displayName.c_str(), info.searchUrl.c_str(), info.suggestionUrl.c_str(), info.imageData.c_str());
 
+    xmlFreeDoc (doc);
+
     if (info.id.empty() || info.displayName.empty() || info.searchUrl.empty()) {
 	g_debug ("discarding info");
 	return false;
     }
-    
+
+    return true;
+}
+
+bool OpenSearchHandler::addPlugin (OpenSearchInfo& info, bool scanningDir)
+{
+    bool itemExist = false;
+
     //If it is already exist in the list then replace 
     if (SearchItemsManager::instance()->isSearchItemExist(info.id)) {
 	// need to change this to update information instead
@@ -307,6 +348,7 @@ bool OpenSearchHandler::parseXml (const std::string& xmlFile, bool scanningDir)
 	}
     g_debug ("adding info to m_osItems");
     m_osItems[info.id] = info;
+    m_generation++;
     //Do not notify the SystemUI if we are adding these items during boot up. The Dashboard should only be displayed when we download the xml for the first time.
     if(!scanningDir && !itemExist)
     	notifyOpenSearchItemAvailable(info.displayName);
@@ -413,25 +455,30 @@ gchar* OpenSearchHandler::unescapeString (const gchar *escaped, gsize& size)
 
 
 
-json_object*	OpenSearchHandler::getOpenSearchList()
+void	OpenSearchHandler::writeOpenSearchList(JsonWriter& writer)
 {
-    json_object* searchList = json_object_new_object();
-
-    json_object* osArray = json_object_new_array();
+    writer.key("Options").beginArray();
     for (std::map<std::string, OpenSearchInfo>::iterator it = m_osItems.begin(); it != m_osItems.end(); ++it) {
         if (SearchItemsManager::instance()->isSearchItemExist(it->second.id)) {
         	continue;
         }
-	json_object* osElem = json_object_new_object();
-	json_object_object_add (osElem, "id", json_object_new_string (it->second.id.c_str()));
-	json_object_object_add (osElem, "displayName", json_object_new_string (it->second.displayName.c_str()));
-	json_object_object_add (osElem, "searchUrl", json_object_new_string (it->second.searchUrl.c_str()));
-	json_object_object_add (osElem, "suggestionUrl", json_object_new_string (it->second.suggestionUrl.c_str()));
-	json_object_object_add (osElem, "imageData", json_object_new_string (it->second.imageData.c_str()));
-	json_object_array_add (osArray, osElem);
-    }
-    json_object_object_add (searchList, "Options", osArray);
-    return searchList;
+	writer.beginObject();
+	writer.key("id").value(it->second.id);
+	writer.key("displayName").value(it->second.displayName);
+	writer.key("searchUrl").value(it->second.searchUrl);
+	writer.key("suggestionUrl").value(it->second.suggestionUrl);
+	writer.key("imageData").value(it->second.imageData);
+	writer.endObject();
+    }
+    writer.endArray();
+}
+
+void	OpenSearchHandler::getOpenSearchItems(std::vector<OpenSearchInfo>& items)
+{
+    for (std::map<std::string, OpenSearchInfo>::iterator it = m_osItems.begin(); it != m_osItems.end(); ++it) {
+        if (!SearchItemsManager::instance()->isSearchItemExist(it->second.id))
+        	items.push_back(it->second);
+    }
 }
 
 bool 	OpenSearchHandler::clearOpenSearchList()
@@ -456,6 +503,7 @@ bool 	OpenSearchHandler::clearOpenSearchList()
 		
 		//remove it from the map.
 		m_osItems.erase(erase_item);
+		m_generation++;
 		
 	}
 	
@@ -499,6 +547,7 @@ bool	OpenSearchHandler::clearOpenSearchItem (const std::string id)
 {
     if (m_osItems.find (id) != m_osItems.end()) {
 	m_osItems.erase (id);
+	m_generation++;
 	unlink (id.c_str());
 	return true;
     }
@@ -508,6 +557,8 @@ bool	OpenSearchHandler::clearOpenSearchItem (const std::string id)
 
 bool OpenSearchHandler::cbDownloadManagerUpdate(LSHandle* lshandle, LSMessage *message, void *user_data) 
 {
+    STATS_SCOPE("cbDownloadManagerUpdate");
+    BUS_CAPTURE("cbDownloadManagerUpdate", message);
     LSError lserror;
     LSErrorInit(&lserror);
     bool success = false;
@@ -627,6 +678,8 @@ const char* OpenSearchHandler::downloadIcon (const std::string& imageUrl)
 
 bool OpenSearchHandler::cbDownloadManagerIconUpdate(LSHandle* lshandle, LSMessage *message, void *user_data) 
 {
+    STATS_SCOPE("cbDownloadManagerIconUpdate");
+    BUS_CAPTURE("cbDownloadManagerIconUpdate", message);
     LSError lserror;
     LSErrorInit(&lserror);
     bool success = false;
@@ -0,0 +1,594 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PayloadDecoder.h"
+
+RequestArena::RequestArena()
+{
+	m_next = m_inline;
+	m_left = s_inlineSize;
+	m_blocks = NULL;
+}
+
+RequestArena::~RequestArena()
+{
+	while (m_blocks) {
+		Block* next = m_blocks->next;
+		free(m_blocks);
+		m_blocks = next;
+	}
+}
+
+/*
+ * Big requests get a block of their own; what is left of the current block is
+ * abandoned when a new one is taken.
+ */
+char* RequestArena::allocate(size_t size)
+{
+	const size_t align = sizeof(void*);
+	char* memory;
+
+	size = (size + align - 1) & ~(align - 1);
+	if (size > m_left) {
+		size_t blockSize = size > s_blockSize - sizeof(Block) ? size + sizeof(Block) : s_blockSize;
+		Block* block = (Block*) malloc(blockSize);
+		if (!block)
+			return NULL;
+
+		block->next = m_blocks;
+		m_blocks = block;
+		m_next = (char*) (block + 1);
+		m_left = blockSize - sizeof(Block);
+	}
+
+	memory = m_next;
+	m_next += size;
+	m_left -= size;
+	return memory;
+}
+
+const char* RequestArena::copy(const char* text, size_t length)
+{
+	char* copy = allocate(length + 1);
+	if (!copy)
+		return "";
+
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+static const char* typeName(unsigned int type)
+{
+	switch (type) {
+	case PayloadNull: return "null";
+	case PayloadBool: return "a boolean";
+	case PayloadNumber: return "a number";
+	case PayloadString: return "a string";
+	case PayloadObject: return "an object";
+	case PayloadArray: return "an array";
+	default: return "a value";
+	}
+}
+
+//"a string or an object"
+static std::string typeNames(unsigned int types)
+{
+	std::string names;
+
+	for (unsigned int type = PayloadNull; type <= PayloadArray; type <<= 1) {
+		if (!(types & type))
+			continue;
+		if (!names.empty())
+			names += " or ";
+		names += typeName(type);
+	}
+	return names;
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static char* appendUtf8(char* out, unsigned int code)
+{
+	if (code < 0x80) {
+		*out++ = (char) code;
+	}
+	else if (code < 0x800) {
+		*out++ = (char) (0xc0 | (code >> 6));
+		*out++ = (char) (0x80 | (code & 0x3f));
+	}
+	else if (code < 0x10000) {
+		*out++ = (char) (0xe0 | (code >> 12));
+		*out++ = (char) (0x80 | ((code >> 6) & 0x3f));
+		*out++ = (char) (0x80 | (code & 0x3f));
+	}
+	else {
+		*out++ = (char) (0xf0 | (code >> 18));
+		*out++ = (char) (0x80 | ((code >> 12) & 0x3f));
+		*out++ = (char) (0x80 | ((code >> 6) & 0x3f));
+		*out++ = (char) (0x80 | (code & 0x3f));
+	}
+	return out;
+}
+
+/*
+ * The text being decoded. Every failure records its message with the offset from the
+ * start of the text and returns false, which the callers pass up.
+ */
+struct Scanner {
+	//What string() does with the text.
+	enum Strings {
+		Copy,		//into the arena, unescaped
+		Name,		//left in the text unless it has escapes
+		Skip		//only checked
+	};
+
+	Scanner(const char* start, const char* pos, const char* end, RequestArena& arena, std::string& error)
+		: start(start), pos(pos), end(end), arena(arena), error(error) {}
+
+	bool fail(const char* what, const char* at)
+	{
+		char offset[32];
+
+		snprintf(offset, sizeof(offset), " (at %d)", (int) (at - start));
+		error = what;
+		error += offset;
+		return false;
+	}
+
+	bool fail(const std::string& what, const char* at) { return fail(what.c_str(), at); }
+
+	void skipSpace()
+	{
+		while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r'))
+			pos++;
+	}
+
+	bool atEnd() const { return pos >= end; }
+
+	bool string(const char*& text, size_t& length, Strings mode)
+	{
+		const char* open = pos++;
+		const char* run = pos;
+		bool escaped = false;
+
+		while (pos < end && *pos != '"') {
+			if ((unsigned char) *pos < 0x20)
+				return fail("control character in a string", pos);
+			if (*pos == '\\') {
+				escaped = true;
+				pos++;
+			}
+			pos++;
+		}
+		if (pos >= end)
+			return fail("unterminated string", open);
+
+		length = pos - run;
+		pos++;
+
+		if (!escaped) {
+			text = mode == Copy ? arena.copy(run, length) : run;
+			return true;
+		}
+		return unescape(run, run + length, text, length, mode != Skip);
+	}
+
+	//Checks the escapes, and with output set writes the string into the arena.
+	bool unescape(const char* from, const char* to, const char*& text, size_t& length, bool output)
+	{
+		char buffer[4];
+		char* out = output ? arena.allocate(to - from + 1) : buffer;
+		char* begin = out;
+
+		if (!out)
+			return fail("out of memory", from);
+
+		while (from < to) {
+			if (*from != '\\') {
+				if (output)
+					*out++ = *from;
+				from++;
+				continue;
+			}
+
+			//Without output the escapes go to the scratch buffer.
+			const char* escape = from++;
+			if (!output)
+				out = buffer;
+			switch (*from++) {
+			case '"': *out++ = '"'; break;
+			case '\\': *out++ = '\\'; break;
+			case '/': *out++ = '/'; break;
+			case 'b': *out++ = '\b'; break;
+			case 'f': *out++ = '\f'; break;
+			case 'n': *out++ = '\n'; break;
+			case 'r': *out++ = '\r'; break;
+			case 't': *out++ = '\t'; break;
+			case 'u': {
+				unsigned int code = 0;
+				if (!hex4(from, to, code))
+					return fail("bad \\u escape", escape);
+				from += 4;
+
+				//A high surrogate takes the low one after it.
+				if (code >= 0xd800 && code < 0xdc00) {
+					unsigned int low = 0;
+					if (to - from < 6 || from[0] != '\\' || from[1] != 'u' || !hex4(from + 2, to, low) || low < 0xdc00 || low >= 0xe000)
+						return fail("unpaired surrogate in a \\u escape", escape);
+					from += 6;
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+				}
+				else if (code >= 0xdc00 && code < 0xe000) {
+					return fail("unpaired surrogate in a \\u escape", escape);
+				}
+
+				//Fits: the escape is longer than its UTF-8.
+				out = appendUtf8(out, code);
+				break;
+			}
+			default:
+				return fail("bad escape in a string", escape);
+			}
+		}
+
+		if (output) {
+			*out = '\0';
+			text = begin;
+			length = out - begin;
+		}
+		return true;
+	}
+
+	static bool hex4(const char* from, const char* to, unsigned int& code)
+	{
+		if (to - from < 4)
+			return false;
+
+		code = 0;
+		for (int i = 0; i < 4; i++) {
+			int digit = hexValue(from[i]);
+			if (digit < 0)
+				return false;
+			code = (code << 4) | digit;
+		}
+		return true;
+	}
+
+	bool literal(const char* word)
+	{
+		size_t length = strlen(word);
+
+		if ((size_t) (end - pos) < length || memcmp(pos, word, length) != 0)
+			return fail("unexpected character", pos);
+		pos += length;
+		return true;
+	}
+
+	bool number(double& value)
+	{
+		const char* begin = pos;
+		char buffer[64];
+
+		if (pos < end && *pos == '-')
+			pos++;
+		if (pos < end && *pos == '0') {
+			pos++;
+		}
+		else if (pos < end && *pos >= '1' && *pos <= '9') {
+			while (pos < end && *pos >= '0' && *pos <= '9')
+				pos++;
+		}
+		else {
+			return fail("bad number", begin);
+		}
+
+		if (pos < end && *pos == '.') {
+			pos++;
+			if (pos >= end || *pos < '0' || *pos > '9')
+				return fail("bad number", begin);
+			while (pos < end && *pos >= '0' && *pos <= '9')
+				pos++;
+		}
+
+		if (pos < end && (*pos == 'e' || *pos == 'E')) {
+			pos++;
+			if (pos < end && (*pos == '+' || *pos == '-'))
+				pos++;
+			if (pos >= end || *pos < '0' || *pos > '9')
+				return fail("bad number", begin);
+			while (pos < end && *pos >= '0' && *pos <= '9')
+				pos++;
+		}
+
+		if ((size_t) (pos - begin) >= sizeof(buffer))
+			return fail("number too long", begin);
+
+		memcpy(buffer, begin, pos - begin);
+		buffer[pos - begin] = '\0';
+		value = g_ascii_strtod(buffer, NULL);
+		return true;
+	}
+
+	/*
+	 * Any value at pos. Objects and arrays are checked and kept as text; strings are
+	 * copied out unless the value is only skipped.
+	 */
+	bool value(PayloadValue& value, int depth, bool skip)
+	{
+		const char* begin = pos;
+
+		if (atEnd())
+			return fail("value expected", pos);
+
+		switch (*pos) {
+		case '"':
+			value.type = PayloadString;
+			return string(value.text, value.length, skip ? Skip : Copy);
+		case '{':
+			value.type = PayloadObject;
+			if (!skipObject(depth))
+				return false;
+			break;
+		case '[':
+			value.type = PayloadArray;
+			if (!skipArray(depth))
+				return false;
+			break;
+		case 't':
+		case 'f':
+			value.type = PayloadBool;
+			value.boolean = *pos == 't';
+			if (!literal(value.boolean ? "true" : "false"))
+				return false;
+			break;
+		case 'n':
+			value.type = PayloadNull;
+			if (!literal("null"))
+				return false;
+			break;
+		default:
+			value.type = PayloadNumber;
+			if (!number(value.number))
+				return false;
+			break;
+		}
+
+		value.text = begin;
+		value.length = pos - begin;
+		return true;
+	}
+
+	bool skipObject(int depth)
+	{
+		const char* text;
+		size_t length;
+		PayloadValue member;
+
+		if (depth >= PayloadDecoder::s_maxDepth)
+			return fail("nested too deeply", pos);
+
+		pos++;
+		skipSpace();
+		if (!atEnd() && *pos == '}') {
+			pos++;
+			return true;
+		}
+
+		while (true) {
+			skipSpace();
+			if (atEnd() || *pos != '"')
+				return fail("member name expected", pos);
+			if (!string(text, length, Skip))
+				return false;
+
+			skipSpace();
+			if (atEnd() || *pos != ':')
+				return fail("':' expected", pos);
+			pos++;
+			skipSpace();
+			if (!value(member, depth + 1, true))
+				return false;
+
+			skipSpace();
+			if (!atEnd() && *pos == ',') {
+				pos++;
+				continue;
+			}
+			if (!atEnd() && *pos == '}') {
+				pos++;
+				return true;
+			}
+			return fail("',' or '}' expected", pos);
+		}
+	}
+
+	bool skipArray(int depth)
+	{
+		PayloadValue element;
+
+		if (depth >= PayloadDecoder::s_maxDepth)
+			return fail("nested too deeply", pos);
+
+		pos++;
+		skipSpace();
+		if (!atEnd() && *pos == ']') {
+			pos++;
+			return true;
+		}
+
+		while (true) {
+			skipSpace();
+			if (!value(element, depth + 1, true))
+				return false;
+
+			skipSpace();
+			if (!atEnd() && *pos == ',') {
+				pos++;
+				continue;
+			}
+			if (!atEnd() && *pos == ']') {
+				pos++;
+				return true;
+			}
+			return fail("',' or ']' expected", pos);
+		}
+	}
+
+	const char* start;
+	const char* pos;
+	const char* end;
+	RequestArena& arena;
+	std::string& error;
+};
+
+//The schema member of a name that is still in the text, or -1.
+static int findMember(const PayloadSchema& schema, const char* name, size_t length)
+{
+	for (int i = 0; i < schema.count; i++) {
+		if (strncmp(schema.fields[i].name, name, length) == 0 && schema.fields[i].name[length] == '\0')
+			return i;
+	}
+	return -1;
+}
+
+bool PayloadDecoder::decode(const PayloadSchema& schema, const char* text, size_t length, PayloadValue* values,
+		RequestArena& arena, bool skipUnknown, std::string& error)
+{
+	Scanner scanner(text, text, text + length, arena, error);
+	PayloadValue skipped;
+	const char* name;
+	const char* nameStart;
+	size_t nameLength;
+	int index;
+
+	if (!text || !length) {
+		error = "empty payload";
+		return false;
+	}
+
+	scanner.skipSpace();
+	if (scanner.atEnd() || *scanner.pos != '{')
+		return scanner.fail("the payload is not an object", scanner.pos);
+	scanner.pos++;
+	scanner.skipSpace();
+
+	if (!scanner.atEnd() && *scanner.pos == '}') {
+		scanner.pos++;
+	}
+	else {
+		while (true) {
+			scanner.skipSpace();
+			nameStart = scanner.pos;
+			if (scanner.atEnd() || *scanner.pos != '"')
+				return scanner.fail("member name expected", scanner.pos);
+			if (!scanner.string(name, nameLength, Scanner::Name))
+				return false;
+
+			index = findMember(schema, name, nameLength);
+			if (index < 0 && !skipUnknown)
+				return scanner.fail("unknown member '" + std::string(name, nameLength) + "'", nameStart);
+
+			scanner.skipSpace();
+			if (scanner.atEnd() || *scanner.pos != ':')
+				return scanner.fail("':' expected", scanner.pos);
+			scanner.pos++;
+			scanner.skipSpace();
+
+			const char* valueStart = scanner.pos;
+			PayloadValue& value = index >= 0 ? values[index] : skipped;
+			if (!scanner.value(value, 1, index < 0))
+				return false;
+
+			if (index >= 0 && !(schema.fields[index].types & value.type)) {
+				return scanner.fail("'" + std::string(schema.fields[index].name) + "' must be "
+						+ typeNames(schema.fields[index].types), valueStart);
+			}
+
+			scanner.skipSpace();
+			if (!scanner.atEnd() && *scanner.pos == ',') {
+				scanner.pos++;
+				continue;
+			}
+			if (!scanner.atEnd() && *scanner.pos == '}') {
+				scanner.pos++;
+				break;
+			}
+			return scanner.fail("',' or '}' expected", scanner.pos);
+		}
+	}
+
+	scanner.skipSpace();
+	if (!scanner.atEnd())
+		return scanner.fail("unexpected text after the object", scanner.pos);
+
+	for (index = 0; index < schema.count; index++) {
+		if (schema.fields[index].required && !values[index].present()) {
+			error = "'" + std::string(schema.fields[index].name) + "' is missing";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+PayloadArrayReader::PayloadArrayReader(const PayloadValue& array, RequestArena& arena)
+	: m_start(array.text), m_next(array.text), m_end(array.text + array.length), m_arena(arena), m_first(true)
+{
+	if (array.type != PayloadArray)
+		m_next = m_end;
+}
+
+bool PayloadArrayReader::next(PayloadValue& element)
+{
+	Scanner scanner(m_start, m_next, m_end, m_arena, m_error);
+
+	scanner.skipSpace();
+	if (scanner.atEnd())
+		return false;
+
+	//The opening bracket, then a comma before every element but the first one.
+	if (*scanner.pos == ']')
+		return false;
+	if (*scanner.pos != (m_first ? '[' : ','))
+		return scanner.fail("',' or ']' expected", scanner.pos);
+	scanner.pos++;
+	scanner.skipSpace();
+	if (m_first && !scanner.atEnd() && *scanner.pos == ']')
+		return false;
+	m_first = false;
+
+	if (!scanner.value(element, 1, false))
+		return false;
+
+	m_next = scanner.pos;
+	return true;
+}
@@ -16,28 +16,43 @@
 //
 // LICENSE@@@
 
+#include <set>
+#include <vector>
+#include <stdio.h>
+#include <sys/stat.h>
+
 #include "SearchItemsManager.h"
 #include "UniversalSearchPrefsDb.h"
 #include "UniversalSearchService.h"
 #include "Logging.h"
 #include "USUtils.h"
+#include "CatalogueSnapshot.h"
+#include "ServiceStats.h"
 
 static const char* s_logChannel = "SearchItemsManager";
 static const char* s_defaultPrefFile = "/usr/palm/universalsearchmgr/resources/en_us/UniversalSearchList.json";
 static const char* s_custUniversalSearchPrefFile = "/usr/lib/luna/customization/UniversalSearchList.json";
+//Spacing of the sort keys when a list is numbered from scratch.
+static const int s_positionGap = 1 << 12;
 SearchItemsManager* SearchItemsManager::s_simgr_instance = 0;
 
 SearchItemsManager::SearchItemsManager() 
 {
 	s_simgr_instance = this;
 	dbHandler = UniversalSearchPrefsDb::instance();
+	m_generation = 0;
+	m_snapshot = NULL;
+	m_inBatch = false;
+	m_batchAppDescriptorsLoaded = false;
+	m_catalogueSavePending = false;
+	m_appDescriptorsLoaded = false;
 	USUtils::initRandomGenerator();
 
 }
 
 SearchItemsManager::~SearchItemsManager() 
 {
-	
+	delete m_snapshot;
 }
 
 SearchItemsManager* SearchItemsManager::instance() 
@@ -52,6 +67,9 @@ SearchItemsManager* SearchItemsManager::instance()
 
 void SearchItemsManager::init() 
 {
+	if (loadCatalogueSnapshot())
+		return;
+	
 	readFromDatabase();
 	readFromDefaultFile();
 	readFromCustFile();
@@ -60,481 +78,481 @@ void SearchItemsManager::init()
 	syncPrefDb();
 }
 
-void SearchItemsManager::readFromDatabase() {
-	int prefsInDb = 0;
-	json_object* label = NULL;
-	json_object* searchListObj = json_object_new_array();
+/*
+ * Same as init() with the database rows already read (by the startup pipeline).
+ */
+void SearchItemsManager::init(const UniversalSearchPrefsDb::RecordBuffer& dbRows) 
+{
+	if (loadCatalogueSnapshot())
+		return;
 	
-	prefsInDb = dbHandler->readPrefDb(searchListObj);
+	readFromDatabase(dbRows);
+	readFromDefaultFile();
+	readFromCustFile();
 	
-	if(prefsInDb > 0) {
-		for (int i = 0; i < json_object_array_length(searchListObj); i++) {
-			json_object* obj = (json_object*) json_object_array_get_idx(searchListObj, i);
-			std::string category;
-				
-			label = json_object_object_get(obj, "category");
-			if (!label || is_error(label))
-				continue;
-			
-				category = json_object_get_string(label);
-				
-				if(category.compare("search") == 0)
-					addSearchItem(json_object_get_string(obj), false, false,false);
-				else if(category.compare("action") == 0)
-					addActionProvider(json_object_get_string(obj), false, false, false);
-				else if(category.compare("dbsearch") == 0)
-					addDBSearchItem(json_object_get_string(obj), false, false,false);
-				else
-					continue;
-			}
+	//Sync the Database
+	syncPrefDb();
+}
+
+std::string SearchItemsManager::catalogueSnapshotPath() const
+{
+	return dbHandler->getPath() + ".snapshot";
+}
+
+std::string SearchItemsManager::catalogueSnapshotKey() const
+{
+	std::string locale = UniversalSearchService::instance()->getLocale();
+	std::string inputs[6];
+	std::string key = "locale " + locale + "\n";
+	
+	inputs[0] = "/usr/palm/universalsearchmgr/resources/" + locale + "/UniversalSearchList.json";
+	inputs[1] = s_defaultPrefFile;
+	inputs[2] = "/usr/lib/luna/customization/resources/" + locale + "/UniversalSearchList.json";
+	inputs[3] = s_custUniversalSearchPrefFile;
+	inputs[4] = dbHandler->getPath();
+	inputs[5] = dbHandler->getPath() + "-wal";
+	
+	for (int i = 0; i < 6; i++) {
+		struct stat st;
+		char buffer[64];
+		
+		if (stat(inputs[i].c_str(), &st) != 0)
+			snprintf(buffer, sizeof(buffer), " -\n");
+		else
+			snprintf(buffer, sizeof(buffer), " %lld.%09ld %lld\n", (long long) st.st_mtime, (long) st.st_mtim.tv_nsec, (long long) st.st_size);
+		key += inputs[i];
+		key += buffer;
 	}
 	
-	if(searchListObj && !is_error(searchListObj))
-		json_object_put(searchListObj);
+	return key;
 }
 
-void SearchItemsManager::readFromDefaultFile() 
+/*
+ * Replaces the lists with the snapshot content. Everything is decoded into local
+ * lists first, a damaged payload leaves the lists as they were.
+ */
+bool SearchItemsManager::loadCatalogueSnapshot()
 {
-	// Read the locale file
-	char localizedPrefFileName[100];
+	STATS_SCOPE("catalogueSnapshot.load");
+	CatalogueSnapshot snapshot;
+	SearchProvidersList searchProviders;
+	ActionProvidersList actionProviders;
+	MojoDBSearchItemList dbSearchItems;
 	
-	sprintf(localizedPrefFileName, "/usr/palm/universalsearchmgr/resources/%s/UniversalSearchList.json", UniversalSearchService::instance()->getLocale().c_str());
-	luna_critical(s_logChannel, "Reading from file :: %s", localizedPrefFileName);
-	char* jsonStr = USUtils::readFile(localizedPrefFileName);
+	if (!snapshot.load(catalogueSnapshotPath(), catalogueSnapshotKey()))
+		return false;
 	
-	if (!jsonStr) {
-		luna_critical(s_logChannel, "Failed to load localized file: [%s]", localizedPrefFileName);
-		
-		jsonStr = USUtils::readFile(s_defaultPrefFile);
-		
-		if(!jsonStr) {
-			luna_critical(s_logChannel, "Fatal Error - Failed to load default file: [%s]", s_defaultPrefFile);
-			return;
-		}
+	CatalogueSnapshot::Reader reader = snapshot.reader();
+	
+	if (!searchProviders.load(reader) || !actionProviders.load(reader) || !dbSearchItems.load(reader) || !reader.atEnd()) {
+		luna_critical(s_logChannel, "Malformed catalogue snapshot, merging the sources");
+		return false;
 	}
+	
+	m_searchProvidersList.swap(searchProviders);
+	m_actionProvidersList.swap(actionProviders);
+	m_mojodbSearchItemList.swap(dbSearchItems);
+	listChanged();
+	
+	luna_critical(s_logChannel, "Loaded the lists from the catalogue snapshot");
+	return true;
+}
 
-	json_object* root = 0;
-	json_object* label = 0;
-	array_list* searchArray = 0;
+void SearchItemsManager::saveCatalogueSnapshot()
+{
+	STATS_SCOPE("catalogueSnapshot.save");
+	CatalogueSnapshot::Writer writer;
+	
+	m_searchProvidersList.save(writer);
+	m_actionProvidersList.save(writer);
+	m_mojodbSearchItemList.save(writer);
+	
+	//The key is taken now, after the writes; any later write makes the snapshot stale.
+	CatalogueSnapshot::save(catalogueSnapshotPath(), catalogueSnapshotKey(), writer);
+}
 
-	root = json_tokener_parse(jsonStr);
-	if (!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse preference file contents into json");
-		goto Done;
+/*
+ * The snapshot must not be ahead of the database, so it is written only once the
+ * writes queued so far are on disk.
+ */
+void SearchItemsManager::scheduleCatalogueSave()
+{
+	if (m_catalogueSavePending)
+		return;
+	
+	m_catalogueSavePending = true;
+	dbHandler->flushAsync(cbSaveCatalogueSnapshot, this);
+}
+
+gboolean SearchItemsManager::cbSaveCatalogueSnapshot(gpointer data)
+{
+	SearchItemsManager* manager = (SearchItemsManager*) data;
+	
+	manager->m_catalogueSavePending = false;
+	manager->saveCatalogueSnapshot();
+	
+	return FALSE;
+}
+
+void SearchItemsManager::reloadForLocale()
+{
+	getEnabledStates(m_carriedEnabledStates);
+	
+	//Everything happens within this call on the main loop, so no reply or broadcast
+	//ever sees the lists half built.
+	m_searchProvidersList.clear();
+	m_actionProvidersList.clear();
+	m_mojodbSearchItemList.clear();
+	init();
+	
+	//The hashes belong to the partition.
+	m_appDescriptorHashes.clear();
+	m_appsWithoutDescriptor.clear();
+	m_appDescriptorsLoaded = false;
+	
+	applyEnabledStates(m_carriedEnabledStates);
+	listChanged();
+	scheduleCatalogueSave();
+}
+
+void SearchItemsManager::applyCarriedEnabledStates()
+{
+	if (m_carriedEnabledStates.empty())
+		return;
+	
+	applyEnabledStates(m_carriedEnabledStates);
+	m_carriedEnabledStates.clear();
+}
+
+void SearchItemsManager::getEnabledStates(EnabledStates& states) const
+{
+	states.clear();
+	getEnabledStates(m_searchProvidersList, states);
+	getEnabledStates(m_actionProvidersList, states);
+	getEnabledStates(m_mojodbSearchItemList, states);
+}
+
+void SearchItemsManager::applyEnabledStates(const EnabledStates& states)
+{
+	bool changed = applyEnabledStates(m_searchProvidersList, states);
+	changed = applyEnabledStates(m_actionProvidersList, states) || changed;
+	changed = applyEnabledStates(m_mojodbSearchItemList, states) || changed;
+	
+	if (changed)
+		listChanged();
+}
+
+void SearchItemsManager::readFromDatabase() {
+	DatabaseReader reader(*this);
+	
+	dbHandler->readPrefDb(reader);
+}
+
+void SearchItemsManager::readFromDatabase(const UniversalSearchPrefsDb::RecordBuffer& records) {
+	DatabaseReader reader(*this);
+	
+	records.replay(reader);
+}
+
+void SearchItemsManager::DatabaseReader::visit(const UniversalSearchPrefsDb::SearchRecord& record)
+{
+	if (record.category == "search")
+		m_manager.addDatabaseItem(m_manager.m_searchProvidersList, record);
+	else if (record.category == "action")
+		m_manager.addDatabaseItem(m_manager.m_actionProvidersList, record);
+}
+
+template <class Traits>
+void SearchItemsManager::addDatabaseItem(ProviderList<Traits>& list, const typename Traits::Record& record)
+{
+	typename Traits::Item item = typename Traits::Item();
+	size_t pos = list.size();
+
+	if (record.id.empty())
+		return;
+
+	if (list.contains(record.id)) {
+		luna_critical(s_logChannel, "%s item %s already exist", Traits::category(), record.id.c_str());
+		return;
 	}
 
-	label = json_object_object_get(root, "UniversalSearchList");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Failed to get UniversalSearchList entry from preference file");
-		goto Done;
+	ProviderList<Traits>::fromRecord(record, item);
+	if (!Traits::acceptStored(item))
+		return;
+
+	item.appExist = false;
+	item.dirty = true;
+	list.push_back(item);
+
+	//Rows of older databases have no position; they stay dirty and get written with the one they are given.
+	if (record.hasPosition && (pos == 0 || list[pos - 1].position < record.position))
+		list[pos].dirty = false;
+	else
+		placeItem(list, pos);
+	listChanged();
+}
+
+static bool isJson(const std::string& text)
+{
+	json_object* parsed = json_tokener_parse(text.c_str());
+
+	if (!parsed || is_error(parsed))
+		return false;
+	json_object_put(parsed);
+	return true;
+}
+
+//Only icons that exist are kept.
+static void dropMissingIcon(PooledString& iconFilePath)
+{
+	if (!iconFilePath.empty() && !USUtils::doesExistOnFilesystem(iconFilePath.c_str()))
+		iconFilePath.clear();
+}
+
+bool SearchItemsManager::SearchTraits::accept(SearchItemsManager& manager, Item& item, const ProviderFieldSet& present)
+{
+	if (!present.has(Fields::url)) {
+		luna_critical(s_logChannel, "url is missing");
+		return false;
 	}
 
-	searchArray = json_object_get_array(label);
-	if (!searchArray) {
-		luna_critical(s_logChannel, "Failed to get search list array from preference file");
-		goto Done;
+	return acceptStored(item);
+}
+
+bool SearchItemsManager::SearchTraits::acceptStored(Item& item)
+{
+	if (item.type.empty())
+		item.type = "web";
+
+	//If launch param is empty then there is no point adding this app into Universal Search.
+	if (item.type == "app" && item.launchParam.empty())
+		return false;
+
+	dropMissingIcon(item.iconFilePath);
+	return true;
+}
+
+bool SearchItemsManager::ActionTraits::accept(SearchItemsManager& manager, Item& item, const ProviderFieldSet& present)
+{
+	dropMissingIcon(item.iconFilePath);
+	if (!present.has(Fields::displayName) && item.iconFilePath.empty()) {
+		luna_critical(s_logChannel, "Both ImageFile and DisplayName are missing");
+		return false;
 	}
 
-	for (int i = 0; i < array_list_length(searchArray); i++) {
-		json_object* obj = (json_object*) array_list_get_idx(searchArray, i);
-		std::string category;
-		
-		label = json_object_object_get(obj, "category");
-		if (!label || is_error(label))
-			continue;
-		
-		category = json_object_get_string(label);
-		
-		if(category == "search")
-			addSearchItem(json_object_get_string(obj), false, false, false);
-		else if(category.compare("action") == 0)
-			addActionProvider(json_object_get_string(obj), false, false, false);
-		else if(category.compare("dbsearch") == 0)
-			addDBSearchItem(json_object_get_string(obj), false, false, false);
-		else
-			continue;
-	
+	if (!present.has(Fields::url)) {
+		luna_critical(s_logChannel, "url is missing");
+		return false;
 	}
-	
-	//Read search Preference
-	label = json_object_object_get(root, "SearchPreference");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Failed to get SearchPreference entry from preference file");
-		goto Done;
+
+	if (!present.has(Fields::launchParam)) {
+		luna_critical(s_logChannel, "launchParam is missing");
+		return false;
 	}
-	
-	m_searchPrefStr = json_object_to_json_string(label);
-	
-	Done:
-		
-		if(root && !is_error(root))
-			json_object_put(root);
-				
-		delete [] jsonStr;
-	
+
+	return acceptStored(item);
 }
 
-void SearchItemsManager::readFromCustFile()
+bool SearchItemsManager::ActionTraits::acceptStored(Item& item)
 {
-	// Read from the localized customization file
-	char localizedCustPrefFileName[100];
-	sprintf(localizedCustPrefFileName, "/usr/lib/luna/customization/resources/%s/UniversalSearchList.json", UniversalSearchService::instance()->getLocale().c_str());
-	luna_critical(s_logChannel, "Reading from file :: %s", localizedCustPrefFileName);
+	//launch param is empty. ignore the entry.
+	if (item.launchParam.empty())
+		return false;
 
-	char* jsonStr = USUtils::readFile(localizedCustPrefFileName);
-	json_object* searchPref = NULL;
-	bool fileExist = true;
-	
-	json_object* root = 0;
-	json_object* label = 0;
-	array_list* searchArray = 0;
-	std::string category, id;
-	bool remove = false;
-	bool enabledExist = false;
-	
-	if (!jsonStr) {
-		luna_critical(s_logChannel, "Failed to load locale cust files: [%s]", localizedCustPrefFileName);
+	dropMissingIcon(item.iconFilePath);
+	return true;
+}
 
-		//Try the default location
-		jsonStr = USUtils::readFile(s_custUniversalSearchPrefFile);
+bool SearchItemsManager::DBSearchTraits::accept(SearchItemsManager& manager, Item& item, const ProviderFieldSet& present)
+{
+	if (!present.has(Fields::dbQuery)) {
+		luna_critical(s_logChannel, "DbQuery property is missing");
+		return false;
+	}
 
-		if(!jsonStr) {
-			luna_critical(s_logChannel, "Failed to load cust files: [%s]", s_custUniversalSearchPrefFile);
-			fileExist = false;
-			goto SyncSearchPref;
-		}
+	if (!manager.validateDbSearchItem(item.id, item.dbQuery.c_str())) {
+		luna_critical(s_logChannel, "DbQuery Validation Failed");
+		return false;
 	}
 
-	root = json_tokener_parse(jsonStr);
-	if (!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse preference file contents into json");
-		goto Done;
+	if (!present.has(Fields::displayName)) {
+		luna_critical(s_logChannel, "DisplayName is missing");
+		return false;
 	}
 
-	label = json_object_object_get(root, "UniversalSearchList");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Failed to get UniversalSearchList entry from preference file");
-		goto Done;
+	if (!present.has(Fields::displayFields)) {
+		luna_critical(s_logChannel, "displayFields is missing");
+		return false;
 	}
 
-	searchArray = json_object_get_array(label);
-	if (!searchArray) {
-		luna_critical(s_logChannel, "Failed to get search list array from preference file");
-		goto Done;
+	return acceptStored(item);
+}
+
+bool SearchItemsManager::DBSearchTraits::acceptStored(Item& item)
+{
+	//Both go into the replies as they are stored.
+	if (!isJson(item.dbQuery) || (item.displayFields.str().find_first_of('[') != std::string::npos && !isJson(item.displayFields))) {
+		luna_critical(s_logChannel, "Malformed dbQuery or displayFields of %s", item.id.c_str());
+		return false;
 	}
 
-	for (int i = 0; i < array_list_length(searchArray); i++) {
-		json_object* obj = (json_object*) array_list_get_idx(searchArray, i);
-		
-		label = json_object_object_get(obj, "id");
-		if(!label || is_error(label)) {
-			luna_critical(s_logChannel, "Id is missing in the Cust File");
-			continue;
-		}
-		id = json_object_get_string(label);
-		
-		//Check this is to remove the object.
-		label = json_object_object_get(obj, "remove");
-		if(label && !is_error(label)) {
-			remove = json_object_get_boolean(label);
-		}
-		else
-			remove = false;
-		
-		label = json_object_object_get(obj, "category");
-		if (label && !is_error(label))
-			category = json_object_get_string(label);
+	dropMissingIcon(item.iconFilePath);
+	return true;
+}
 
-		//Check if "enabled" field exist.
-		label = json_object_object_get(obj, "enabled");
-		if (label && !is_error(label)) {
-			enabledExist = true;
-		}
-		else
-			enabledExist = false;
-		
-		//Remove the object from the list
-		if(remove) {
-			if(category.empty()) {
-				removeSearchItem(json_object_get_string(obj));
-				removeActionProvider(json_object_get_string(obj));
-				removeDBSearchItem(json_object_get_string(obj));
-			}
-			else {
-				if(category == "search")
-					removeSearchItem(json_object_get_string(obj));
-				else if(category.compare("action") == 0)
-					removeActionProvider(json_object_get_string(obj));
-				else if(category.compare("dbsearch") == 0)
-					removeDBSearchItem(json_object_get_string(obj));
-			}
-		}
-		else if(enabledExist) {
-			if(category.empty()) {
-				modifySearchItem(json_object_get_string(obj));
-				modifyActionProvider(json_object_get_string(obj));
-				modifyDBSearchItem(json_object_get_string(obj));
-			}
-			else {
-				//This could be either an update or a new item. We don't know at this point, hence calling both modify and add methods which will do the right thing.
-				if(category == "search") {
-					modifySearchItem(json_object_get_string(obj));
-					addSearchItem(json_object_get_string(obj), false, false, false);
-				}
-				else if(category.compare("action") == 0) {
-					modifyActionProvider(json_object_get_string(obj));
-					addActionProvider(json_object_get_string(obj), false, false, false);
-				}
-				else if(category.compare("dbsearch") == 0) {
-					modifyDBSearchItem(json_object_get_string(obj));
-					addDBSearchItem(json_object_get_string(obj), false, false, false);
-				}
-			}
-		}
+//Adds an item of a resource file or batch operation, see below.
+template <class Traits>
+bool SearchItemsManager::addItem(ProviderList<Traits>& list, json_object* root, bool dbSync, bool overwrite, bool appExist)
+{
+	typename Traits::Item item = typename Traits::Item();
+	ProviderFieldSet present;
+	json_object* label = NULL;
+	bool setDefault = false;
+
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
 	}
-	
-	SyncSearchPref:
-	
-		searchPref = json_tokener_parse(m_searchPrefStr.c_str());
-		if(!searchPref || is_error(searchPref)) {
-			luna_critical(s_logChannel, "Failed to parse SearchPreference entry from cust preference file");
-			goto Done;
-		}
-		
-		if(fileExist) {
-			//Read search Preference
-			label = json_object_object_get(root, "SearchPreference");
-			if (label && !is_error(label)) {
-				json_object_object_foreach(label, key, val) {
-		
-					if(val == NULL)
-						continue;
-					
-					json_object_object_add(searchPref, key, val);
-				}
-			}
-		}
-	
-		dbHandler->syncSearchPreferenceDb(json_object_get_string(searchPref));
-	
-	Done:
-				
-		delete [] jsonStr;
+
+	label = json_object_object_get(root, "id");
+	if (label && !is_error(label))
+		item.id = json_object_get_string(label);
+
+	label = json_object_object_get(root, "setDefault");
+	if (label && !is_error(label))
+		setDefault = json_object_get_boolean(label);
+
+	ProviderList<Traits>::decode(root, item, present);
+	return addItem(list, item, present, setDefault, dbSync, overwrite, appExist);
 }
 
-/*
- * Returns the search list array.
- */
-json_object* SearchItemsManager::getSearchList() 
+//The same for a decoded request.
+template <class Traits>
+bool SearchItemsManager::addItem(ProviderList<Traits>& list, const ItemRequest& request, bool dbSync, bool overwrite, bool appExist)
 {
-	json_object* objArray = json_object_new_array();
-	
-	for(SearchProvidersList::const_iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		
-		SearchProvider searchProvider =  (*it);
-		
-		json_object* infoObj = json_object_new_object();
-		json_object_object_add(infoObj,(char*) "id",json_object_new_string((char*) searchProvider.id.c_str()));
-		json_object_object_add(infoObj,(char*) "displayName",json_object_new_string((char*) searchProvider.displayName.c_str()));
-		json_object_object_add(infoObj,(char*) "iconFilePath",json_object_new_string((char*) searchProvider.iconFilePath.c_str()));
-		json_object_object_add(infoObj,(char*) "url",json_object_new_string((char*) searchProvider.url.c_str()));
-		json_object_object_add(infoObj,(char*) "suggestURL",json_object_new_string((char*) searchProvider.suggestURL.c_str()));
-		json_object_object_add(infoObj,(char*) "launchParam",json_object_new_string((char*) searchProvider.launchParam.c_str()));
-		json_object_object_add(infoObj,(char*) "type",json_object_new_string((char*) searchProvider.type.c_str()));
-		json_object_object_add(infoObj,(char*) "enabled",json_object_new_boolean(searchProvider.enabled));
-		
-		json_object_array_add(objArray, infoObj);
-		
-	}
-	return objArray;
+	typename Traits::Item item = typename Traits::Item();
+	ProviderFieldSet present;
+
+	item.id.assign(request[ItemPayload::id].text, request[ItemPayload::id].length);
+	ProviderList<Traits>::decode(request, item, present);
+	return addItem(list, item, present, request[ItemPayload::setDefault].boolean, dbSync, overwrite, appExist);
 }
 
-//add an item to the list
-bool SearchItemsManager::addSearchItem(const char* jsonStr, bool dbSync, bool overwrite, bool appExist)
+/*
+ * Adds a decoded item; present tells which fields it came with. An item that is
+ * already there is replaced if overwrite is set, keeping its enabled state and its
+ * place, or if the new one has a higher version. Replacing it with the same content
+ * only marks its app as present.
+ */
+template <class Traits>
+bool SearchItemsManager::addItem(ProviderList<Traits>& list, typename Traits::Item& item, const ProviderFieldSet& present,
+		bool setDefault, bool dbSync, bool overwrite, bool appExist)
 {
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	std::string imageFilePath;
-	std::string id;
-	int version = 1;
-	bool enabled = false;
+	typedef ProviderList<Traits> List;
+	typedef typename Traits::Fields Fields;
+	typename List::iterator it;
+	size_t itemIndex = List::npos;
 	char idValue[20];
 	bool success = true;
-	bool imgFileExist = true;
-	SearchProvider searchProvider;
-	SearchProvidersList::iterator it;
-	int itemIndex;
-	bool setDefault = false;
-	bool replaceItem = false;
-	
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
 
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
+	if (item.id.empty()) {
+		if (!Traits::s_generatesId) {
+			luna_critical(s_logChannel, "id is missing");
+			success = false;
+			goto Done;
+		}
 		//Get the Unique value
-		sprintf(idValue, "User-%d", USUtils::getUniqueId() );
-		id = idValue;
-	}
-	else 
-		id = json_object_get_string(label);
-	
-	label = json_object_object_get(root, "version");
-	if (label && !is_error(label)) {
-		version = json_object_get_int(label);
-	}
-	
-	if(id.find("com.palm.app",0) != std::string::npos) {
-		enabled = true; //Privileged App. Enabled by default.
-	}
-	
-	label = json_object_object_get(root, "enabled");
-	if (label && !is_error(label)) {
-		enabled = json_object_get_int(label);
+		sprintf(idValue, "User-%d", USUtils::getUniqueId());
+		item.id = idValue;
 	}
 
+	if (!present.has(Fields::version))
+		item.version = 1;
+	if (!present.has(Fields::enabled))
+		item.enabled = item.id.str().find("com.palm.app", 0) != std::string::npos; //Privileged App. Enabled by default.
+	item.appExist = appExist;
+	item.dirty = !dbSync;
+
 	//check for duplication
-	//Iterate the list to find the matching object.
-	for(it=m_searchProvidersList.begin(), itemIndex=0; it!=m_searchProvidersList.end(); ++it,++itemIndex) {
-		SearchProvider searchItem =  (*it);
-		if(searchItem.id == id) {
-			//Check the flag overwrite is set to true. If truthy then simply replace the entry. but restore the user preference(enable /disable)
-			if(overwrite) {
-				enabled = searchItem.enabled;
-				m_searchProvidersList.erase(it);
-				replaceItem = true;
-				break;
-			}
-			//Check the version. Overwrite if it is greater than what is in the Database.
-			else if(version > searchItem.version) {
-				removeSearchItem(jsonStr);
-				break;
-			}	
-			else {
-				luna_critical(s_logChannel, "Search Item already exist");
-				success = false;
-				goto Done;
-			}
+	it = list.find(item.id);
+	if(it != list.end()) {
+		//Check the flag overwrite is set to true. If truthy then simply replace the entry. but restore the user preference(enable /disable)
+		if(overwrite) {
+			itemIndex = it - list.begin();
+			item.enabled = it->enabled;
 		}
-	}
-
-	searchProvider.id = id;
-	searchProvider.version = version;
-	searchProvider.enabled = enabled;
-	searchProvider.appExist = appExist;
-
-	label = json_object_object_get(root, "iconFilePath");
-	if (label && !is_error(label)) {
-		imageFilePath = json_object_get_string(label);
-						
-		if(!imageFilePath.empty() && USUtils::doesExistOnFilesystem(imageFilePath.c_str())) {
-			searchProvider.iconFilePath = imageFilePath;
-			imgFileExist = true;
+		//Check the version. Overwrite if it is greater than what is in the Database.
+		else if(item.version > it->version) {
+			removeItem(list, item.id);
+		}
+		else {
+			luna_critical(s_logChannel, "%s item %s already exist", Traits::category(), item.id.c_str());
+			success = false;
+			goto Done;
 		}
 	}
 
-	label = json_object_object_get(root, "displayName");
-	if ((!label || is_error(label)) && !imgFileExist) {
-		luna_critical(s_logChannel, "Both ImageFile and DisplayName are missing");
-		success = false;
-		goto Done;
-	}
-	searchProvider.displayName = json_object_get_string(label);
-					
-	label = json_object_object_get(root, "url");
-	if (!label || is_error(label)) {
+	if(!Traits::accept(*this, item, present)) {
+		//An entry that was to be overwritten goes anyway.
+		if(itemIndex != List::npos) {
+			list.erase(list.begin() + itemIndex);
+			listChanged();
+		}
 		success = false;
 		goto Done;
 	}
-	searchProvider.url = json_object_get_string(label);
-	
-	label = json_object_object_get(root, "launchParam");
-	if (label && !is_error(label)) {
-		searchProvider.launchParam = json_object_get_string(label);
-	}
-	
-	
-	label = json_object_object_get(root, "type");
-	if(!label || is_error(label)) {
-		searchProvider.type = "web";
+
+	//It passes the validation, add it to the list.
+	if(itemIndex == List::npos) {
+		list.push_back(item);
+		itemIndex = list.size() - 1;
+		placeItem(list, itemIndex);
+		listChanged();
+		if(dbSync)
+			writeItem<Traits>(list[itemIndex]);
 	}
-	else 
-		searchProvider.type = json_object_get_string(label);
-	
-	if(searchProvider.type == "app" && searchProvider.launchParam.empty()) {
-		//If launch param is empty then there is no point adding this app into Universal Search. 
-		success = false;
-		goto Done;
+	else if(List::sameContent(list[itemIndex], item)) {
+		list[itemIndex].appExist = appExist;
 	}
-	
-	label = json_object_object_get(root, "suggestURL");
-	if(label && !is_error(label)) {
-		searchProvider.suggestURL = json_object_get_string(label);
+	else {
+		item.position = list[itemIndex].position;
+		list[itemIndex] = item;
+		listChanged();
+		if(dbSync)
+			writeItem<Traits>(item);
 	}
-	
+
 	//Do we need to set it as a default?
-	label = json_object_object_get(root, "setDefault");
-	if(label && !is_error(label)) {
-		setDefault = json_object_get_boolean(label);
-	}
-			
-	//It passes the validation, add it to the list.
-	if(replaceItem && overwrite) {
-		it=m_searchProvidersList.begin();
-		std::advance(it, itemIndex);
-		m_searchProvidersList.insert(it, searchProvider);
-	}
-	else
-		m_searchProvidersList.push_back(searchProvider);
+	if(Traits::s_canBeDefault && setDefault)
+		dbHandler->setSearchPreference("defaultSearchEngine", item.id);
 
-	//Save it to the Database.
-	if(dbSync)
-		dbHandler->addSearchRecord(searchProvider.id.c_str(), "search", searchProvider.displayName.c_str(), searchProvider.iconFilePath.c_str(), searchProvider.url.c_str(), 
-				searchProvider.suggestURL.c_str(), searchProvider.launchParam.c_str(), searchProvider.type.c_str(), searchProvider.enabled?1:0, searchProvider.version);
-	
-	
-	if(setDefault) {
-		dbHandler->setSearchPreference("defaultSearchEngine", searchProvider.id);
-	}
-	
 	Done:
-	
-		if (root && !is_error(root))
-			json_object_put(root);
-	
-		if(!success)
-			return false;
-	
-	return true;
+
+		return success;
 }
 
-bool SearchItemsManager::modifySearchItem(const char* jsonStr) 
+template <class Traits>
+bool SearchItemsManager::modifyItem(ProviderList<Traits>& list, json_object* root)
 {
-	json_object* root = json_tokener_parse(jsonStr);
 	json_object* label = NULL;
-	std::string Id;
+	std::string id;
 	bool success = true;
 	bool enabled;
-	int index = 0;
-	bool setDefault = false;
-							
+
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
 		success = false;
 		goto Done;
 	}
-				
+
 	label = json_object_object_get(root, "id");
 	if (!label || is_error(label)) {
 		luna_critical(s_logChannel, "id is missing");
 		success = false;
 		goto Done;
 	}
-	Id = json_object_get_string(label);
-			
+	id = json_object_get_string(label);
+
 	label = json_object_object_get(root, "enabled");
 	if (!label || is_error(label)) {
 		luna_critical(s_logChannel, "enabled is missing");
@@ -542,289 +560,772 @@ bool SearchItemsManager::modifySearchItem(const char* jsonStr)
 		goto Done;
 	}
 	enabled = json_object_get_boolean(label);
-	
-	//Do we need to set it as a default?
+
 	label = json_object_object_get(root, "setDefault");
-	if(label && !is_error(label)) {
-		setDefault = json_object_get_boolean(label);
-	}
+	modifyItem(list, id, enabled, label && !is_error(label) && json_object_get_boolean(label));
 
-		
-	//Iterate the list to find the matching object.
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it, index++) {
-		SearchProvider& searchProvider =  (*it);
-		if(searchProvider.id == Id) {
-			searchProvider.enabled = enabled;
-			dbHandler->updateSearchRecord(Id.c_str(), "search", enabled?1:0);
-			/*if(!enabled) {
-				moveSearchItem(Id, index, (int)m_searchProvidersList.size());
-			}*/
-			if(setDefault) {
-				dbHandler->setSearchPreference("defaultSearchEngine", Id);
-			}
-			break;
-		}
-	}
-	
 	Done:
-		
-		if (root && !is_error(root))
-			json_object_put(root);
 
-		if(!success)
-			return false;
+		return success;
+}
 
-	return true;
+//An id that is not in the list is no error.
+template <class Traits>
+void SearchItemsManager::modifyItem(ProviderList<Traits>& list, const std::string& id, bool enabled, bool setDefault)
+{
+	typename ProviderList<Traits>::iterator it = list.find(id);
+
+	if(it == list.end())
+		return;
+
+	it->enabled = enabled;
+	listChanged();
+	dbHandler->updateRecordEnabled(id.c_str(), Traits::category(), enabled);
+
+	//Do we need to set it as a default?
+	if(Traits::s_canBeDefault && setDefault)
+		dbHandler->setSearchPreference("defaultSearchEngine", id);
 }
 
-bool SearchItemsManager::modifyAllSearchItems(const char* jsonStr)
+template <class Traits>
+bool SearchItemsManager::modifyAllItems(ProviderList<Traits>& list, json_object* root)
 {
-	json_object* root = json_tokener_parse(jsonStr);
 	json_object* label = NULL;
-	json_object* openSearchList;
-	json_object* openSearchObj = json_object_new_array();
-	std::string iconFile;
-	bool success = true;
-	bool enabled;
 
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
+		return false;
 	}
 
 	label = json_object_object_get(root, "enabled");
 	if (!label || is_error(label)) {
 		luna_critical(s_logChannel, "enabled is missing");
-		success = false;
-		goto Done;
-	}
-	enabled = json_object_get_boolean(label);
-
-
-	//Iterate the list to update all objects.
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		SearchProvider& searchProvider =  (*it);
-		searchProvider.enabled = enabled;
+		return false;
 	}
 
-	//Check to see if there are items in the opensearch list. if there are, add them to search items list if the request is enabled:true.
-	if(enabled) {
-		openSearchList = OpenSearchHandler::instance()->getOpenSearchList();
-
-		openSearchObj = json_object_object_get(openSearchList, "Options");
-
-		if (!openSearchObj || is_error(openSearchObj)) {
-			luna_critical(s_logChannel, "Options is missing");
-			success = false;
-			goto Done;
-		}
-		luna_critical(s_logChannel, "Options length %d", json_object_array_length(openSearchObj));
-		for (int i = 0; i < json_object_array_length(openSearchObj); i++) {
-			json_object* obj = (json_object*) json_object_array_get_idx(openSearchObj, i);
-
-			label = json_object_object_get(obj, "imageData");
-			if (label && !is_error(label)) {
-				iconFile = json_object_get_string(label);
-			}
-			else {
-				iconFile = std::string("");
-			}
-
-			label = json_object_object_get(obj, "searchUrl");
-			if (label && !is_error(label)) {
-				json_object_object_add (obj, "url", label);
-			}
+	modifyAllItems(list, json_object_get_boolean(label));
+	return true;
+}
 
-			label = json_object_object_get(obj, "suggestionUrl");
-			if (label && !is_error(label)) {
-				json_object_object_add (obj, "suggestURL", label);
-			}
+template <class Traits>
+void SearchItemsManager::modifyAllItems(ProviderList<Traits>& list, bool enabled)
+{
+	for(typename ProviderList<Traits>::iterator it=list.begin(); it!=list.end(); ++it)
+		it->enabled = enabled;
+	listChanged();
+	dbHandler->updateAllRecordsEnabled(Traits::category(), enabled);
+}
 
-			json_object_object_add (obj, "category", json_object_new_string ("search"));
-			json_object_object_add (obj, "type", json_object_new_string ("opensearch"));
-			json_object_object_add (obj, "enabled", json_object_new_boolean (enabled));
-			json_object_object_add (obj, "iconFilePath", json_object_new_string (iconFile.c_str()));
-			addSearchItem(json_object_get_string(obj), true, false, true);
-		}
+template <class Traits>
+bool SearchItemsManager::removeItem(ProviderList<Traits>& list, json_object* root)
+{
+	json_object* label = NULL;
 
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
 	}
 
+	label = json_object_object_get(root, "id");
+	if (!label || is_error(label)) {
+		luna_critical(s_logChannel, "id is missing");
+		return false;
+	}
 
-	dbHandler->updateAllSearchRecord("search", enabled?1:0);
-
-	Done:
-
-		if (root && !is_error(root))
-			json_object_put(root);
-
-		if(openSearchObj && !is_error(openSearchObj))
-			json_object_put(openSearchObj);
+	removeItem(list, json_object_get_string(label));
+	return true;
+}
 
+template <class Traits>
+bool SearchItemsManager::removeItem(ProviderList<Traits>& list, const std::string& id)
+{
+	typename ProviderList<Traits>::iterator it = list.find(id);
 
-		if(!success)
-			return false;
+	if(it == list.end())
+		return false;
 
+	list.erase(it);
+	listChanged();
+	dbHandler->removeRecord(id.c_str(), Traits::category());
+	forgetAppDescriptor(id);
 	return true;
 }
 
-bool SearchItemsManager::removeSearchItem(const char* jsonStr) 
+template <class Traits>
+bool SearchItemsManager::reorderItem(ProviderList<Traits>& list, json_object* root)
 {
-	json_object* root = json_tokener_parse(jsonStr);
 	json_object* label = NULL;
-	bool success = true;
-	std::string value;
 	std::string id;
-			
+	int fromIndex = -1;
+	int toIndex;
+
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
+		return false;
 	}
-		
+
 	label = json_object_object_get(root, "id");
 	if (!label || is_error(label)) {
 		luna_critical(s_logChannel, "ID is missing");
-		success = false;
-		goto Done;
+		return false;
 	}
 	id = json_object_get_string(label);
-	
-	//Iterate the list to find the matching object.
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		SearchProvider& searchProvider =  (*it);
-		if(searchProvider.id == id) {
-			m_searchProvidersList.erase(it);
-			dbHandler->removeSearchRecord(id.c_str(), "search");
-			break;
-		}
+
+	label = json_object_object_get(root, "fromIndex");
+	if (label && !is_error(label)) {
+		fromIndex = json_object_get_int(label);
+	}
+	else if (!Traits::s_reorderAfterDefault) {
+		luna_critical(s_logChannel, "From Index is missing");
+		return false;
 	}
-				
-	Done:
 
-		if (root && !is_error(root))
-			json_object_put(root);
+	label = json_object_object_get(root, "toIndex");
+	if (!label || is_error(label)) {
+		luna_critical(s_logChannel, "To Index is missing");
+		return false;
+	}
+	toIndex = json_object_get_int(label);
 
-		if(!success)
-			return false;
+	return reorderItem(list, id, fromIndex, toIndex);
+}
+
+/*
+ * toIndex counts the items after the default one for search items, which are found by
+ * their id; fromIndex is only used for the other categories.
+ */
+template <class Traits>
+bool SearchItemsManager::reorderItem(ProviderList<Traits>& list, const std::string& id, int fromIndex, int toIndex)
+{
+	//npos, for an unknown id, comes out negative.
+	if(Traits::s_reorderAfterDefault)
+		fromIndex = (int) list.indexOf(id);
+
+	if(fromIndex < 0 || fromIndex >= (int)list.size()) {
+		luna_critical(s_logChannel, "fromIndex is out of range");
+		return false;
+	}
+
+	//The list is divided into two groups in the UI (default and More searches). When reorder occurs  in the More Searches group,
+	//we need to increment the toIndex by 1 to include the default item.
+	if(Traits::s_reorderAfterDefault)
+		toIndex++;
+
+	//If an item moves downward, adjust the toIndex incrementing by 1.
+	if(fromIndex < toIndex)
+		toIndex++;
+
+	return moveItem(list, id, fromIndex, toIndex);
+}
+
+template <class Traits>
+bool SearchItemsManager::moveItem(ProviderList<Traits>& list, const std::string& id, int fromIndex, int toIndex)
+{
+	//Make sure toIndex is within the range.
+	if(toIndex > (int)list.size())
+		toIndex = (int)list.size();
+
+	//Make sure it points the item that we are moving.
+	if(fromIndex < 0 || fromIndex >= (int)list.size() || list[fromIndex].id != id || toIndex < 0)
+		return false;
+
+	list.move(fromIndex, toIndex);
+	listChanged();
+
+	//Only the moved row is written, unless the list had to be renumbered.
+	if(toIndex > fromIndex)
+		toIndex--;
+	if(placeItem(list, toIndex))
+		dbHandler->updateRecordPosition(id.c_str(), Traits::category(), list[toIndex].position);
 
 	return true;
 }
 
-bool SearchItemsManager::reorderSearchItem(const char* jsonStr) 
+template <class Traits>
+void SearchItemsManager::writeItem(const typename Traits::Item& item)
 {
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	bool success = true;
+	typename Traits::Record record;
 
-	std::string id;
-	int fromIndex = 0, toIndex = 0;
-			
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
+	ProviderList<Traits>::toRecord(item, record);
+	dbHandler->addRecord(record);
+}
+
+template <class Traits>
+int SearchItemsManager::syncItems(ProviderList<Traits>& list)
+{
+	int rows = 0;
+
+	for(typename ProviderList<Traits>::iterator it=list.begin(); it!=list.end(); ++it) {
+		if(!it->dirty)
+			continue;
+		writeItem<Traits>(*it);
+		it->dirty = false;
+		rows++;
+	}
+	return rows;
+}
+
+template <class Traits>
+void SearchItemsManager::getEnabledStates(const ProviderList<Traits>& list, EnabledStates& states) const
+{
+	std::string prefix = std::string(Traits::category()) + "/";
+
+	for(typename ProviderList<Traits>::const_iterator it=list.begin(); it!=list.end(); ++it)
+		states[prefix + it->id.str()] = it->enabled;
+}
+
+template <class Traits>
+bool SearchItemsManager::applyEnabledStates(ProviderList<Traits>& list, const EnabledStates& states)
+{
+	std::string prefix = std::string(Traits::category()) + "/";
+	EnabledStates::const_iterator found;
+	bool changed = false;
+
+	for(typename ProviderList<Traits>::iterator it=list.begin(); it!=list.end(); ++it) {
+		found = states.find(prefix + it->id.str());
+		if (found == states.end() || found->second == it->enabled)
+			continue;
+		it->enabled = found->second;
+		dbHandler->updateRecordEnabled(it->id.c_str(), Traits::category(), it->enabled);
+		changed = true;
 	}
+	return changed;
+}
+
+template <class Traits>
+void SearchItemsManager::removeStaleItems(ProviderList<Traits>& list)
+{
+	const ProviderList<Traits>& items = list;
+	bool stale = false;
+
+	if(Traits::staleType()) {
+		//Only the items of that type are looked at.
+		const typename ProviderList<Traits>::Positions& candidates = items.positionsOfType(Traits::staleType());
+		for(size_t i = 0; i < candidates.size(); i++) {
+			const typename Traits::Item& item = items[candidates[i]];
+			if(Traits::isStale(item)) {
+				dbHandler->removeRecord(item.id.c_str(), Traits::category());
+				stale = true;
+			}
+		}
+	}
+	else {
+		for(typename ProviderList<Traits>::const_iterator it=items.begin(); it!=items.end(); ++it) {
+			if(Traits::isStale(*it)) {
+				dbHandler->removeRecord(it->id.c_str(), Traits::category());
+				stale = true;
+			}
+		}
+	}
+
+	if(stale)
+		list.remove_if(Traits::isStale);
+}
+
+void SearchItemsManager::readFromDefaultFile() 
+{
+	// Read the locale file
+	char localizedPrefFileName[100];
+	
+	sprintf(localizedPrefFileName, "/usr/palm/universalsearchmgr/resources/%s/UniversalSearchList.json", UniversalSearchService::instance()->getLocale().c_str());
+	luna_critical(s_logChannel, "Reading from file :: %s", localizedPrefFileName);
+	char* jsonStr = USUtils::readFile(localizedPrefFileName);
+	
+	if (!jsonStr) {
+		luna_critical(s_logChannel, "Failed to load localized file: [%s]", localizedPrefFileName);
 		
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "ID is missing");
-		success = false;
+		jsonStr = USUtils::readFile(s_defaultPrefFile);
+		
+		if(!jsonStr) {
+			luna_critical(s_logChannel, "Fatal Error - Failed to load default file: [%s]", s_defaultPrefFile);
+			return;
+		}
+	}
+
+	json_object* root = 0;
+	json_object* label = 0;
+	array_list* searchArray = 0;
+
+	root = json_tokener_parse(jsonStr);
+	if (!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse preference file contents into json");
 		goto Done;
 	}
-	id = json_object_get_string(label);
-	
-	/*label = json_object_object_get(root, "fromIndex");
+
+	label = json_object_object_get(root, "UniversalSearchList");
 	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "From Index is missing");
-		success = false;
+		luna_critical(s_logChannel, "Failed to get UniversalSearchList entry from preference file");
 		goto Done;
 	}
-	fromIndex = json_object_get_int(label);*/
 
-	//Iterate the list to find the matching object.
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it,++fromIndex) {
-		SearchProvider& searchProvider =  (*it);
-		if(searchProvider.id == id) {
-			break;
-		}
+	searchArray = json_object_get_array(label);
+	if (!searchArray) {
+		luna_critical(s_logChannel, "Failed to get search list array from preference file");
+		goto Done;
 	}
+
+	for (int i = 0; i < array_list_length(searchArray); i++) {
+		json_object* obj = (json_object*) array_list_get_idx(searchArray, i);
+		std::string category;
+		
+		label = json_object_object_get(obj, "category");
+		if (!label || is_error(label))
+			continue;
+		
+		category = json_object_get_string(label);
+		
+		if(category == "search")
+			addSearchItem(obj, false, false, false);
+		else if(category.compare("action") == 0)
+			addActionProvider(obj, false, false, false);
+		else if(category.compare("dbsearch") == 0)
+			addDBSearchItem(obj, false, false, false);
+		else
+			continue;
 	
-	if(fromIndex < 0 || fromIndex >= (int)m_searchProvidersList.size()) {
-		luna_critical(s_logChannel, "fromIndex is out of range");
-		success = false;
-		goto Done;
 	}
 	
-	label = json_object_object_get(root, "toIndex");
+	//Read search Preference
+	label = json_object_object_get(root, "SearchPreference");
 	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "To Index is missing");
-		success = false;
+		luna_critical(s_logChannel, "Failed to get SearchPreference entry from preference file");
 		goto Done;
 	}
-	toIndex = json_object_get_int(label);
-	//The list is divided into two groups in the UI (default and More searches). When reorder occurs  in the More Searches group,
-	//we need to increment the toIndex by 1 to include the default item.
-	toIndex++;
 	
-	//If an item moves downward, adjust the toIndex incrementing by 1.
-	if(fromIndex < toIndex) {
-		toIndex++;
+	m_searchPrefStr = json_object_to_json_string(label);
+	
+	Done:
+		
+		if(root && !is_error(root))
+			json_object_put(root);
+				
+		delete [] jsonStr;
+	
+}
+
+void SearchItemsManager::readFromCustFile()
+{
+	// Read from the localized customization file
+	char localizedCustPrefFileName[100];
+	sprintf(localizedCustPrefFileName, "/usr/lib/luna/customization/resources/%s/UniversalSearchList.json", UniversalSearchService::instance()->getLocale().c_str());
+	luna_critical(s_logChannel, "Reading from file :: %s", localizedCustPrefFileName);
+
+	char* jsonStr = USUtils::readFile(localizedCustPrefFileName);
+	json_object* searchPref = NULL;
+	bool fileExist = true;
+	
+	json_object* root = 0;
+	json_object* label = 0;
+	array_list* searchArray = 0;
+	std::string category, id;
+	bool remove = false;
+	bool enabledExist = false;
+	
+	if (!jsonStr) {
+		luna_critical(s_logChannel, "Failed to load locale cust files: [%s]", localizedCustPrefFileName);
+
+		//Try the default location
+		jsonStr = USUtils::readFile(s_custUniversalSearchPrefFile);
+
+		if(!jsonStr) {
+			luna_critical(s_logChannel, "Failed to load cust files: [%s]", s_custUniversalSearchPrefFile);
+			fileExist = false;
+			goto SyncSearchPref;
+		}
 	}
 
-	success = moveSearchItem(id, fromIndex, toIndex);
+	root = json_tokener_parse(jsonStr);
+	if (!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse preference file contents into json");
+		goto Done;
+	}
 
-	Done:
+	label = json_object_object_get(root, "UniversalSearchList");
+	if (!label || is_error(label)) {
+		luna_critical(s_logChannel, "Failed to get UniversalSearchList entry from preference file");
+		goto Done;
+	}
 
-		if (root && !is_error(root))
-			json_object_put(root);
+	searchArray = json_object_get_array(label);
+	if (!searchArray) {
+		luna_critical(s_logChannel, "Failed to get search list array from preference file");
+		goto Done;
+	}
 
-		if(!success)
-			return false;
+	for (int i = 0; i < array_list_length(searchArray); i++) {
+		json_object* obj = (json_object*) array_list_get_idx(searchArray, i);
+		
+		label = json_object_object_get(obj, "id");
+		if(!label || is_error(label)) {
+			luna_critical(s_logChannel, "Id is missing in the Cust File");
+			continue;
+		}
+		id = json_object_get_string(label);
+		
+		//Check this is to remove the object.
+		label = json_object_object_get(obj, "remove");
+		if(label && !is_error(label)) {
+			remove = json_object_get_boolean(label);
+		}
+		else
+			remove = false;
+		
+		label = json_object_object_get(obj, "category");
+		if (label && !is_error(label))
+			category = json_object_get_string(label);
 
-	return true;
+		//Check if "enabled" field exist.
+		label = json_object_object_get(obj, "enabled");
+		if (label && !is_error(label)) {
+			enabledExist = true;
+		}
+		else
+			enabledExist = false;
+		
+		//Remove the object from the list
+		if(remove) {
+			if(category.empty()) {
+				removeSearchItem(obj);
+				removeActionProvider(obj);
+				removeDBSearchItem(obj);
+			}
+			else {
+				if(category == "search")
+					removeSearchItem(obj);
+				else if(category.compare("action") == 0)
+					removeActionProvider(obj);
+				else if(category.compare("dbsearch") == 0)
+					removeDBSearchItem(obj);
+			}
+		}
+		else if(enabledExist) {
+			if(category.empty()) {
+				modifySearchItem(obj);
+				modifyActionProvider(obj);
+				modifyDBSearchItem(obj);
+			}
+			else {
+				//This could be either an update or a new item. We don't know at this point, hence calling both modify and add methods which will do the right thing.
+				if(category == "search") {
+					modifySearchItem(obj);
+					addSearchItem(obj, false, false, false);
+				}
+				else if(category.compare("action") == 0) {
+					modifyActionProvider(obj);
+					addActionProvider(obj, false, false, false);
+				}
+				else if(category.compare("dbsearch") == 0) {
+					modifyDBSearchItem(obj);
+					addDBSearchItem(obj, false, false, false);
+				}
+			}
+		}
+	}
+	
+	SyncSearchPref:
 	
+		searchPref = json_tokener_parse(m_searchPrefStr.c_str());
+		if(!searchPref || is_error(searchPref)) {
+			luna_critical(s_logChannel, "Failed to parse SearchPreference entry from cust preference file");
+			goto Done;
+		}
+		
+		if(fileExist) {
+			//Read search Preference
+			label = json_object_object_get(root, "SearchPreference");
+			if (label && !is_error(label)) {
+				json_object_object_foreach(label, key, val) {
+		
+					if(val == NULL)
+						continue;
+					
+					json_object_object_add(searchPref, key, val);
+				}
+			}
+		}
+	
+		dbHandler->syncSearchPreferenceDb(json_object_get_string(searchPref));
+	
+	Done:
+				
+		delete [] jsonStr;
 }
 
-bool SearchItemsManager::moveSearchItem(const std::string& id, int fromIndex, int toIndex)
+/*
+ * Returns the serialized search list snapshot, rebuilding it only when the lists
+ * or the preferences have changed since the last call. The items are captured for
+ * the change log while they are written.
+ */
+const SearchItemsManager::SearchListSnapshot* SearchItemsManager::getSearchListSnapshot()
 {
-	SearchProvidersList::iterator fromIt, toIt;
-	
-	//Make sure toIndex is within the range.
-	if(toIndex > (int)m_searchProvidersList.size())
-		toIndex = (int)m_searchProvidersList.size();
+	unsigned int prefGeneration = dbHandler->getGeneration();
+	SearchListChangeLog::ListState lists[SearchListChangeLog::s_numLists];
+	SearchListQuery query;
+	
+	if(m_snapshot && m_snapshot->generation == m_generation && m_snapshot->prefGeneration == prefGeneration)
+		return m_snapshot;
+	
+	std::string defaultSearchEngine = dbHandler->getSearchPreference("defaultSearchEngine");
+	
+	m_writer.clear();
+	m_writer.key("UniversalSearchList");
+	m_searchProvidersList.write(m_writer, query, &lists[0]);
+	m_writer.key("ActionList");
+	m_actionProvidersList.write(m_writer, query, &lists[1]);
+	m_writer.key("DBSearchItemList");
+	m_mojodbSearchItemList.write(m_writer, query, &lists[2]);
+	m_writer.key("defaultSearchEngine").value(defaultSearchEngine);
+	
+	SearchListSnapshot* snapshot = new SearchListSnapshot();
+	snapshot->generation = m_generation;
+	snapshot->prefGeneration = prefGeneration;
+	snapshot->listGeneration = m_changeLog.record(lists, defaultSearchEngine);
+	snapshot->body = m_writer.str();
+	
+	delete m_snapshot;
+	m_snapshot = snapshot;
+	
+	return m_snapshot;
+}
+
+/*
+ * Serialized members of a getUniversalSearchList reply restricted to 'query'. Only the
+ * requested lists are written, and defaultSearchEngine only comes with the search list.
+ */
+const std::string& SearchItemsManager::getSearchListBody(const SearchListQuery& query)
+{
+	m_writer.clear();
 	
-	fromIt = m_searchProvidersList.begin();
-	std::advance(fromIt, fromIndex);
+	if(query.categories & SearchListQuery::CategorySearch) {
+		m_writer.key("UniversalSearchList");
+		m_searchProvidersList.write(m_writer, query);
+		m_writer.key("defaultSearchEngine").value(dbHandler->getSearchPreference("defaultSearchEngine"));
+	}
+	if(query.categories & SearchListQuery::CategoryAction) {
+		m_writer.key("ActionList");
+		m_actionProvidersList.write(m_writer, query);
+	}
+	if(query.categories & SearchListQuery::CategoryDBSearch) {
+		m_writer.key("DBSearchItemList");
+		m_mojodbSearchItemList.write(m_writer, query);
+	}
 	
-	//Make sure it points the item that we are moving.
-	if(fromIt->id != id) {
+	return m_writer.str();
+}
+
+//add an item to the list
+bool SearchItemsManager::addSearchItem(const char* jsonStr, bool dbSync, bool overwrite, bool appExist)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
 		return false;
 	}
-	
-	toIt = m_searchProvidersList.begin();
-	std::advance(toIt, toIndex);
-	
-	m_searchProvidersList.splice(toIt, m_searchProvidersList, fromIt);
 
+	bool success = addSearchItem(root, dbSync, overwrite, appExist);
+	json_object_put(root);
+
+	return success;
+}
+
+bool SearchItemsManager::addSearchItem(json_object* root, bool dbSync, bool overwrite, bool appExist)
+{
+	return addItem(m_searchProvidersList, root, dbSync, overwrite, appExist);
+}
+
+bool SearchItemsManager::modifySearchItem(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
+	}
+
+	bool success = modifySearchItem(root);
+	json_object_put(root);
+
+	return success;
+}
+
+bool SearchItemsManager::modifySearchItem(json_object* root)
+{
+	return modifyItem(m_searchProvidersList, root);
+}
+
+bool SearchItemsManager::modifyAllSearchItems(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
+	}
+
+	bool success = modifyAllSearchItems(root);
+	json_object_put(root);
+
+	return success;
+}
+
+bool SearchItemsManager::modifyAllSearchItems(json_object* root)
+{
+	if(!modifyAllItems(m_searchProvidersList, root))
+		return false;
+
+	//Check to see if there are items in the opensearch list. if there are, add them to search items list if the request is enabled:true.
+	if(json_object_get_boolean(json_object_object_get(root, "enabled")))
+		addOpenSearchItems();
 
-	//Sync the Database
-	syncPrefDb();
-	
 	return true;
 }
 
+void SearchItemsManager::addOpenSearchItems()
+{
+	std::vector<OpenSearchHandler::OpenSearchInfo> openSearchItems;
+
+	OpenSearchHandler::instance()->getOpenSearchItems(openSearchItems);
+	luna_critical(s_logChannel, "Options length %d", (int) openSearchItems.size());
+	for (size_t i = 0; i < openSearchItems.size(); i++) {
+		const OpenSearchHandler::OpenSearchInfo& info = openSearchItems[i];
+		json_object* obj = json_object_new_object();
+
+		json_object_object_add (obj, "id", json_object_new_string (info.id.c_str()));
+		json_object_object_add (obj, "displayName", json_object_new_string (info.displayName.c_str()));
+		json_object_object_add (obj, "url", json_object_new_string (info.searchUrl.c_str()));
+		json_object_object_add (obj, "suggestURL", json_object_new_string (info.suggestionUrl.c_str()));
+		json_object_object_add (obj, "category", json_object_new_string ("search"));
+		json_object_object_add (obj, "type", json_object_new_string ("opensearch"));
+		json_object_object_add (obj, "enabled", json_object_new_boolean (true));
+		json_object_object_add (obj, "iconFilePath", json_object_new_string (info.imageData.c_str()));
+		addSearchItem(obj, true, false, true);
+		json_object_put(obj);
+	}
+}
+
+/*
+ * The decoded requests of the bus methods, by category. An unknown category fails;
+ * an unknown id only fails to be added or reordered, as with the JSON requests.
+ */
+bool SearchItemsManager::addItem(const std::string& category, const ItemRequest& request, bool dbSync, bool overwrite, bool appExist)
+{
+	if(category == "search")
+		return addItem(m_searchProvidersList, request, dbSync, overwrite, appExist);
+	else if(category == "action")
+		return addItem(m_actionProvidersList, request, dbSync, overwrite, appExist);
+	else if(category == "dbsearch")
+		return addItem(m_mojodbSearchItemList, request, dbSync, overwrite, appExist);
+	return false;
+}
+
+bool SearchItemsManager::modifyItem(const std::string& category, const std::string& id, bool enabled, bool setDefault)
+{
+	if(category == "search")
+		modifyItem(m_searchProvidersList, id, enabled, setDefault);
+	else if(category == "action")
+		modifyItem(m_actionProvidersList, id, enabled, setDefault);
+	else if(category == "dbsearch")
+		modifyItem(m_mojodbSearchItemList, id, enabled, setDefault);
+	else
+		return false;
+	return true;
+}
+
+bool SearchItemsManager::modifyAllItems(const std::string& category, bool enabled)
+{
+	if(category == "search") {
+		modifyAllItems(m_searchProvidersList, enabled);
+		if(enabled)
+			addOpenSearchItems();
+	}
+	else if(category == "action")
+		modifyAllItems(m_actionProvidersList, enabled);
+	else if(category == "dbsearch")
+		modifyAllItems(m_mojodbSearchItemList, enabled);
+	else
+		return false;
+	return true;
+}
+
+bool SearchItemsManager::removeItem(const std::string& category, const std::string& id)
+{
+	if(category == "search")
+		removeItem(m_searchProvidersList, id);
+	else if(category == "action")
+		removeItem(m_actionProvidersList, id);
+	else if(category == "dbsearch")
+		removeItem(m_mojodbSearchItemList, id);
+	else
+		return false;
+	return true;
+}
+
+bool SearchItemsManager::reorderItem(const std::string& category, const std::string& id, int fromIndex, int toIndex)
+{
+	if(category == "search")
+		return reorderItem(m_searchProvidersList, id, fromIndex, toIndex);
+	else if(category == "action")
+		return reorderItem(m_actionProvidersList, id, fromIndex, toIndex);
+	else if(category == "dbsearch")
+		return reorderItem(m_mojodbSearchItemList, id, fromIndex, toIndex);
+	return false;
+}
+
+bool SearchItemsManager::removeSearchItem(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
+	}
+
+	bool success = removeSearchItem(root);
+	json_object_put(root);
+
+	return success;
+}
+
+bool SearchItemsManager::removeSearchItem(json_object* root)
+{
+	return removeItem(m_searchProvidersList, root);
+}
+
+bool SearchItemsManager::reorderSearchItem(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
+	}
+
+	bool success = reorderSearchItem(root);
+	json_object_put(root);
+
+	return success;
+}
+
+bool SearchItemsManager::reorderSearchItem(json_object* root)
+{
+	return reorderItem(m_searchProvidersList, root);
+}
+
+bool SearchItemsManager::moveSearchItem(const std::string& id, int fromIndex, int toIndex)
+{
+	return moveItem(m_searchProvidersList, id, fromIndex, toIndex);
+}
+
 bool SearchItemsManager::replaceSearchItem(const std::string& id, const std::string& url, const std::string& suggestUrl, const std::string& displayName)
 {
+	SearchProvidersList::iterator it;
 	
 	//Iterate thru the list to find the item within the list
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
+	it = m_searchProvidersList.find(id);
+	if(it != m_searchProvidersList.end()) {
 		SearchProvider& searchItem =  (*it);
-		if(searchItem.id == id) {
+		if(searchItem.displayName != displayName || searchItem.url != url || searchItem.suggestURL != suggestUrl) {
 			searchItem.displayName = displayName;
 			searchItem.url = url;
 			searchItem.suggestURL = suggestUrl;
-			break;
+			searchItem.dirty = true;
+			listChanged();
 		}
 	}
 
@@ -835,24 +1336,17 @@ bool SearchItemsManager::replaceSearchItem(const std::string& id, const std::str
 
 bool SearchItemsManager::isSearchItemExist(const std::string& id)
 {
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		SearchProvider searchItem =  (*it);
-		if(searchItem.id == id) {
-			return true;
-		}
-	}
-	return false;
+	return m_searchProvidersList.contains(id);
 }
 
 bool SearchItemsManager::removeDisabledOpenSearchItem(const std::string& id)
 {
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		SearchProvider& searchProvider =  (*it);
-		if(searchProvider.id == id && searchProvider.type == "opensearch" && !searchProvider.enabled) {
-			m_searchProvidersList.erase(it);
-			dbHandler->removeSearchRecord(id.c_str(), "search");
-			return true;
-		}
+	SearchProvidersList::iterator it = m_searchProvidersList.find(id);
+	if(it != m_searchProvidersList.end() && it->type == "opensearch" && !it->enabled) {
+		m_searchProvidersList.erase(it);
+		listChanged();
+		dbHandler->removeRecord(id.c_str(), "search");
+		return true;
 	}
 	return false;
 }
@@ -860,906 +1354,667 @@ bool SearchItemsManager::removeDisabledOpenSearchItem(const std::string& id)
 bool SearchItemsManager::addActionProvider(const char* jsonStr, bool dbSync, bool overwrite, bool appExist)
 {
 	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	int version = 1;
-	std::string imageFilePath;
-	std::string id;
-	bool enabled = false;
-	bool success = true;
-	bool imgFileExist = false;
-	bool replaceItem = false;
-	int itemIndex;
-	ActionProvider actionProvider;
-	ActionProvidersList::iterator it;
-	
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-	
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "id is missing");
-		success = false;
-		goto Done;
-	}
-	id = json_object_get_string(label);
-
-	label = json_object_object_get(root, "version");
-	if (label && !is_error(label)) {
-		version = json_object_get_int(label);
-	}
-
-	if(id.find("com.palm.app",0) != std::string::npos) {
-		enabled = true; //Privileged App. Enabled by default.
-	}
-	
-	label = json_object_object_get(root, "enabled");
-	if (label && !is_error(label)) {
-		enabled = json_object_get_boolean(label);
-	}
-
-	//check for duplication
-	//Iterate the list to find the matching object.
-	for(it=m_actionProvidersList.begin(), itemIndex=0; it!=m_actionProvidersList.end(); ++it, ++itemIndex) {
-		ActionProvider actionInfo =  (*it);
-		if(actionInfo.id == id) {
-			if(overwrite) {
-				enabled = actionInfo.enabled;
-				m_actionProvidersList.erase(it);
-				replaceItem = true;
-				break;
-			}
-			//Check the version. Overwrite if it is greater than what is in the Database.
-			if(version > actionInfo.version) {
-				//remove the item from list
-				removeActionProvider(jsonStr);
-				break;
-			}
-			else {
-				luna_critical(s_logChannel, "Action Item already exist");
-				success = false;
-				goto Done;
-			}
-		}
-	}
-	actionProvider.id = id;
-	actionProvider.version = version;
-	actionProvider.enabled = enabled;
-	actionProvider.appExist = appExist;
-	
-	label = json_object_object_get(root, "iconFilePath");
-	if (label && !is_error(label)) {
-		imageFilePath = json_object_get_string(label);
-						
-		if(!imageFilePath.empty() && USUtils::doesExistOnFilesystem(imageFilePath.c_str())) {
-			actionProvider.iconFilePath = imageFilePath;
-			imgFileExist = true;
-		}
-		
-	}
-	label = json_object_object_get(root, "displayName");
-	if ((!label || is_error(label)) && !imgFileExist) {
-		luna_critical(s_logChannel, "Both ImageFile and DisplayName are missing");
-		success = false;
-		goto Done;
-	}
-	actionProvider.displayName = json_object_get_string(label);			
-	label = json_object_object_get(root, "url");
-	if (!label || is_error(label)) {
-		success = false;
-		goto Done;
-	}
-	actionProvider.url = json_object_get_string(label);
-	label = json_object_object_get(root, "launchParam");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "launchParam is missing");
-		success = false;
-		goto Done;
-	}
-	
-	actionProvider.launchParam = json_object_get_string(label);	
-	if(actionProvider.launchParam.empty()) {
-		//launch param is empty. ignore the entry.
-		success = false;
-		goto Done;
-	}
-	//It passes the validation, add it to the list.
-	if(overwrite && replaceItem) {
-		it=m_actionProvidersList.begin();
-		std::advance(it, itemIndex);
-		m_actionProvidersList.insert(it, actionProvider);
+		return false;
 	}
-	else 
-		m_actionProvidersList.push_back(actionProvider);
-
-	//Save it to the Database.
-	if(dbSync)
-		dbHandler->addSearchRecord(actionProvider.id.c_str(), "action", actionProvider.displayName.c_str(), actionProvider.iconFilePath.c_str(), actionProvider.url.c_str(), 
-				actionProvider.suggestURL.c_str(),actionProvider.launchParam.c_str(),actionProvider.type.c_str(),actionProvider.enabled?1:0, actionProvider.version);
-	
-	Done:
 
-		if (root && !is_error(root))
-			json_object_put(root);
+	bool success = addActionProvider(root, dbSync, overwrite, appExist);
+	json_object_put(root);
 
-		if(!success)
-			return false;
+	return success;
+}
 
-	return true;
-	
+bool SearchItemsManager::addActionProvider(json_object* root, bool dbSync, bool overwrite, bool appExist)
+{
+	return addItem(m_actionProvidersList, root, dbSync, overwrite, appExist);
 }
 
 bool SearchItemsManager::modifyActionProvider(const char* jsonStr)
 {
 	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	std::string id;
-	bool success = true;
-	bool enabled;
-	int index = 0;
-						
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-				
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Id is missing");
-		success = false;
-		goto Done;
-	}
-	id = json_object_get_string(label);
-			
-	label = json_object_object_get(root, "enabled");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "enabled is missing");
-		success = false;
-		goto Done;
-	}
-	enabled = json_object_get_boolean(label);
-		
-	//Iterate the list to find the matching object.
-	for(ActionProvidersList::iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it, index++) {
-		ActionProvider& actionProvider =  (*it);
-		if(actionProvider.id == id) {
-			actionProvider.enabled = enabled;
-			dbHandler->updateSearchRecord(id.c_str(), "action", enabled?1:0);
-			/*if(!enabled) {
-				moveActionItem(id, index, (int)m_actionProvidersList.size());
-			}*/
-			break;
-		}
+		return false;
 	}
-		
-	Done:
 
-		if (root && !is_error(root))
-			json_object_put(root);
+	bool success = modifyActionProvider(root);
+	json_object_put(root);
 
-		if(!success)
-			return false;
-
-	return true;	
+	return success;
 }
 
-bool SearchItemsManager::modifyAllActionProviders(const char* jsonStr)
+bool SearchItemsManager::modifyActionProvider(json_object* root)
 {
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	bool success = true;
-	bool enabled;
+	return modifyItem(m_actionProvidersList, root);
+}
 
+bool SearchItemsManager::modifyAllActionProviders(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-
-	label = json_object_object_get(root, "enabled");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "enabled is missing");
-		success = false;
-		goto Done;
-	}
-	enabled = json_object_get_boolean(label);
-
-	//Iterate the list to find the matching object.
-	for(ActionProvidersList::iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-		ActionProvider& actionProvider =  (*it);
-		actionProvider.enabled = enabled;
+		return false;
 	}
-	dbHandler->updateAllSearchRecord("action", enabled?1:0);
 
-	Done:
-
-		if (root && !is_error(root))
-			json_object_put(root);
+	bool success = modifyAllActionProviders(root);
+	json_object_put(root);
 
-		if(!success)
-			return false;
+	return success;
+}
 
-	return true;
+bool SearchItemsManager::modifyAllActionProviders(json_object* root)
+{
+	return modifyAllItems(m_actionProvidersList, root);
 }
 
 bool SearchItemsManager::removeActionProvider(const char* jsonStr)
 {
 	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	std::string id;
-	bool success = true;
-						
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-				
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Id is missing");
-		success = false;
-		goto Done;
-	}
-	id = json_object_get_string(label);
-				
-	//Iterate the list to find the matching object.
-	for(ActionProvidersList::iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-		const ActionProvider& actionProvider =  (*it);
-		if(actionProvider.id == id) {
-			m_actionProvidersList.erase(it);
-			dbHandler->removeSearchRecord(id.c_str(), "action");
-			break;
-		}
+		return false;
 	}
 
-	Done:
+	bool success = removeActionProvider(root);
+	json_object_put(root);
 
-		if (root && !is_error(root))
-			json_object_put(root);
+	return success;
+}
 
-		if(!success)
-			return false;
-			
-	return true;	
+bool SearchItemsManager::removeActionProvider(json_object* root)
+{
+	return removeItem(m_actionProvidersList, root);
 }
 
 bool SearchItemsManager::reorderActionProvider(const char* jsonStr)
 {
 	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	bool success = true;
-
-	std::string id;
-	int fromIndex, toIndex;
-			
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-		
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "ID is missing");
-		success = false;
-		goto Done;
+		return false;
 	}
-	id = json_object_get_string(label);
+
+	bool success = reorderActionProvider(root);
+	json_object_put(root);
+
+	return success;
+}
+
+bool SearchItemsManager::reorderActionProvider(json_object* root)
+{
+	return reorderItem(m_actionProvidersList, root);
+}
+
+bool SearchItemsManager::moveActionItem(const std::string& id, int fromIndex, int toIndex)
+{
+	return moveItem(m_actionProvidersList, id, fromIndex, toIndex);
+}
+
+void SearchItemsManager::syncPrefDb()
+{
+	STATS_SCOPE("syncPrefDb");
+	//Batches already run in a transaction of their own.
+	bool transaction = !m_inBatch && dbHandler->beginTransaction();
+	int rows = 0;
 	
-	label = json_object_object_get(root, "fromIndex");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "From Index is missing");
-		success = false;
-		goto Done;
-	}
-	fromIndex = json_object_get_int(label);
+	rows += syncItems(m_searchProvidersList);
+	rows += syncItems(m_actionProvidersList);
+	rows += syncItems(m_mojodbSearchItemList);
 	
-	if(fromIndex < 0 || fromIndex >= (int)m_actionProvidersList.size()) {
-		luna_critical(s_logChannel, "fromIndex is out of range");
-		success = false;
-		goto Done;
-	}
+	if(transaction)
+		dbHandler->commitTransaction();
 	
-	label = json_object_object_get(root, "toIndex");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "To Index is missing");
-		success = false;
-		goto Done;
-	}
-	toIndex = json_object_get_int(label);
+	STATS_RECORD("syncPrefDb.rows", ServiceStats::Counter, rows);
+	luna_log(s_logChannel, "Synced %d rows", rows);
+}
+
+template <class Traits>
+bool SearchItemsManager::placeItem(ProviderList<Traits>& list, size_t pos)
+{
+	gint64 before = pos > 0 ? list[pos - 1].position : 0;
+	gint64 after = pos + 1 < list.size() ? list[pos + 1].position : before + 2 * s_positionGap;
 	
-	//If an item moves downward, adjust the toIndex incrementing by 1.
-	if(fromIndex < toIndex) {
-		toIndex++;
+	if(after - before >= 2 && after <= G_MAXINT) {
+		list[pos].position = (int) ((before + after) / 2);
+		return true;
 	}
 	
-	success = moveActionItem(id, fromIndex, toIndex);
-	
-	Done:
+	STATS_COUNT("positions.renumber");
+	for(size_t i = 0; i < list.size(); i++) {
+		list[i].position = (int) (i + 1) * s_positionGap;
+		dbHandler->updateRecordPosition(list[i].id.c_str(), Traits::category(), list[i].position);
+	}
+	return false;
+}
 
-		if (root && !is_error(root))
-			json_object_put(root);
+bool SearchItemsManager::addDBSearchItem(const char* jsonStr, bool dbSync, bool overwrite, bool appExist)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
+	}
 
-		if(!success)
-			return false;
+	bool success = addDBSearchItem(root, dbSync, overwrite, appExist);
+	json_object_put(root);
 
-	return true;
-	
+	return success;
 }
 
-bool SearchItemsManager::moveActionItem(const std::string& id, int fromIndex, int toIndex)
+bool SearchItemsManager::addDBSearchItem(json_object* root, bool dbSync, bool overwrite, bool appExist)
 {
-	ActionProvidersList::iterator fromIt, toIt;
-	
-	//Make sure toIndex is within the range.
-	if(toIndex > (int)m_actionProvidersList.size())
-		toIndex = (int)m_actionProvidersList.size();
-	
-	fromIt = m_actionProvidersList.begin();
-	std::advance(fromIt, fromIndex);
-	
-	//Make sure it points the item that we are moving.
-	if(fromIt->id != id) {
+	return addItem(m_mojodbSearchItemList, root, dbSync, overwrite, appExist);
+}
+
+bool SearchItemsManager::modifyDBSearchItem(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
 		return false;
 	}
-	
-	toIt = m_actionProvidersList.begin();
-	std::advance(toIt, toIndex);
-	
-	m_actionProvidersList.splice(toIt, m_actionProvidersList, fromIt);
 
-	//Sync the Database
-	syncPrefDb();
-	
-	return true;
+	bool success = modifyDBSearchItem(root);
+	json_object_put(root);
+
+	return success;
 }
 
-json_object* SearchItemsManager::getActionProvidersList() 
+bool SearchItemsManager::modifyDBSearchItem(json_object* root)
 {
-	json_object* objArray = json_object_new_array();
-	
-	for(ActionProvidersList::const_iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-		
-		ActionProvider actionProvider =  (*it);
-		
-		json_object* infoObj = json_object_new_object();
-		json_object_object_add(infoObj,(char*) "id",json_object_new_string((char*) actionProvider.id.c_str()));
-		json_object_object_add(infoObj,(char*) "displayName",json_object_new_string((char*) actionProvider.displayName.c_str()));
-		json_object_object_add(infoObj,(char*) "iconFilePath",json_object_new_string((char*) actionProvider.iconFilePath.c_str()));
-		json_object_object_add(infoObj,(char*) "url",json_object_new_string((char*) actionProvider.url.c_str()));
-		json_object_object_add(infoObj,(char*) "launchParam",json_object_new_string((char*) actionProvider.launchParam.c_str()));
-		json_object_object_add(infoObj,(char*) "enabled",json_object_new_boolean(actionProvider.enabled));
-		
-		json_object_array_add(objArray, infoObj);
-		
-	}
-	return objArray;
+	return modifyItem(m_mojodbSearchItemList, root);
 }
 
-void SearchItemsManager::syncPrefDb()
+bool SearchItemsManager::modifyAllDBSearchItems(const char* jsonStr)
 {
-	for(SearchProvidersList::const_iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-			SearchProvider searchProvider =  (*it);
-			dbHandler->addSearchRecord(searchProvider.id.c_str(), "search", searchProvider.displayName.c_str(), searchProvider.iconFilePath.c_str(), searchProvider.url.c_str(), 
-					searchProvider.suggestURL.c_str(), searchProvider.launchParam.c_str(), searchProvider.type.c_str(), searchProvider.enabled?1:0, searchProvider.version);
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
 	}
 
-	for(ActionProvidersList::const_iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-			ActionProvider actionProvider =  (*it);
-			dbHandler->addSearchRecord(actionProvider.id.c_str(), "action", actionProvider.displayName.c_str(), actionProvider.iconFilePath.c_str(), actionProvider.url.c_str(), 
-					actionProvider.suggestURL.c_str(),actionProvider.launchParam.c_str(), actionProvider.type.c_str(), actionProvider.enabled?1:0, actionProvider.version);
-	}
+	bool success = modifyAllDBSearchItems(root);
+	json_object_put(root);
 
-	for(MojoDBSearchItemList::const_iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it) {
-			MojoDBSearchItem dbSearch =  (*it);
-			dbHandler->addDBSearchRecord(dbSearch.id.c_str(), "dbsearch", dbSearch.displayName.c_str(), dbSearch.iconFilePath.c_str(), dbSearch.url.c_str(), 
-					dbSearch.launchParam.c_str(),dbSearch.launchParamDbField.c_str(), dbSearch.dbQuery.c_str(), dbSearch.displayFields.c_str(), dbSearch.batchQuery?1:0,dbSearch.enabled?1:0, dbSearch.version);
-	}		
+	return success;
 }
 
-bool SearchItemsManager::addDBSearchItem(const char* jsonStr, bool dbSync, bool overwrite, bool appExist)
+bool SearchItemsManager::modifyAllDBSearchItems(json_object* root)
+{
+	return modifyAllItems(m_mojodbSearchItemList, root);
+}
+
+bool SearchItemsManager::removeDBSearchItem(const char* jsonStr)
 {
 	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	std::string imageFilePath;
-	std::string id;
-	int version = 1;
-	int itemIndex;
-	bool enabled = false;
-	bool success = true;
-	bool replaceItem = false;
-	
-	MojoDBSearchItem dbSearchItem;
-	MojoDBSearchItemList::iterator it;
-	
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
+		return false;
 	}
 
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Id is missing");
-		success = false;
-		goto Done;
-	}
-	id = json_object_get_string(label);
-	
-	label = json_object_object_get(root, "version");
-	if (label && !is_error(label)) {
-		version = json_object_get_int(label);
-	}
-	
-	if(id.find("com.palm.app",0) != std::string::npos) {
-		enabled = true; //Privileged App. Enabled by default.
-	}
-	
-	label = json_object_object_get(root, "enabled");
-	if (label && !is_error(label)) {
-		enabled = json_object_get_boolean(label);
-	}
+	bool success = removeDBSearchItem(root);
+	json_object_put(root);
 
-	//check for duplication
-	
-	//Iterate the list to find the matching object.
-	for(it=m_mojodbSearchItemList.begin(), itemIndex=0; it!=m_mojodbSearchItemList.end(); ++it, ++itemIndex) {
-		MojoDBSearchItem dbInfo =  (*it);
-		if(dbInfo.id == id) {
-			if(overwrite) {
-				enabled = dbInfo.enabled;
-				m_mojodbSearchItemList.erase(it);
-				replaceItem = true;
-				break;
-			}
-			//Check the version. Overwrite if it is greater than what is in the Database.
-			if(version > dbInfo.version) {
-				//remove the item from list
-				removeDBSearchItem(jsonStr);
-				break;
-			}
-			else {
-				luna_critical(s_logChannel, "DB Search Item already exist");
-				success = false;
-				goto Done;
-			}
-		}
-	}
-	dbSearchItem.id = id;
-	dbSearchItem.version = version;
-	dbSearchItem.enabled = enabled;
-	dbSearchItem.appExist = appExist;
+	return success;
+}
 
-	label = json_object_object_get(root, "dbQuery");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "DbQuery property is missing");
-		success = false;
-		goto Done;
-	}
-	
-	dbSearchItem.dbQuery = json_object_get_string(label);
-	if(!validateDbSearchItem(id, dbSearchItem.dbQuery.c_str())) {
-		luna_critical(s_logChannel, "DbQuery Validation Failed");
-		success = false;
-		goto Done;
-	}
+bool SearchItemsManager::removeDBSearchItem(json_object* root)
+{
+	return removeItem(m_mojodbSearchItemList, root);
+}
 
-	label = json_object_object_get(root, "displayName");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "DisplayName is missing");
-		success = false;
-		goto Done;
+bool SearchItemsManager::reorderDBSearchItem(const char* jsonStr)
+{
+	json_object* root = json_tokener_parse(jsonStr);
+	if(!root || is_error(root)) {
+		luna_critical(s_logChannel, "Failed to parse content into json");
+		return false;
 	}
-	dbSearchItem.displayName = json_object_get_string(label);
 
-	label = json_object_object_get(root, "displayFields");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "displayFields is missing");
-		success = false;
-		goto Done;
-	}
-	dbSearchItem.displayFields = json_object_get_string(label);
+	bool success = reorderDBSearchItem(root);
+	json_object_put(root);
 
-	label = json_object_object_get(root, "url");
-	if(label && !is_error(label)) {
-		dbSearchItem.url = json_object_get_string(label);
-	}
+	return success;
+}
 
-	label = json_object_object_get(root, "launchParam");
-	if(label && !is_error(label)) {
-		dbSearchItem.launchParam = json_object_get_string(label);
-	}
+bool SearchItemsManager::reorderDBSearchItem(json_object* root)
+{
+	return reorderItem(m_mojodbSearchItemList, root);
+}
 
-	label = json_object_object_get(root, "launchParamDbField");
-	if(label && !is_error(label)) {
-		dbSearchItem.launchParamDbField = json_object_get_string(label);
-	}
-	
-	label = json_object_object_get(root, "batchQuery");
-	if (!label || is_error(label)) {
-		dbSearchItem.batchQuery = false;
-	}
-	else 
-		dbSearchItem.batchQuery = json_object_get_boolean(label);
+bool SearchItemsManager::moveDBSearchItem(const std::string& id, int fromIndex, int toIndex)
+{
+	return moveItem(m_mojodbSearchItemList, id, fromIndex, toIndex);
+}
 
-	label = json_object_object_get(root, "iconFilePath");
-	if (label && !is_error(label)) {
-		imageFilePath = json_object_get_string(label);
-						
-		if(USUtils::doesExistOnFilesystem(imageFilePath.c_str())) {
-			dbSearchItem.iconFilePath = imageFilePath;
-		}
-	}
+bool SearchItemsManager::validateDbSearchItem(std::string appId, const char* dbQuery)
+{
+	json_object* fromObj = NULL;
+	json_object* label = NULL;
+	std::string dbKind;
 	
-	//It passes the validation, add it to the list.
-	if(overwrite && replaceItem) {
-		it=m_mojodbSearchItemList.begin();
-		std::advance(it, itemIndex);
-		m_mojodbSearchItemList.insert(it, dbSearchItem);
+	//No restriction for Palm Apps.
+	if(appId.find("com.palm.",0) != std::string::npos) {
+		return true;
 	}
-	else
-		m_mojodbSearchItemList.push_back(dbSearchItem);
-
-	//Save it to the Database.
-	if(dbSync)
-		dbHandler->addDBSearchRecord(dbSearchItem.id.c_str(), "dbsearch", dbSearchItem.displayName.c_str(), dbSearchItem.iconFilePath.c_str(), dbSearchItem.url.c_str(), 
-				dbSearchItem.launchParam.c_str(), dbSearchItem.launchParamDbField.c_str(), dbSearchItem.dbQuery.c_str(), dbSearchItem.displayFields.c_str(), dbSearchItem.batchQuery?1:0, dbSearchItem.enabled?1:0, dbSearchItem.version);
 	
+	fromObj = json_tokener_parse(dbQuery);
+	
+	label = json_object_object_get(fromObj, "from");
+	if(!label || is_error(label))
+		return false;
+	dbKind = json_object_get_string(label);
+	
+	//Db Query should not contain com.palm in the db kind.
+	if(dbKind.find("com.palm.",0) == std::string::npos)
+		return true;
+	
+	return false;
+}
 
-	Done:
+bool SearchItemsManager::isItemExist(const std::string& id)
+{
+	return m_searchProvidersList.contains(id) || m_actionProvidersList.contains(id) || m_mojodbSearchItemList.contains(id);
+}
+
+void SearchItemsManager::checkIntegrity()
+{
+	removeStaleItems(m_searchProvidersList);
+	removeStaleItems(m_actionProvidersList);
+	removeStaleItems(m_mojodbSearchItemList);
+	listChanged();
+}
 
-		if (root && !is_error(root))
-			json_object_put(root);
-		
-		if(!success)
-			return false;
+//Bump when the way app descriptors are turned into items changes.
+static const char* s_appDescriptorHashVersion = "2";
 
-		
-	return true;
+//The block as it is in the listApps reply.
+std::string SearchItemsManager::appDescriptorHash(const std::string& universalSearch, const std::string& icon)
+{
+	std::string input = s_appDescriptorHashVersion;
+	input += '\n';
+	input += universalSearch;
+	input += '\n';
+	input += icon;
+	
+	gchar* digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, input.c_str(), input.size());
+	std::string hash = digest ? digest : "";
+	g_free(digest);
 	
+	return hash;
 }
 
-bool SearchItemsManager::modifyDBSearchItem(const char* jsonStr)
+void SearchItemsManager::loadAppDescriptors()
 {
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	std::string id;
-	bool success = true;
-	bool enabled;
-	int index = 0;
-						
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-				
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Id is missing");
-		success = false;
-		goto Done;
-	}
-	id = json_object_get_string(label);
-			
-	label = json_object_object_get(root, "enabled");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "enabled is missing");
-		success = false;
-		goto Done;
-	}
-	enabled = json_object_get_boolean(label);
-		
-	//Iterate the list to find the matching object.
-	for(MojoDBSearchItemList::iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it,index++) {
-		MojoDBSearchItem& dbSearchItem =  (*it);
-		if(dbSearchItem.id == id) {
-			dbSearchItem.enabled = enabled;
-			dbHandler->updateDBSearchRecord(id.c_str(), enabled?1:0);
-			/*if(!enabled) {
-				moveDBSearchItem(id, index, (int)m_mojodbSearchItemList.size());
-			}*/
-			break;
+	if (m_appDescriptorsLoaded)
+		return;
+	
+	m_appDescriptorsLoaded = true;
+	dbHandler->readAppDescriptorHashes(m_appDescriptorHashes);
+	
+	for (AppDescriptorHashes::iterator it = m_appDescriptorHashes.begin(); it != m_appDescriptorHashes.end(); ) {
+		if (it->second.empty()) {
+			m_appsWithoutDescriptor.insert(it->first);
+			m_appDescriptorHashes.erase(it++);
 		}
+		else
+			++it;
 	}
-		
-	Done:
-
-		if (root && !is_error(root))
-			json_object_put(root);
-
-		if(!success)
-			return false;
+}
 
-	return true;	
+bool SearchItemsManager::isAppDescriptorUnchanged(const std::string& appId, const std::string& hash)
+{
+	loadAppDescriptors();
+	
+	AppDescriptorHashes::const_iterator it = m_appDescriptorHashes.find(appId);
+	return it != m_appDescriptorHashes.end() && it->second == hash;
 }
 
-bool SearchItemsManager::modifyAllDBSearchItems(const char* jsonStr)
+bool SearchItemsManager::isAppWithoutDescriptor(const std::string& appId)
 {
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	bool success = true;
-	bool enabled;
+	loadAppDescriptors();
+	
+	return m_appsWithoutDescriptor.count(appId) > 0;
+}
 
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
+void SearchItemsManager::setAppDescriptorHash(const std::string& appId, const std::string& hash)
+{
+	loadAppDescriptors();
+	
+	if (hash.empty()) {
+		if (!m_appsWithoutDescriptor.insert(appId).second)
+			return;
+		m_appDescriptorHashes.erase(appId);
 	}
-
-	label = json_object_object_get(root, "enabled");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "enabled is missing");
-		success = false;
-		goto Done;
+	else {
+		std::string& stored = m_appDescriptorHashes[appId];
+		if (stored == hash)
+			return;
+		stored = hash;
+		m_appsWithoutDescriptor.erase(appId);
 	}
-	enabled = json_object_get_boolean(label);
+	
+	dbHandler->setAppDescriptorHash(appId.c_str(), hash.c_str());
+}
 
-	//Iterate the list to find the matching object.
-	for(MojoDBSearchItemList::iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it) {
-		MojoDBSearchItem& dbSearchItem =  (*it);
-		dbSearchItem.enabled = enabled;
-	}
-	dbHandler->updateAllDBSearchRecord("dbsearch", enabled?1:0);
+void SearchItemsManager::forgetAppDescriptor(const std::string& appId)
+{
+	loadAppDescriptors();
+	
+	if (m_appDescriptorHashes.erase(appId) || m_appsWithoutDescriptor.erase(appId))
+		dbHandler->removeAppDescriptorHash(appId.c_str());
+}
 
-	Done:
+void SearchItemsManager::markAppItemsExist(const std::string& appId)
+{
+	SearchProvidersList::iterator searchItem = m_searchProvidersList.find(appId);
+	if(searchItem != m_searchProvidersList.end())
+		searchItem->appExist = true;
+	
+	ActionProvidersList::iterator actionProvider = m_actionProvidersList.find(appId);
+	if(actionProvider != m_actionProvidersList.end())
+		actionProvider->appExist = true;
+	
+	MojoDBSearchItemList::iterator dbSearch = m_mojodbSearchItemList.find(appId);
+	if(dbSearch != m_mojodbSearchItemList.end())
+		dbSearch->appExist = true;
+}
 
-		if (root && !is_error(root))
-			json_object_put(root);
+//Uninstalled apps; checkIntegrity() takes care of their items.
+void SearchItemsManager::forgetMissingApps(const std::set<std::string>& installedAppIds)
+{
+	std::vector<std::string> missing;
+	
+	loadAppDescriptors();
+	
+	for (AppDescriptorHashes::const_iterator it = m_appDescriptorHashes.begin(); it != m_appDescriptorHashes.end(); ++it) {
+		if (!installedAppIds.count(it->first))
+			missing.push_back(it->first);
+	}
+	
+	for (std::set<std::string>::const_iterator it = m_appsWithoutDescriptor.begin(); it != m_appsWithoutDescriptor.end(); ++it) {
+		if (!installedAppIds.count(*it))
+			missing.push_back(*it);
+	}
+	
+	for (std::vector<std::string>::const_iterator it = missing.begin(); it != missing.end(); ++it)
+		forgetAppDescriptor(*it);
+}
 
-		if(!success)
-			return false;
+template <class Traits>
+void SearchItemsManager::getBatchItems(const ProviderList<Traits>& list, BatchItems& items) const
+{
+	BatchItem item;
 
-	return true;
+	for(typename ProviderList<Traits>::const_iterator it=list.begin(); it!=list.end(); ++it) {
+		item.id = it->id.str();
+		item.version = it->version;
+		items.push_back(item);
+	}
 }
 
-bool SearchItemsManager::removeDBSearchItem(const char* jsonStr)
+/*
+ * Checks one operation the way the call of its op would, with the same schema as that
+ * call and the rules of addItem(), reorderItem() and moveItem(), and applies it to items.
+ * Updates and removes of an unknown id are errors here, though the calls ignore them.
+ */
+template <class Traits>
+bool SearchItemsManager::validateChange(BatchItems& items, json_object* operation, const std::string& op,
+		RequestArena& arena, std::string& errorText)
 {
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
+	const char* text = json_object_to_json_string(operation);
 	std::string id;
-	bool success = true;
-						
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
-	}
-				
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "Id is missing");
-		success = false;
-		goto Done;
-	}
-	id = json_object_get_string(label);
-				
-	//Iterate the list to find the matching object.
-	for(MojoDBSearchItemList::iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it) {
-		MojoDBSearchItem dbSearchItem =  (*it);
-		if(dbSearchItem.id == id) {
-			m_mojodbSearchItemList.erase(it);
-			dbHandler->removeDBSearchRecord(id.c_str());
-			break;
+	size_t pos;
+	bool hasFromIndex = false;
+	int fromIndex = -1;
+	int toIndex = 0;
+
+	if (op == "add") {
+		DecodedPayload<ItemPayload> request(arena);
+		typename Traits::Item item = typename Traits::Item();
+		ProviderFieldSet present;
+		BatchItem batchItem;
+
+		if (!request.decode(text, errorText, true))
+			return false;
+
+		id = request[ItemPayload::id].str();
+		if (id.empty() && !Traits::s_generatesId) {
+			errorText = "id is missing";
+			return false;
 		}
-	}
 
-	Done:
+		item.id = id;
+		ProviderList<Traits>::decode(request, item, present);
+		if (!present.has(Traits::Fields::version))
+			item.version = 1;
 
-		if (root && !is_error(root))
-			json_object_put(root);
+		//The batch adds without overwrite: only a higher version replaces an item.
+		pos = id.empty() ? BatchItems::npos : items.indexOf(id);
+		if (pos != BatchItems::npos && item.version <= items[pos].version) {
+			errorText = std::string(Traits::category()) + " item " + id + " already exists";
+			return false;
+		}
 
-		if(!success)
+		if (!Traits::accept(*this, item, present)) {
+			errorText = std::string("invalid ") + Traits::category() + " item";
 			return false;
-			
-	return true;	
-}
+		}
 
-bool SearchItemsManager::reorderDBSearchItem(const char* jsonStr)
-{
-	json_object* root = json_tokener_parse(jsonStr);
-	json_object* label = NULL;
-	bool success = true;
+		if (pos != BatchItems::npos)
+			items.erase(items.begin() + pos);
+		//A generated id cannot be referred to, but the item still takes its place.
+		batchItem.id = id;
+		batchItem.version = item.version;
+		items.push_back(batchItem);
+		return true;
+	}
 
-	std::string id;
-	int fromIndex, toIndex;
-	
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Failed to parse content into json");
-		success = false;
-		goto Done;
+	if (op == "update") {
+		DecodedPayload<UpdateItemPayload> request(arena);
+
+		if (!request.decode(text, errorText, true))
+			return false;
+		id = request[UpdateItemPayload::id].str();
 	}
-		
-	label = json_object_object_get(root, "id");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "ID is missing");
-		success = false;
-		goto Done;
+	else if (op == "remove") {
+		DecodedPayload<RemoveItemPayload> request(arena);
+
+		if (!request.decode(text, errorText, true))
+			return false;
+		id = request[RemoveItemPayload::id].str();
 	}
-	id = json_object_get_string(label);
-	
-	label = json_object_object_get(root, "fromIndex");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "From Index is missing");
-		success = false;
-		goto Done;
+	else if (op == "reorder") {
+		DecodedPayload<ReorderItemPayload> request(arena);
+
+		if (!request.decode(text, errorText, true))
+			return false;
+		id = request[ReorderItemPayload::id].str();
+		hasFromIndex = request[ReorderItemPayload::fromIndex].present();
+		fromIndex = request[ReorderItemPayload::fromIndex].toInt();
+		toIndex = request[ReorderItemPayload::toIndex].toInt();
 	}
-	fromIndex = json_object_get_int(label);
-	
-	if(fromIndex < 0 || fromIndex >= (int)m_mojodbSearchItemList.size()) {
-		luna_critical(s_logChannel, "fromIndex is out of range");
-		success = false;
-		goto Done;
+	else {
+		errorText = "unknown op " + op;
+		return false;
 	}
-	
-	label = json_object_object_get(root, "toIndex");
-	if (!label || is_error(label)) {
-		luna_critical(s_logChannel, "To Index is missing");
-		success = false;
-		goto Done;
+
+	if (id.empty()) {
+		errorText = "id is missing";
+		return false;
 	}
-	toIndex = json_object_get_int(label);
-	
-	//If an item moves downward, adjust the toIndex incrementing by 1.
-	if(fromIndex < toIndex) {
-		toIndex++;
+
+	pos = items.indexOf(id);
+	if (pos == BatchItems::npos) {
+		errorText = "no " + std::string(Traits::category()) + " item " + id;
+		return false;
 	}
-	
-	success = moveDBSearchItem(id, fromIndex, toIndex);
 
-	Done:
+	if (op == "remove") {
+		items.erase(items.begin() + pos);
+	}
+	else if (op == "reorder") {
+		//Search items are found by their id, the others must be where fromIndex says.
+		if (Traits::s_reorderAfterDefault) {
+			fromIndex = (int) pos;
+		}
+		else if (!hasFromIndex) {
+			errorText = "fromIndex is missing";
+			return false;
+		}
 
-		if (root && !is_error(root))
-			json_object_put(root);
+		if (fromIndex < 0 || fromIndex >= (int) items.size() || items[fromIndex].id != id) {
+			errorText = "fromIndex is out of range";
+			return false;
+		}
 
-		if(!success)
+		if (Traits::s_reorderAfterDefault)
+			toIndex++;
+		if (fromIndex < toIndex)
+			toIndex++;
+		if (toIndex > (int) items.size())
+			toIndex = (int) items.size();
+		if (toIndex < 0) {
+			errorText = "toIndex is out of range";
 			return false;
+		}
+
+		items.move(fromIndex, toIndex);
+	}
 
 	return true;
-	
 }
 
-bool SearchItemsManager::moveDBSearchItem(const std::string& id, int fromIndex, int toIndex)
+/*
+ * Checks each operation for a known op and category, and then as validateChange() does,
+ * against the lists as the earlier operations of the batch leave them.
+ */
+bool SearchItemsManager::validateSearchItemChanges(json_object* operations, int& failedIndex, std::string& errorText)
 {
+	BatchItems searchItems, actionItems, dbSearchItems;
+	RequestArena arena;
+	json_object* label = NULL;
 	
-	MojoDBSearchItemList::iterator fromIt, toIt;
-	
-	//Make sure toIndex is within the range.
-	if(toIndex > (int)m_mojodbSearchItemList.size())
-		toIndex = (int)m_mojodbSearchItemList.size();
+	failedIndex = -1;
 	
-	fromIt = m_mojodbSearchItemList.begin();
-	std::advance(fromIt, fromIndex);
-
-	//Make sure it points the item that we are moving.
-	if(fromIt->id != id) {
+	if (!operations || is_error(operations) || !json_object_is_type(operations, json_type_array)) {
+		errorText = "operations array is missing";
 		return false;
 	}
-
-	toIt = m_mojodbSearchItemList.begin();
-	std::advance(toIt, toIndex);
-	
-	m_mojodbSearchItemList.splice(toIt, m_mojodbSearchItemList, fromIt);
-
-	//Sync the Database
-	syncPrefDb();
 	
-	return true;
+	if (json_object_array_length(operations) == 0) {
+		errorText = "operations array is empty";
+		return false;
+	}
 	
-}
-
-json_object* SearchItemsManager::getDBSearchItemList() 
-{
-	json_object* objArray = json_object_new_array();
-	size_t found;
+	getBatchItems(m_searchProvidersList, searchItems);
+	getBatchItems(m_actionProvidersList, actionItems);
+	getBatchItems(m_mojodbSearchItemList, dbSearchItems);
 	
-	for(MojoDBSearchItemList::const_iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it) {
+	for (int i = 0; i < json_object_array_length(operations); i++) {
+		json_object* operation = json_object_array_get_idx(operations, i);
+		std::string op, category;
+		bool valid;
 		
-		MojoDBSearchItem dbSearchItem =  (*it);
+		failedIndex = i;
 		
-		json_object* infoObj = json_object_new_object();
+		if (!operation || is_error(operation) || !json_object_is_type(operation, json_type_object)) {
+			errorText = "operation is not an object";
+			return false;
+		}
 		
-		json_object_object_add(infoObj,(char*) "id",json_object_new_string((char*) dbSearchItem.id.c_str()));
-		json_object_object_add(infoObj,(char*) "displayName",json_object_new_string((char*) dbSearchItem.displayName.c_str()));
-		json_object_object_add(infoObj,(char*) "iconFilePath",json_object_new_string((char*) dbSearchItem.iconFilePath.c_str()));
-		json_object_object_add(infoObj,(char*) "launchParam",json_object_new_string((char*) dbSearchItem.launchParam.c_str()));
-		json_object_object_add(infoObj,(char*) "launchParamDbField",json_object_new_string((char*) dbSearchItem.launchParamDbField.c_str()));
-		json_object_object_add(infoObj,(char*) "dbQuery",json_tokener_parse((char*) dbSearchItem.dbQuery.c_str()));
+		label = json_object_object_get(operation, "op");
+		if (!label || is_error(label)) {
+			errorText = "op is missing";
+			return false;
+		}
+		op = json_object_get_string(label);
 		
-		found = dbSearchItem.displayFields.find_first_of('[', 0);
-		if(found != std::string::npos)
-			json_object_object_add(infoObj,(char*) "displayFields", json_tokener_parse((char*) dbSearchItem.displayFields.c_str()));
-		else
-			json_object_object_add(infoObj,(char*) "displayFields", json_object_new_string((char*) dbSearchItem.displayFields.c_str()));
-		json_object_object_add(infoObj,(char*) "batchQuery",json_object_new_boolean(dbSearchItem.batchQuery));
-		json_object_object_add(infoObj,(char*) "enabled",json_object_new_boolean(dbSearchItem.enabled));
+		label = json_object_object_get(operation, "category");
+		if (!label || is_error(label)) {
+			errorText = "category is missing";
+			return false;
+		}
+		category = json_object_get_string(label);
 		
-		json_object_array_add(objArray, infoObj);
+		if (category == "search")
+			valid = validateChange<SearchTraits>(searchItems, operation, op, arena, errorText);
+		else if (category == "action")
+			valid = validateChange<ActionTraits>(actionItems, operation, op, arena, errorText);
+		else if (category == "dbsearch")
+			valid = validateChange<DBSearchTraits>(dbSearchItems, operation, op, arena, errorText);
+		else {
+			errorText = "unknown category " + category;
+			return false;
+		}
 		
+		if (!valid)
+			return false;
 	}
-	return objArray;
+	
+	failedIndex = -1;
+	return true;
 }
 
-
-bool SearchItemsManager::validateDbSearchItem(std::string appId, const char* dbQuery)
+bool SearchItemsManager::beginBatch()
 {
-	json_object* fromObj = NULL;
-	json_object* label = NULL;
-	std::string dbKind;
-	
-	//No restriction for Palm Apps.
-	if(appId.find("com.palm.",0) != std::string::npos) {
-		return true;
+	if (m_inBatch) {
+		luna_critical(s_logChannel, "Batch already in progress");
+		return false;
 	}
 	
-	fromObj = json_tokener_parse(dbQuery);
-	
-	label = json_object_object_get(fromObj, "from");
-	if(!label || is_error(label))
+	if (!dbHandler->beginTransaction())
 		return false;
-	dbKind = json_object_get_string(label);
 	
-	//Db Query should not contain com.palm in the db kind.
-	if(dbKind.find("com.palm.",0) == std::string::npos)
-		return true;
+	m_batchSearchProviders = m_searchProvidersList;
+	m_batchActionProviders = m_actionProvidersList;
+	m_batchDBSearchItems = m_mojodbSearchItemList;
+	//Removing an item forgets the hash of its app; the row goes with the transaction.
+	m_batchAppDescriptorHashes = m_appDescriptorHashes;
+	m_batchAppsWithoutDescriptor = m_appsWithoutDescriptor;
+	m_batchAppDescriptorsLoaded = m_appDescriptorsLoaded;
+	m_inBatch = true;
 	
-	return false;
+	return true;
 }
 
-bool SearchItemsManager::isItemExist(const std::string& id)
+void SearchItemsManager::commitBatch()
 {
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		SearchProvider searchItem =  (*it);
-		if(searchItem.id == id) {
-			return true;
-		}
-	}
+	if (!m_inBatch)
+		return;
 	
-	for(ActionProvidersList::iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-		ActionProvider actionProvider =  (*it);
-		if(actionProvider.id == id) {
-			return true;
-		}
-	}
+	dbHandler->commitTransaction();
 	
-	for(MojoDBSearchItemList::iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it) {
-		MojoDBSearchItem dbSearch =  (*it);
-		if(dbSearch.id == id) {
-			return true;
-		}
-	}
-	return false;
+	m_batchSearchProviders.clear();
+	m_batchActionProviders.clear();
+	m_batchDBSearchItems.clear();
+	m_batchAppDescriptorHashes.clear();
+	m_batchAppsWithoutDescriptor.clear();
+	m_inBatch = false;
 }
 
-void SearchItemsManager::checkIntegrity()
+void SearchItemsManager::rollbackBatch()
 {
-	for(SearchProvidersList::iterator it=m_searchProvidersList.begin(); it!=m_searchProvidersList.end(); ++it) {
-		SearchProvider searchItem =  (*it);
-		if(searchItem.type == "app" && !searchItem.appExist && searchItem.id != "map") {
-			dbHandler->removeSearchRecord(searchItem.id.c_str(), "search");
-		}
-	}
-
-	for(ActionProvidersList::iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-		ActionProvider actionProvider =  (*it);
-			if(!actionProvider.appExist) {
-				dbHandler->removeSearchRecord(actionProvider.id.c_str(), "action");
-			}
-		}
-
-	for(MojoDBSearchItemList::iterator it=m_mojodbSearchItemList.begin(); it!=m_mojodbSearchItemList.end(); ++it) {
-		MojoDBSearchItem dbSearch =  (*it);
-		if(!dbSearch.appExist) {
-			dbHandler->removeDBSearchRecord(dbSearch.id.c_str());
-		}
-	}
-	m_searchProvidersList.remove_if(PredSearch());
-	m_actionProvidersList.remove_if(PredAction());
-	m_mojodbSearchItemList.remove_if(PredDbSearch());
+	if (!m_inBatch)
+		return;
+	
+	dbHandler->rollbackTransaction();
+	
+	m_searchProvidersList.swap(m_batchSearchProviders);
+	m_actionProvidersList.swap(m_batchActionProviders);
+	m_mojodbSearchItemList.swap(m_batchDBSearchItems);
+	m_appDescriptorHashes.swap(m_batchAppDescriptorHashes);
+	m_appsWithoutDescriptor.swap(m_batchAppsWithoutDescriptor);
+	m_appDescriptorsLoaded = m_batchAppDescriptorsLoaded;
+	listChanged();
+	
+	m_batchSearchProviders.clear();
+	m_batchActionProviders.clear();
+	m_batchDBSearchItems.clear();
+	m_batchAppDescriptorHashes.clear();
+	m_batchAppsWithoutDescriptor.clear();
+	m_inBatch = false;
 }
 
 void SearchItemsManager::dumpList() 
@@ -1772,7 +2027,7 @@ void SearchItemsManager::dumpList()
 
 void SearchItemsManager::dumpActionList() {
 	for(ActionProvidersList::const_iterator it=m_actionProvidersList.begin(); it!=m_actionProvidersList.end(); ++it) {
-			ActionProvider actionProvider =  (*it);
+			const ActionProvider& actionProvider =  (*it);
 			const char* appId = actionProvider.id.c_str();
 			//const char* displayName = actionProvider.displayName.c_str();
 			luna_critical(s_logChannel, "Action Provider :: %s  %d ", appId, actionProvider.appExist);
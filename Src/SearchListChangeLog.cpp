@@ -0,0 +1,233 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "SearchListChangeLog.h"
+#include "Logging.h"
+
+static const char* s_logChannel = "SearchListChangeLog";
+const char* SearchListChangeLog::s_listNames[] = { "UniversalSearchList", "ActionList", "DBSearchItemList" };
+
+SearchListChangeLog::SearchListChangeLog()
+{
+	m_generation = 0;
+	m_hasState = false;
+	//Generations restart with the process, the instance id tells clients apart from a previous run.
+	m_instanceId = ((unsigned int) time(NULL) ^ ((unsigned int) getpid() << 16)) & 0x7fffffff;
+}
+
+/*
+ * Changes are emitted so that they can be applied in order: removals first, then
+ * additions and moves by ascending target index, then field changes. Items that keep
+ * their relative order (the longest increasing run of old positions) are not moved.
+ */
+int SearchListChangeLog::diffList(const char* listName, const ListState& oldList, const ListState& newList, JsonWriter& changes)
+{
+	int count = 0;
+
+	std::map<std::string, int> oldIndex;
+	std::map<std::string, int> newIndex;
+
+	for (int i = 0; i < (int) oldList.size(); i++)
+		oldIndex[oldList[i].id] = i;
+	for (int i = 0; i < (int) newList.size(); i++)
+		newIndex[newList[i].id] = i;
+
+	for (int i = 0; i < (int) oldList.size(); i++) {
+		if (newIndex.find(oldList[i].id) != newIndex.end())
+			continue;
+		changes.beginObject();
+		changes.key("op").value("removed");
+		changes.key("list").value(listName);
+		changes.key("id").value(oldList[i].id);
+		changes.endObject();
+		count++;
+	}
+
+	//Old positions of the surviving items, in their new order.
+	std::vector<int> common;
+	std::vector<int> commonNewIndex;
+	for (int i = 0; i < (int) newList.size(); i++) {
+		std::map<std::string, int>::const_iterator found = oldIndex.find(newList[i].id);
+		if (found == oldIndex.end())
+			continue;
+		common.push_back(found->second);
+		commonNewIndex.push_back(i);
+	}
+
+	//Longest increasing subsequence of the old positions; those items stay in place.
+	std::vector<int> tails;
+	std::vector<int> tailIndex;
+	std::vector<int> previous(common.size(), -1);
+	for (int i = 0; i < (int) common.size(); i++) {
+		int pos = std::lower_bound(tails.begin(), tails.end(), common[i]) - tails.begin();
+		if (pos == (int) tails.size()) {
+			tails.push_back(common[i]);
+			tailIndex.push_back(i);
+		}
+		else {
+			tails[pos] = common[i];
+			tailIndex[pos] = i;
+		}
+		previous[i] = pos > 0 ? tailIndex[pos - 1] : -1;
+	}
+
+	std::vector<bool> stays(newList.size(), false);
+	for (int i = tailIndex.empty() ? -1 : tailIndex.back(); i >= 0; i = previous[i])
+		stays[commonNewIndex[i]] = true;
+
+	for (int i = 0; i < (int) newList.size(); i++) {
+		if (stays[i])
+			continue;
+		changes.beginObject();
+		if (oldIndex.find(newList[i].id) == oldIndex.end()) {
+			changes.key("op").value("added");
+			changes.key("list").value(listName);
+			changes.key("id").value(newList[i].id);
+			changes.key("index").value(i);
+			changes.key("item").raw(newList[i].item);
+		}
+		else {
+			changes.key("op").value("moved");
+			changes.key("list").value(listName);
+			changes.key("id").value(newList[i].id);
+			changes.key("index").value(i);
+		}
+		changes.endObject();
+		count++;
+	}
+
+	for (int i = 0; i < (int) newList.size(); i++) {
+		std::map<std::string, int>::const_iterator found = oldIndex.find(newList[i].id);
+		if (found == oldIndex.end())
+			continue;
+
+		const ItemState& oldItem = oldList[found->second];
+		const ItemState& newItem = newList[i];
+		for (std::map<std::string, std::string>::const_iterator field = newItem.fields.begin(); field != newItem.fields.end(); ++field) {
+			std::map<std::string, std::string>::const_iterator oldField = oldItem.fields.find(field->first);
+			if (oldField != oldItem.fields.end() && oldField->second == field->second)
+				continue;
+			changes.beginObject();
+			changes.key("op").value("fieldChanged");
+			changes.key("list").value(listName);
+			changes.key("id").value(newItem.id);
+			changes.key("field").value(field->first);
+			changes.key("value").raw(field->second);
+			changes.endObject();
+			count++;
+		}
+
+		//Fields that disappeared are reported with a null value.
+		for (std::map<std::string, std::string>::const_iterator field = oldItem.fields.begin(); field != oldItem.fields.end(); ++field) {
+			if (newItem.fields.find(field->first) != newItem.fields.end())
+				continue;
+			changes.beginObject();
+			changes.key("op").value("fieldChanged");
+			changes.key("list").value(listName);
+			changes.key("id").value(newItem.id);
+			changes.key("field").value(field->first);
+			changes.key("value").null();
+			changes.endObject();
+			count++;
+		}
+	}
+
+	return count;
+}
+
+unsigned int SearchListChangeLog::record(ListState* lists, const std::string& defaultSearchEngine)
+{
+	if (m_hasState) {
+		JsonWriter step;
+		int count = 0;
+
+		step.beginObject();
+		step.key("fromGeneration").value((int) m_generation);
+		step.key("generation").value((int) m_generation + 1);
+		step.key("changes").beginArray();
+
+		for (int i = 0; i < s_numLists; i++)
+			count += diffList(s_listNames[i], m_lists[i], lists[i], step);
+
+		//Not an item: no list and no id.
+		if (defaultSearchEngine != m_defaultSearchEngine) {
+			step.beginObject();
+			step.key("op").value("fieldChanged");
+			step.key("field").value("defaultSearchEngine");
+			step.key("value").value(defaultSearchEngine);
+			step.endObject();
+			count++;
+		}
+
+		step.endArray();
+		step.endObject();
+
+		if (count > 0) {
+			ChangeStep change;
+			change.fromGeneration = m_generation;
+			change.generation = ++m_generation;
+			change.serialized = step.str();
+
+			m_steps.push_back(change);
+			if (m_steps.size() > s_maxSteps)
+				m_steps.pop_front();
+
+			luna_log(s_logChannel, "generation %u: %d changes", m_generation, count);
+		}
+	}
+	else {
+		m_hasState = true;
+		m_generation = 1;
+	}
+
+	for (int i = 0; i < s_numLists; i++)
+		m_lists[i].swap(lists[i]);
+	m_defaultSearchEngine = defaultSearchEngine;
+
+	return m_generation;
+}
+
+bool SearchListChangeLog::changesSince(unsigned int generation, std::string& changes) const
+{
+	changes = "[ ";
+
+	if (generation == m_generation) {
+		changes += "]";
+		return true;
+	}
+
+	std::deque<ChangeStep>::const_iterator it = m_steps.begin();
+	while (it != m_steps.end() && it->fromGeneration != generation)
+		++it;
+
+	if (it == m_steps.end())
+		return false;
+
+	for (bool first = true; it != m_steps.end(); ++it, first = false) {
+		if (!first)
+			changes += ", ";
+		changes += it->serialized;
+	}
+	changes += " ]";
+
+	return true;
+}
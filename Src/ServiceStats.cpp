@@ -0,0 +1,130 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <string.h>
+
+#include "ServiceStats.h"
+
+static ServiceStats* s_stats_instance = NULL;
+
+static const char* s_kindNames[] = { "latency", "payloadSize", "subscribers", "counters" };
+
+void ServiceStats::Metric::record(guint64 value)
+{
+	int bucket = 0;
+
+	//Bucket i holds the values below 2^(i+1).
+	for (guint64 v = value >> 1; v && bucket < s_numBuckets - 1; v >>= 1)
+		bucket++;
+
+	count++;
+	sum += value;
+	if (value > max)
+		max = value;
+	buckets[bucket]++;
+}
+
+void ServiceStats::Metric::reset()
+{
+	count = 0;
+	sum = 0;
+	max = 0;
+	memset(buckets, 0, sizeof(buckets));
+}
+
+ServiceStats* ServiceStats::instance()
+{
+	if (!s_stats_instance)
+		s_stats_instance = new ServiceStats();
+
+	return s_stats_instance;
+}
+
+ServiceStats::ServiceStats()
+{
+	m_since = g_get_monotonic_time();
+}
+
+/*
+ * Metrics live as long as the service, so callers may keep the returned pointer.
+ */
+ServiceStats::Metric* ServiceStats::metric(const char* name, Kind kind)
+{
+	std::pair<Kind, std::string> key(kind, name);
+	MetricMap::iterator it = m_metrics.find(key);
+	if (it != m_metrics.end())
+		return it->second;
+
+	Metric* metric = new Metric();
+	metric->kind = kind;
+	metric->reset();
+	m_metrics[key] = metric;
+
+	return metric;
+}
+
+void ServiceStats::reset()
+{
+	for (MetricMap::iterator it = m_metrics.begin(); it != m_metrics.end(); ++it)
+		it->second->reset();
+
+	m_since = g_get_monotonic_time();
+}
+
+json_object* ServiceStats::toJson() const
+{
+	json_object* stats = json_object_new_object();
+	json_object* groups[4];
+
+	for (int i = 0; i < 4; i++) {
+		groups[i] = json_object_new_object();
+		json_object_object_add(stats, s_kindNames[i], groups[i]);
+	}
+
+	json_object_object_add(stats, "periodMs", json_object_new_int((int) ((g_get_monotonic_time() - m_since) / 1000)));
+
+	for (MetricMap::const_iterator it = m_metrics.begin(); it != m_metrics.end(); ++it) {
+		const Metric* metric = it->second;
+
+		if (metric->kind == Counter) {
+			json_object_object_add(groups[Counter], it->first.second.c_str(), json_object_new_int((int) metric->count));
+			continue;
+		}
+
+		json_object* entry = json_object_new_object();
+		json_object_object_add(entry, "count", json_object_new_int((int) metric->count));
+		json_object_object_add(entry, "max", json_object_new_int((int) metric->max));
+		json_object_object_add(entry, "mean", json_object_new_int(metric->count ? (int) (metric->sum / metric->count) : 0));
+
+		//Only the buckets in use, each with its exclusive upper bound.
+		json_object* histogram = json_object_new_array();
+		for (int i = 0; i < s_numBuckets; i++) {
+			if (!metric->buckets[i])
+				continue;
+			json_object* bucket = json_object_new_object();
+			json_object_object_add(bucket, "below", json_object_new_int(i < 30 ? (1 << (i + 1)) : G_MAXINT));
+			json_object_object_add(bucket, "count", json_object_new_int((int) metric->buckets[i]));
+			json_object_array_add(histogram, bucket);
+		}
+		json_object_object_add(entry, "histogram", histogram);
+
+		json_object_object_add(groups[metric->kind], it->first.second.c_str(), entry);
+	}
+
+	return stats;
+}
@@ -0,0 +1,252 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include "StartupPipeline.h"
+#include "UniversalSearchService.h"
+#include "UniversalSearchPrefsDb.h"
+#include "Logging.h"
+#include "ServiceStats.h"
+#include "BusCapture.h"
+
+static const char* s_logChannel = "StartupPipeline";
+
+//The database read and the plugin scan are the only jobs.
+static const int s_maxPoolThreads = 2;
+
+StartupPipeline::StartupPipeline()
+{
+	m_pool = NULL;
+	m_done = 0;
+	m_launchTime = g_get_monotonic_time();
+	m_firstReplyRecorded = false;
+	m_dbRows = NULL;
+}
+
+StartupPipeline::~StartupPipeline()
+{
+	if (m_pool)
+		g_thread_pool_free(m_pool, FALSE, TRUE);
+
+	delete m_dbRows;
+
+	for (std::list<DeferredMessage>::iterator it = m_deferred.begin(); it != m_deferred.end(); ++it)
+		LSMessageUnref(it->message);
+}
+
+/*
+ * Called while the service is being constructed; it must not go through
+ * UniversalSearchService::instance() here.
+ */
+void StartupPipeline::start(const std::string& pluginPath)
+{
+	GError* error = NULL;
+
+	m_pool = g_thread_pool_new(runJob, NULL, s_maxPoolThreads, FALSE, &error);
+	if (!m_pool) {
+		luna_critical(s_logChannel, "Failed to create the startup pool (%s), running the jobs in line",
+				error ? error->message : "unknown error");
+		if (error)
+			g_error_free(error);
+	}
+
+	queueDatabaseJob();
+
+	Job* job = new Job();
+	job->stage = StagePlugins;
+	job->rows = NULL;
+	job->pluginPath = pluginPath;
+	queueJob(job);
+}
+
+void StartupPipeline::queueDatabaseJob()
+{
+	Job* job = new Job();
+	job->stage = StageDatabase;
+	job->rows = NULL;
+	job->dbPath = UniversalSearchPrefsDb::instance()->getPath();
+	queueJob(job);
+}
+
+void StartupPipeline::queueJob(Job* job)
+{
+	job->pipeline = this;
+	job->durationUs = 0;
+
+	if (!m_pool || !g_thread_pool_push(m_pool, job, NULL))
+		runJob(job, NULL);
+}
+
+/*
+ * Runs on a pool thread. Only touches the job; the result goes back to the main loop.
+ */
+void StartupPipeline::runJob(gpointer data, gpointer user_data)
+{
+	Job* job = (Job*) data;
+	gint64 start = g_get_monotonic_time();
+
+	switch (job->stage) {
+	case StageDatabase:
+		job->rows = new UniversalSearchPrefsDb::RecordBuffer();
+		UniversalSearchPrefsDb::instance()->readPrefDb(*job->rows, job->dbPath);
+		break;
+	case StagePlugins:
+		OpenSearchHandler::readPluginDirectory(job->pluginPath, job->plugins);
+		break;
+	default:
+		break;
+	}
+
+	job->durationUs = g_get_monotonic_time() - start;
+	g_idle_add(cbJobDone, job);
+}
+
+gboolean StartupPipeline::cbJobDone(gpointer data)
+{
+	Job* job = (Job*) data;
+
+	job->pipeline->jobDone(job);
+	delete job;
+
+	return FALSE;
+}
+
+void StartupPipeline::jobDone(Job* job)
+{
+	if (job->stage == StageDatabase) {
+		STATS_RECORD("startup.database", ServiceStats::Latency, job->durationUs);
+		m_dbRows = job->rows;
+		m_dbRowsPath = job->dbPath;
+		job->rows = NULL;
+	}
+	else if (job->stage == StagePlugins) {
+		STATS_RECORD("startup.plugins", ServiceStats::Latency, job->durationUs);
+		m_plugins.swap(job->plugins);
+	}
+
+	luna_log(s_logChannel, "Stage 0x%x done in %lld us", job->stage, (long long) job->durationUs);
+	m_done |= job->stage;
+	advance();
+}
+
+void StartupPipeline::localeKnown()
+{
+	if (m_done & StageLocale)
+		return;
+
+	STATS_RECORD("startup.locale", ServiceStats::Latency, g_get_monotonic_time() - m_launchTime);
+	m_done |= StageLocale;
+	advance();
+}
+
+void StartupPipeline::advance()
+{
+	if (!(m_done & StageMerged) && (m_done & StageDatabase) && (m_done & StageLocale)) {
+		/*
+		 * The partition of the locale is only opened once the launch read is over: the
+		 * first locale adopts the database file by renaming it, which must not happen
+		 * under the read connection. What was read is still valid unless the content
+		 * changed with the partition.
+		 */
+		if (!UniversalSearchPrefsDb::instance()->setLocale(UniversalSearchService::instance()->getLocale()))
+			m_dbRowsPath = UniversalSearchPrefsDb::instance()->getPath();
+
+		if (m_dbRowsPath != UniversalSearchPrefsDb::instance()->getPath()) {
+			//The locale picked another partition than the one read at launch.
+			luna_critical(s_logChannel, "Reading %s again", UniversalSearchPrefsDb::instance()->getPath().c_str());
+			delete m_dbRows;
+			m_dbRows = NULL;
+			m_done &= ~StageDatabase;
+			queueDatabaseJob();
+		}
+		else {
+			merge();
+			m_done |= StageMerged;
+		}
+	}
+
+	if (!(m_done & StageReady) && (m_done & StageMerged) && (m_done & StagePlugins)) {
+		//Plugins that are in the search list get their urls refreshed, hence after the merge.
+		UniversalSearchService::instance()->openSearchHandler->addScannedPlugins(m_plugins);
+		m_plugins.clear();
+
+		m_done |= StageReady;
+		gint64 elapsed = g_get_monotonic_time() - m_launchTime;
+		STATS_RECORD("startup.ready", ServiceStats::Latency, elapsed);
+		luna_critical(s_logChannel, "Lists ready %lld ms after launch", (long long) (elapsed / 1000));
+
+		if (m_pool) {
+			g_thread_pool_free(m_pool, FALSE, TRUE);
+			m_pool = NULL;
+		}
+
+		replayDeferred();
+		UniversalSearchService::instance()->searchItemsMgr->scheduleCatalogueSave();
+
+		//Subscribers that came early only have the empty lists.
+		UniversalSearchService::instance()->postSearchListChange("update");
+	}
+}
+
+void StartupPipeline::merge()
+{
+	STATS_SCOPE("startup.merge");
+
+	UniversalSearchService::instance()->searchItemsMgr->init(*m_dbRows);
+
+	delete m_dbRows;
+	m_dbRows = NULL;
+}
+
+bool StartupPipeline::deferUntilReady(LSHandle* lshandle, LSMessage* message, LSFilterFunc callback)
+{
+	if (isReady())
+		return false;
+
+	DeferredMessage deferred;
+	deferred.lshandle = lshandle;
+	deferred.message = message;
+	deferred.callback = callback;
+	LSMessageRef(message);
+	m_deferred.push_back(deferred);
+
+	STATS_COUNT("startup.deferredMessages");
+	return true;
+}
+
+void StartupPipeline::replayDeferred()
+{
+	std::list<DeferredMessage> deferred;
+	deferred.swap(m_deferred);
+
+	//They were captured when they arrived.
+	BusCapture::instance()->setSuspended(true);
+	for (std::list<DeferredMessage>::iterator it = deferred.begin(); it != deferred.end(); ++it) {
+		it->callback(it->lshandle, it->message, NULL);
+		LSMessageUnref(it->message);
+	}
+	BusCapture::instance()->setSuspended(false);
+}
+
+void StartupPipeline::listReplySent()
+{
+	if (m_firstReplyRecorded || !isReady())
+		return;
+
+	m_firstReplyRecorded = true;
+	STATS_RECORD("startup.timeToFirstListReply", ServiceStats::Latency, g_get_monotonic_time() - m_launchTime);
+}
@@ -0,0 +1,101 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include "StringPool.h"
+
+static StringPool* s_pool_instance = NULL;
+
+const std::string PooledString::s_empty;
+
+/*
+ * Never deleted: items in other singletons may release their handles at any point
+ * of the shutdown.
+ */
+StringPool* StringPool::instance()
+{
+	if (!s_pool_instance)
+		s_pool_instance = new StringPool();
+
+	return s_pool_instance;
+}
+
+StringPool::StringPool()
+{
+	m_stats.strings = 0;
+	m_stats.references = 0;
+	m_stats.internedBytes = 0;
+	m_stats.rawBytes = 0;
+}
+
+//Returns the entry with one more handle, which the caller owns. Only a new entry allocates.
+StringPool::Entry* StringPool::intern(const char* text, size_t length)
+{
+	Key key = { text, length };
+	Entries::iterator it = m_entries.find(key);
+	Entry* entry;
+
+	if (it != m_entries.end()) {
+		entry = it->second;
+	}
+	else {
+		entry = new Entry(std::string(text, length), 0);
+		key.text = entry->first.data();
+		m_entries.insert(Entries::value_type(key, entry));
+		m_stats.strings++;
+		m_stats.internedBytes += length;
+	}
+
+	retain(entry);
+	return entry;
+}
+
+void StringPool::release(Entry* entry)
+{
+	m_stats.references--;
+	m_stats.rawBytes -= entry->first.size();
+
+	if (--entry->second == 0) {
+		Key key = { entry->first.data(), entry->first.size() };
+
+		m_stats.strings--;
+		m_stats.internedBytes -= entry->first.size();
+		m_entries.erase(key);
+		delete entry;
+	}
+}
+
+json_object* StringPool::toJson() const
+{
+	json_object* obj = json_object_new_object();
+
+	json_object_object_add(obj, "strings", json_object_new_int((int) m_stats.strings));
+	json_object_object_add(obj, "references", json_object_new_int((int) m_stats.references));
+	json_object_object_add(obj, "internedBytes", json_object_new_int((int) m_stats.internedBytes));
+	json_object_object_add(obj, "rawBytes", json_object_new_int((int) m_stats.rawBytes));
+
+	return obj;
+}
+
+PooledString& PooledString::assign(const char* text, size_t length)
+{
+	StringPool::Entry* entry = intern(text, length);
+
+	release();
+	m_entry = entry;
+	return *this;
+}
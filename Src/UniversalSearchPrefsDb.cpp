@@ -18,17 +18,156 @@
 
 #include <glib.h>
 #include <cjson/json.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <iostream>
 #include <sstream>
 
 #include "UniversalSearchPrefsDb.h"
 #include "Logging.h"
+#include "ServiceStats.h"
+#include "JsonWriter.h"
 
 static const char* s_logChannel = "UniversalSearchPrefsDb";
+//Database of the releases without partitions; adopted by the first locale that shows up.
 static const char* usp_dbFile = "/var/luna/preferences/universalsearchprefs.db";
+static const char* usp_partitionFileFormat = "/var/luna/preferences/universalsearchprefs-%s.db";
+static const char* usp_localeFile = "/var/luna/preferences/universalsearchprefs.locale";
 UniversalSearchPrefsDb* UniversalSearchPrefsDb::s_uspDb_instance = 0;
 
+static const char* s_synchronousLevels[] = { "OFF", "NORMAL", "FULL" };
+static const char* s_defaultSynchronousLevel = "NORMAL";
+//Upper bound of queued units the writer commits in one transaction.
+static const unsigned int s_maxOpsPerCommit = 256;
+static const int s_writerBusyTimeoutMs = 5000;
+
+//Indexed by UniversalSearchPrefsDb::Statement.
+static const char* s_statementSql[] = {
+	"INSERT OR REPLACE INTO SearchList "
+	"(id, category, " SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_COLUMN) "position) "
+	"VALUES (?, ?, " SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_PARAMETER) "?)",
+	"UPDATE OR REPLACE SearchList SET ENABLED = ? WHERE ID = ? AND CATEGORY = ?",
+	"UPDATE OR REPLACE SearchList SET ENABLED = ? WHERE CATEGORY = ?",
+	"DELETE FROM SearchList WHERE ID = ? AND CATEGORY = ?",
+	"UPDATE SearchList SET position = ? WHERE ID = ? AND CATEGORY = ?",
+	"INSERT OR REPLACE INTO DBSearchList "
+	"(id, category, " DB_SEARCH_ITEM_FIELDS(PROVIDER_FIELD_COLUMN) "position) "
+	"VALUES (?, ?, " DB_SEARCH_ITEM_FIELDS(PROVIDER_FIELD_PARAMETER) "?)",
+	"UPDATE OR REPLACE DBSearchList SET ENABLED = ? WHERE ID = ?",
+	"UPDATE OR REPLACE DBSearchList SET ENABLED = ? WHERE CATEGORY = ?",
+	"DELETE FROM DBSearchList WHERE ID = ?",
+	"UPDATE DBSearchList SET position = ? WHERE ID = ?",
+	"INSERT OR REPLACE INTO AppDescriptor VALUES (?, ?)",
+	"DELETE FROM AppDescriptor WHERE appId = ?",
+	"INSERT INTO SearchPreference VALUES (?, ?)",
+	"SELECT key, value FROM SearchPreference",
+	"SELECT appId, hash FROM AppDescriptor",
+	"BEGIN TRANSACTION",
+	"COMMIT TRANSACTION",
+	"ROLLBACK TRANSACTION",
+	"SAVEPOINT unit",
+	"RELEASE unit",
+	"ROLLBACK TO unit"
+};
+
+UniversalSearchPrefsDb::Write& UniversalSearchPrefsDb::Write::text(const char* value)
+{
+	Value bound;
+	bound.isNull = value == NULL;
+	bound.isText = true;
+	bound.number = 0;
+	if (value)
+		bound.text = value;
+	values.push_back(bound);
+	return *this;
+}
+
+UniversalSearchPrefsDb::Write& UniversalSearchPrefsDb::Write::number(int value)
+{
+	Value bound;
+	bound.isNull = false;
+	bound.isText = false;
+	bound.number = value;
+	values.push_back(bound);
+	return *this;
+}
+
+UniversalSearchPrefsDb::StatementCache::StatementCache()
+{
+	m_db = 0;
+	for (int i = 0; i < NumStatements; i++)
+		m_statements[i] = 0;
+}
+
+void UniversalSearchPrefsDb::StatementCache::open(sqlite3* db)
+{
+	close();
+	m_db = db;
+}
+
+//Has to run before the connection is closed.
+void UniversalSearchPrefsDb::StatementCache::close()
+{
+	for (int i = 0; i < NumStatements; i++) {
+		if (m_statements[i]) {
+			sqlite3_finalize(m_statements[i]);
+			m_statements[i] = 0;
+		}
+	}
+	m_db = 0;
+}
+
+sqlite3_stmt* UniversalSearchPrefsDb::StatementCache::get(Statement statement)
+{
+	int ret;
+	
+	if (m_statements[statement] || !m_db)
+		return m_statements[statement];
+	
+#if SQLITE_VERSION_NUMBER >= 3020000
+	//Kept for the life of the connection; tells SQLite not to use its lookaside memory for it.
+	ret = sqlite3_prepare_v3(m_db, s_statementSql[statement], -1, SQLITE_PREPARE_PERSISTENT, &m_statements[statement], NULL);
+#else
+	ret = sqlite3_prepare_v2(m_db, s_statementSql[statement], -1, &m_statements[statement], NULL);
+#endif
+	if (ret) {
+		luna_critical(s_logChannel, "Failed to prepare sql statement: %s (%s)", s_statementSql[statement], sqlite3_errmsg(m_db));
+		m_statements[statement] = 0;
+	}
+	
+	return m_statements[statement];
+}
+
+int UniversalSearchPrefsDb::StatementCache::execute(const Write& write)
+{
+	sqlite3_stmt* statement = get(write.statement);
+	int ret;
+	
+	if (!statement)
+		return SQLITE_ERROR;
+	
+	//The values outlive the statement execution, no copies needed.
+	for (unsigned int i = 0; i < write.values.size(); i++) {
+		const Write::Value& value = write.values[i];
+		if (value.isNull)
+			sqlite3_bind_null(statement, i + 1);
+		else if (value.isText)
+			sqlite3_bind_text(statement, i + 1, value.text.data(), (int) value.text.size(), SQLITE_STATIC);
+		else
+			sqlite3_bind_int(statement, i + 1, value.number);
+	}
+	
+	while ((ret = sqlite3_step(statement)) == SQLITE_ROW)
+		;
+	
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+	
+	return ret == SQLITE_DONE ? SQLITE_OK : ret;
+}
+
 UniversalSearchPrefsDb* UniversalSearchPrefsDb::instance()
 {
 	
@@ -42,6 +181,23 @@ UniversalSearchPrefsDb::UniversalSearchPrefsDb()
 {
 	s_uspDb_instance = this;
 	m_uspDb = 0;
+	m_generation = 0;
+	m_inTransaction = false;
+	m_writerDb = 0;
+	m_writerThread = 0;
+	m_writeQueue = 0;
+	m_barrierMutex = 0;
+	m_barrierCond = 0;
+	m_preferencesJsonValid = false;
+	
+	//Start on the partition of the last locale, the locale itself comes later from the bus.
+	gchar* lastLocale = NULL;
+	if (g_file_get_contents(usp_localeFile, &lastLocale, NULL, NULL)) {
+		m_locale = g_strstrip(lastLocale);
+		g_free(lastLocale);
+	}
+	m_dbPath = m_locale.empty() ? usp_dbFile : partitionPath(m_locale);
+	
 	openUniversalSearchPrefsDb();
 }
 
@@ -63,12 +219,17 @@ void UniversalSearchPrefsDb::openUniversalSearchPrefsDb()
 	gchar* prefDbDirPath = g_path_get_dirname(usp_dbFile);
 	g_mkdir_with_parents(prefDbDirPath, 0755);
 	
-	int ret = sqlite3_open(usp_dbFile, &m_uspDb);
+	int ret = sqlite3_open(m_dbPath.c_str(), &m_uspDb);
 	if (ret) {
 		g_warning("Failed to open Universal Search Prefs db");
 		return;
 	}
 	
+	//Readers are not blocked by the writer thread in WAL mode. The mode sticks to the file.
+	ret = sqlite3_exec(m_uspDb, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
+	if (ret)
+		luna_critical(s_logChannel, "Failed to switch to WAL mode: %s", sqlite3_errmsg(m_uspDb));
+	
 	//Creating SearchList table
 	ret = sqlite3_exec(m_uspDb,
 			"CREATE TABLE IF NOT EXISTS SearchList "
@@ -82,6 +243,7 @@ void UniversalSearchPrefsDb::openUniversalSearchPrefsDb()
 			" type TEXT, "
 			" enabled INTEGER, "
 			" version INTEGER, "
+			" position INTEGER, "
 			" PRIMARY KEY(id, category) );", NULL, NULL, NULL);
 	
 	ret = sqlite3_exec(m_uspDb,
@@ -97,13 +259,20 @@ void UniversalSearchPrefsDb::openUniversalSearchPrefsDb()
 			" displayFields TEXT,"
 			" batchQuery INTEGER,"
 			" enabled INTEGER, "
-			" version INTEGER );", NULL, NULL, NULL);
+			" version INTEGER, "
+			" position INTEGER );", NULL, NULL, NULL);
 			
 	ret = sqlite3_exec(m_uspDb,
 			"CREATE TABLE IF NOT EXISTS SearchPreference "
 			"(key TEXT NOT NULL ON CONFLICT FAIL UNIQUE ON CONFLICT REPLACE, "
 			" value TEXT);", NULL, NULL, NULL);
 	
+	//Hash of each app's universalSearch block as of the last listApps, empty if it has none.
+	ret = sqlite3_exec(m_uspDb,
+			"CREATE TABLE IF NOT EXISTS AppDescriptor "
+			"(appId TEXT PRIMARY KEY, "
+			" hash TEXT);", NULL, NULL, NULL);
+	
 	
 	if (ret) {
 		g_warning("Failed to create pref table");
@@ -112,6 +281,45 @@ void UniversalSearchPrefsDb::openUniversalSearchPrefsDb()
 		return;
 	}
 	
+	//Databases written before the order was persisted; their rows keep the rowid order until the next sync.
+	addMissingColumn("SearchList", "position", "INTEGER");
+	addMissingColumn("DBSearchList", "position", "INTEGER");
+	
+	m_readStatements.open(m_uspDb);
+	loadPreferences();
+	startWriter();
+}
+
+void UniversalSearchPrefsDb::addMissingColumn(const char* table, const char* column, const char* type)
+{
+	sqlite3_stmt* statement = 0;
+	char* queryStr = sqlite3_mprintf("PRAGMA table_info(%s)", table);
+	bool found = false;
+	
+	if (!queryStr)
+		return;
+	
+	if (sqlite3_prepare(m_uspDb, queryStr, -1, &statement, NULL) == SQLITE_OK) {
+		while (!found && sqlite3_step(statement) == SQLITE_ROW) {
+			const char* name = (const char*) sqlite3_column_text(statement, 1);
+			found = name && strcmp(name, column) == 0;
+		}
+		sqlite3_finalize(statement);
+	}
+	sqlite3_free(queryStr);
+	
+	if (found)
+		return;
+	
+	queryStr = sqlite3_mprintf("ALTER TABLE %s ADD COLUMN %s %s", table, column, type);
+	if (!queryStr)
+		return;
+	
+	if (sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL))
+		luna_critical(s_logChannel, "Failed to execute: %s (%s)", queryStr, sqlite3_errmsg(m_uspDb));
+	else
+		luna_log(s_logChannel, "Added %s.%s", table, column);
+	sqlite3_free(queryStr);
 }
 
 void UniversalSearchPrefsDb::closeUniversalSearchPrefsDb() 
@@ -119,332 +327,640 @@ void UniversalSearchPrefsDb::closeUniversalSearchPrefsDb()
 	if (!m_uspDb)
 		return;
 
+	stopWriter();
+	m_readStatements.close();
+	
 	(void) sqlite3_close(m_uspDb);
 	m_uspDb = 0;   
 }
 
+std::string UniversalSearchPrefsDb::partitionPath(const std::string& locale)
+{
+	std::string name = locale;
+	for (std::string::size_type i = 0; i < name.size(); i++) {
+		if (!g_ascii_isalnum(name[i]) && name[i] != '_' && name[i] != '-')
+			name[i] = '_';
+	}
+	
+	gchar* path = g_strdup_printf(usp_partitionFileFormat, name.c_str());
+	std::string result = path;
+	g_free(path);
+	
+	return result;
+}
 
-bool UniversalSearchPrefsDb::addSearchRecord(const char* id, const char* category, const char* displayName, const char* iconFilePath, const char* url, const char* suggestURL, const char* launchParam, const char* type, int enabled, int version)
+/*
+ * Every locale keeps its lists and preferences in a database file of its own, so
+ * switching back to a locale finds its state as it was left. Waits for the writer
+ * to drain; locale changes are rare enough for that.
+ *
+ * The first locale adopts the unpartitioned database by renaming it. No other
+ * connection may have it open then (see StartupPipeline::advance()), and its WAL is
+ * checkpointed first so the renamed file has every committed page.
+ *
+ * Returns true if the database content changed, i.e. the lists have to be read again.
+ */
+bool UniversalSearchPrefsDb::setLocale(const std::string& locale)
 {
-	if (!m_uspDb) {
-		luna_critical(s_logChannel, "Invalid DB handler");
+	STATS_COUNT("sqlite.setLocale");
+	std::string path = partitionPath(locale);
+	bool migrate;
+	bool adopted = false;
+	
+	if (locale == m_locale)
 		return false;
+	
+	//The unpartitioned database belongs to the first locale, unless that one already has a partition.
+	migrate = m_locale.empty() && !g_file_test(path.c_str(), G_FILE_TEST_EXISTS);
+	if (migrate)
+		checkpoint();
+	
+	closeUniversalSearchPrefsDb();
+	
+	if (migrate) {
+		if (rename(usp_dbFile, path.c_str()) == 0) {
+			adopted = true;
+			moveWal(usp_dbFile, path);
+		}
+		else
+			luna_critical(s_logChannel, "Failed to move %s to %s", usp_dbFile, path.c_str());
 	}
+	
+	luna_critical(s_logChannel, "Locale %s uses %s%s", locale.c_str(), path.c_str(), adopted ? " (migrated)" : "");
+	
+	m_locale = locale;
+	m_dbPath = path;
+	if (!g_file_set_contents(usp_localeFile, locale.c_str(), -1, NULL))
+		luna_critical(s_logChannel, "Failed to write %s", usp_localeFile);
+	
+	openUniversalSearchPrefsDb();
+	m_generation++;
+	
+	return !adopted;
+}
 
-	gchar* queryStr = sqlite3_mprintf("INSERT OR REPLACE INTO SearchList "
-									  "VALUES (%Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %d, %d)",
-									  id, category, displayName, iconFilePath, url, suggestURL, launchParam, type, enabled, version);
-	if (!queryStr)
+/*
+ * Moves every committed page of the WAL into the database file and truncates the WAL,
+ * once the writer has drained. Returns false if a reader kept it from completing.
+ */
+bool UniversalSearchPrefsDb::checkpoint()
+{
+	int logFrames = 0;
+	int checkpointedFrames = 0;
+	int ret;
+	
+	if (!m_uspDb)
 		return false;
 	
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
-
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute query: %s", queryStr);
-		sqlite3_free(queryStr);
+	flush();
+	ret = sqlite3_wal_checkpoint_v2(m_uspDb, NULL, SQLITE_CHECKPOINT_TRUNCATE, &logFrames, &checkpointedFrames);
+	if (ret != SQLITE_OK || checkpointedFrames < logFrames) {
+		luna_critical(s_logChannel, "Incomplete checkpoint of %s: %s (%d of %d frames)", m_dbPath.c_str(),
+				sqlite3_errmsg(m_uspDb), checkpointedFrames, logFrames);
 		return false;
 	}
+	
+	return true;
+}
 
-	sqlite3_free(queryStr);
+/*
+ * A WAL left after the last connection closed (the checkpoint did not complete) has to
+ * stay with its database file to be replayed; the shared memory index is rebuilt.
+ */
+void UniversalSearchPrefsDb::moveWal(const std::string& from, const std::string& to)
+{
+	std::string wal = from + "-wal";
+	
+	if (g_file_test(wal.c_str(), G_FILE_TEST_EXISTS) && rename(wal.c_str(), (to + "-wal").c_str()) != 0)
+		luna_critical(s_logChannel, "Failed to move %s", wal.c_str());
+	
+	unlink((from + "-shm").c_str());
+}
 
-	return true;    
+void UniversalSearchPrefsDb::startWriter()
+{
+	const char* synchronous = s_defaultSynchronousLevel;
+	const char* env = getenv("UNIVERSALSEARCH_DB_SYNCHRONOUS");
+	gchar* pragma = 0;
+	
+	if (env && *env) {
+		unsigned int i;
+		for (i = 0; i < G_N_ELEMENTS(s_synchronousLevels); i++) {
+			if (strcasecmp(env, s_synchronousLevels[i]) == 0)
+				break;
+		}
+		if (i < G_N_ELEMENTS(s_synchronousLevels))
+			synchronous = s_synchronousLevels[i];
+		else
+			luna_critical(s_logChannel, "Ignoring invalid UNIVERSALSEARCH_DB_SYNCHRONOUS=%s", env);
+	}
+	
+	m_barrierMutex = g_mutex_new();
+	m_barrierCond = g_cond_new();
+	m_writeQueue = g_async_queue_new();
+	
+	if (sqlite3_threadsafe()) {
+		if (sqlite3_open(m_dbPath.c_str(), &m_writerDb) == SQLITE_OK) {
+			sqlite3_busy_timeout(m_writerDb, s_writerBusyTimeoutMs);
+		}
+		else {
+			luna_critical(s_logChannel, "Failed to open writer connection: %s", sqlite3_errmsg(m_writerDb));
+			sqlite3_close(m_writerDb);
+			m_writerDb = 0;
+		}
+	}
 	
+	if (!m_writerDb) {
+		//Without a second connection the writes run on the main one, like they used to.
+		luna_critical(s_logChannel, "No writer thread, writing synchronously");
+		m_writerDb = m_uspDb;
+	}
+	
+	pragma = sqlite3_mprintf("PRAGMA synchronous=%s", synchronous);
+	if (pragma) {
+		if (sqlite3_exec(m_writerDb, pragma, NULL, NULL, NULL))
+			luna_critical(s_logChannel, "Failed to execute: %s", pragma);
+		sqlite3_free(pragma);
+	}
+	
+	m_writerStatements.open(m_writerDb);
+	if (m_writerDb != m_uspDb) {
+		m_writerThread = g_thread_create(writerThread, this, TRUE, NULL);
+		if (!m_writerThread) {
+			luna_critical(s_logChannel, "Failed to start writer thread, writing synchronously");
+			m_writerStatements.close();
+			sqlite3_close(m_writerDb);
+			m_writerDb = m_uspDb;
+			m_writerStatements.open(m_writerDb);
+		}
+	}
 }
 
-bool UniversalSearchPrefsDb::updateSearchRecord(const char* id, const char* category, int enabled) 
+void UniversalSearchPrefsDb::stopWriter()
 {
-	if (!m_uspDb) {
-		luna_critical(s_logChannel, "Invalid DB handler");
-		return false;
+	if (m_writerThread) {
+		//Everything queued before the quit is still written.
+		WriteOp* op = new WriteOp(WriteOp::Quit);
+		pushWriteOp(op);
+		
+		g_thread_join(m_writerThread);
+		m_writerThread = 0;
+		m_writerStatements.close();
+		sqlite3_close(m_writerDb);
 	}
+	m_writerStatements.close();
+	m_writerDb = 0;
 	
-	gchar* queryStr = sqlite3_mprintf("UPDATE OR REPLACE SearchList "
-									  "SET ENABLED = %d "
-									  "WHERE ID = %Q AND CATEGORY = %Q",
-									  enabled, id, category);
-	if (!queryStr)
-		return false;
+	m_transactionWrites.clear();
 	
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
+	if (m_writeQueue) {
+		g_async_queue_unref(m_writeQueue);
+		m_writeQueue = 0;
+	}
+	if (m_barrierCond) {
+		g_cond_free(m_barrierCond);
+		m_barrierCond = 0;
+	}
+	if (m_barrierMutex) {
+		g_mutex_free(m_barrierMutex);
+		m_barrierMutex = 0;
+	}
+}
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute update query: %s", queryStr);
-		sqlite3_free(queryStr);
-		return false;
+/*
+ * Inside a transaction the write is held back until commit, otherwise it is queued
+ * right away.
+ */
+bool UniversalSearchPrefsDb::queueWrite(const Write& write)
+{
+	if (m_inTransaction) {
+		m_transactionWrites.push_back(write);
+		return true;
 	}
+	
+	WriteOp* op = new WriteOp(WriteOp::Statements);
+	op->writes.push_back(write);
+	pushWriteOp(op);
+	
+	return true;
+}
 
-	sqlite3_free(queryStr);
+void UniversalSearchPrefsDb::pushWriteOp(WriteOp* op)
+{
+	if (m_writerThread) {
+		g_async_queue_push(m_writeQueue, op);
+		return;
+	}
+	
+	std::vector<WriteOp*> ops(1, op);
+	executeWriteOps(ops);
+}
 
-	return true;    
+void UniversalSearchPrefsDb::freeWriteOp(WriteOp* op)
+{
+	delete op;
 }
 
-bool UniversalSearchPrefsDb::updateAllSearchRecord(const char* category, int enabled)
+gpointer UniversalSearchPrefsDb::writerThread(gpointer data)
 {
-	if (!m_uspDb) {
-		luna_critical(s_logChannel, "Invalid DB handler");
-		return false;
+	UniversalSearchPrefsDb* db = (UniversalSearchPrefsDb*) data;
+	std::vector<WriteOp*> ops;
+	WriteOp* op = 0;
+	bool quit = false;
+	
+	while (!quit) {
+		ops.clear();
+		ops.push_back((WriteOp*) g_async_queue_pop(db->m_writeQueue));
+		
+		//Whatever queued up in the meantime goes into the same transaction.
+		while (ops.size() < s_maxOpsPerCommit && (op = (WriteOp*) g_async_queue_try_pop(db->m_writeQueue)))
+			ops.push_back(op);
+		
+		quit = db->executeWriteOps(ops);
 	}
+	
+	return NULL;
+}
 
-	gchar* queryStr = sqlite3_mprintf("UPDATE OR REPLACE SearchList "
-									  "SET ENABLED = %d "
-									  "WHERE CATEGORY = %Q",
-									  enabled, category);
-	if (!queryStr)
-		return false;
+/*
+ * Runs on the writer thread (or inline without one). Each unit gets a savepoint so a
+ * failing unit is undone on its own without losing the others in the transaction.
+ * Barriers are released once the transaction is over; every other op is freed here.
+ * Returns true when a quit op was seen.
+ */
+bool UniversalSearchPrefsDb::executeWriteOps(const std::vector<WriteOp*>& ops)
+{
+	sqlite3* db = m_writerDb;
+	StatementCache& statements = m_writerStatements;
+	bool quit = false;
+	int ret;
+	
+	ret = statements.execute(Write(BeginTransaction));
+	if (ret)
+		luna_critical(s_logChannel, "Failed to begin transaction: %s", sqlite3_errmsg(db));
+	
+	for (unsigned int i = 0; i < ops.size(); i++) {
+		WriteOp* op = ops[i];
+		if (op->type == WriteOp::Quit)
+			quit = true;
+		if (op->type != WriteOp::Statements)
+			continue;
+		
+		statements.execute(Write(Savepoint));
+		for (unsigned int j = 0; j < op->writes.size(); j++) {
+			if (statements.execute(op->writes[j])) {
+				luna_critical(s_logChannel, "Failed to execute query: %s (%s)", s_statementSql[op->writes[j].statement], sqlite3_errmsg(db));
+				statements.execute(Write(RollbackToSavepoint));
+				break;
+			}
+		}
+		statements.execute(Write(ReleaseSavepoint));
+	}
+	
+	if (!ret && statements.execute(Write(CommitTransaction))) {
+		luna_critical(s_logChannel, "Failed to commit transaction: %s", sqlite3_errmsg(db));
+		statements.execute(Write(RollbackTransaction));
+	}
+	
+	g_mutex_lock(m_barrierMutex);
+	for (unsigned int i = 0; i < ops.size(); i++) {
+		if (ops[i]->type == WriteOp::Barrier && !ops[i]->callback)
+			ops[i]->done = true;
+	}
+	g_cond_broadcast(m_barrierCond);
+	g_mutex_unlock(m_barrierMutex);
+	
+	//Asynchronous barriers report back through the main loop.
+	for (unsigned int i = 0; i < ops.size(); i++) {
+		if (ops[i]->type == WriteOp::Barrier && ops[i]->callback)
+			g_idle_add(ops[i]->callback, ops[i]->callbackData);
+		if (ops[i]->type != WriteOp::Barrier || ops[i]->callback)
+			freeWriteOp(ops[i]);
+	}
+	
+	return quit;
+}
 
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
+void UniversalSearchPrefsDb::flush()
+{
+	STATS_SCOPE("sqlite.flush");
+	if (!m_writerThread)
+		return;
+	
+	WriteOp* op = new WriteOp(WriteOp::Barrier);
+	pushWriteOp(op);
+	
+	g_mutex_lock(m_barrierMutex);
+	while (!op->done)
+		g_cond_wait(m_barrierCond, m_barrierMutex);
+	g_mutex_unlock(m_barrierMutex);
+	
+	freeWriteOp(op);
+}
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute update query: %s", queryStr);
-		sqlite3_free(queryStr);
-		return false;
+void UniversalSearchPrefsDb::flushAsync(GSourceFunc callback, gpointer data)
+{
+	if (!m_writerThread) {
+		g_idle_add(callback, data);
+		return;
 	}
+	
+	WriteOp* op = new WriteOp(WriteOp::Barrier);
+	op->callback = callback;
+	op->callbackData = data;
+	pushWriteOp(op);
+}
 
-	sqlite3_free(queryStr);
+/*
+ * Reads the SearchPreference table once, on open. From then on the map is written
+ * through by setSearchPreference and is what every preference read is served from.
+ */
+void UniversalSearchPrefsDb::loadPreferences()
+{
+	STATS_SCOPE("sqlite.loadPreferences");
+	sqlite3_stmt* statement = m_readStatements.get(SelectAllPreferences);
+	
+	m_preferences.clear();
+	preferencesChanged();
+	
+	if (!statement)
+		return;
+	
+	while (sqlite3_step(statement) == SQLITE_ROW) {
+		const char* key = (const char*) sqlite3_column_text(statement, 0);
+		const char* val = (const char*) sqlite3_column_text(statement, 1);
+		if (key)
+			m_preferences[key] = val ? val : "";
+	}
+	
+	sqlite3_reset(statement);
+}
 
-	return true;
+void UniversalSearchPrefsDb::preferencesChanged()
+{
+	m_preferencesJsonValid = false;
+	m_preferencesJson.clear();
 }
 
-bool UniversalSearchPrefsDb::removeSearchRecord(const char* id, const char* category) 
+struct UniversalSearchPrefsDb::FieldBinder {
+	FieldBinder(Write& write) : write(write) {}
+	
+	template <class Reply>
+	void operator()(const char*, const std::string& value, Reply) { write.text(value.c_str()); }
+	template <class Reply>
+	void operator()(const char*, bool value, Reply) { write.number(value ? 1 : 0); }
+	template <class Reply>
+	void operator()(const char*, int value, Reply) { write.number(value); }
+	
+	Write& write;
+};
+
+bool UniversalSearchPrefsDb::addRecord(const SearchRecord& record)
 {
+	STATS_COUNT("sqlite.addSearchRecord");
 	if (!m_uspDb) {
 		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
+
+	Write write(InsertSearchRecord);
+	FieldBinder binder(write);
+	write.text(record.id.c_str()).text(record.category.c_str());
+	SearchProviderFields::visit(record, binder);
+	write.number(record.position);
 	
-	gchar* queryStr = sqlite3_mprintf("DELETE FROM SearchList "
-									  "WHERE ID = %Q AND CATEGORY = %Q",
-									  id, category);
-	if (!queryStr)
-		return false;
-	
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
+	return queueWrite(write);
+}
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute delete query: %s", queryStr);
-		sqlite3_free(queryStr);
+bool UniversalSearchPrefsDb::addRecord(const DBSearchRecord& record)
+{
+	STATS_COUNT("sqlite.addDBSearchRecord");
+	if (!m_uspDb) {
+		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
 
-	sqlite3_free(queryStr);
-
-	return true;    
+	Write write(InsertDBSearchRecord);
+	FieldBinder binder(write);
+	write.text(record.id.c_str()).text(record.category.c_str());
+	DBSearchItemFields::visit(record, binder);
+	write.number(record.position);
+	
+	return queueWrite(write);
 }
 
-bool UniversalSearchPrefsDb::addDBSearchRecord(const char* id, const char* category, const char* displayName, const char* iconFilePath, const char* url, const char* launchParam, const char* launchParamDbField, const char* dbQuery, const char* displayFields, int batchQuery, int enabled, int version)
+bool UniversalSearchPrefsDb::updateRecordEnabled(const char* id, const char* category, bool enabled) 
 {
+	STATS_COUNT("sqlite.updateRecordEnabled");
 	if (!m_uspDb) {
 		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
-
-	gchar* queryStr = sqlite3_mprintf("INSERT OR REPLACE INTO DBSearchList "
-									  "VALUES (%Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %d, %d, %d)",
-									  id, category, displayName, iconFilePath, url, launchParam, launchParamDbField, dbQuery, displayFields, batchQuery, enabled, version);
-	if (!queryStr)
-		return false;
 	
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
+	if (strcmp(category, "dbsearch") == 0)
+		return queueWrite(Write(UpdateDBSearchEnabled).number(enabled ? 1 : 0).text(id));
+	return queueWrite(Write(UpdateSearchEnabled).number(enabled ? 1 : 0).text(id).text(category));
+}
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute query: %s", queryStr);
-		sqlite3_free(queryStr);
+bool UniversalSearchPrefsDb::updateAllRecordsEnabled(const char* category, bool enabled)
+{
+	STATS_COUNT("sqlite.updateAllRecordsEnabled");
+	if (!m_uspDb) {
+		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
 
-	sqlite3_free(queryStr);
-
-	return true;    
-	
+	if (strcmp(category, "dbsearch") == 0)
+		return queueWrite(Write(UpdateAllDBSearchEnabled).number(enabled ? 1 : 0).text(category));
+	return queueWrite(Write(UpdateAllSearchEnabled).number(enabled ? 1 : 0).text(category));
 }
 
-bool UniversalSearchPrefsDb::updateDBSearchRecord(const char* id, int enabled) 
+bool UniversalSearchPrefsDb::removeRecord(const char* id, const char* category) 
 {
+	STATS_COUNT("sqlite.removeRecord");
 	if (!m_uspDb) {
 		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
 	
-	gchar* queryStr = sqlite3_mprintf("UPDATE OR REPLACE DBSearchList "
-									  "SET ENABLED = %d "
-									  "WHERE ID = %Q",
-									  enabled, id);
-	if (!queryStr)
-		return false;
-	
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
+	if (strcmp(category, "dbsearch") == 0)
+		return queueWrite(Write(DeleteDBSearchRecord).text(id));
+	return queueWrite(Write(DeleteSearchRecord).text(id).text(category));
+}
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute update query: %s", queryStr);
-		sqlite3_free(queryStr);
+bool UniversalSearchPrefsDb::updateRecordPosition(const char* id, const char* category, int position)
+{
+	STATS_COUNT("sqlite.updateRecordPosition");
+	if (!m_uspDb) {
+		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
 
-	sqlite3_free(queryStr);
-
-	return true;    
+	if (strcmp(category, "dbsearch") == 0)
+		return queueWrite(Write(UpdateDBSearchPosition).number(position).text(id));
+	return queueWrite(Write(UpdateSearchPosition).number(position).text(id).text(category));
 }
 
-bool UniversalSearchPrefsDb::updateAllDBSearchRecord(const char* category, int enabled)
+bool UniversalSearchPrefsDb::setAppDescriptorHash(const char* appId, const char* hash)
 {
+	STATS_COUNT("sqlite.setAppDescriptorHash");
 	if (!m_uspDb) {
 		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
 
-	gchar* queryStr = sqlite3_mprintf("UPDATE OR REPLACE DBSearchList "
-									  "SET ENABLED = %d "
-									  "WHERE CATEGORY = %Q",
-									  enabled, category);
-	if (!queryStr)
-		return false;
-
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
+	return queueWrite(Write(InsertAppDescriptor).text(appId).text(hash));
+}
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute update query: %s", queryStr);
-		sqlite3_free(queryStr);
+bool UniversalSearchPrefsDb::removeAppDescriptorHash(const char* appId)
+{
+	STATS_COUNT("sqlite.removeAppDescriptorHash");
+	if (!m_uspDb) {
+		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
 
-	sqlite3_free(queryStr);
-
-	return true;
+	return queueWrite(Write(DeleteAppDescriptor).text(appId));
 }
 
-bool UniversalSearchPrefsDb::removeDBSearchRecord(const char* id) 
+/*
+ * Only read once per partition, before any hash is written to it, so the rows still
+ * queued for the writer do not matter.
+ */
+bool UniversalSearchPrefsDb::readAppDescriptorHashes(std::map<std::string, std::string>& hashes)
 {
+	STATS_COUNT("sqlite.readAppDescriptorHashes");
+	sqlite3_stmt* statement = 0;
+	int ret;
+
+	hashes.clear();
 	if (!m_uspDb) {
 		luna_critical(s_logChannel, "Invalid DB handler");
 		return false;
 	}
-	
-	gchar* queryStr = sqlite3_mprintf("DELETE FROM DBSearchList "
-									  "WHERE ID = %Q",
-									   id);
-	if (!queryStr)
-		return false;
-	
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
 
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to execute delete query: %s", queryStr);
-		sqlite3_free(queryStr);
+	statement = m_readStatements.get(SelectAppDescriptors);
+	if (!statement)
 		return false;
+
+	while ((ret = sqlite3_step(statement)) == SQLITE_ROW) {
+		const char* appId = (const char*) sqlite3_column_text(statement, 0);
+		const char* hash = (const char*) sqlite3_column_text(statement, 1);
+		if (appId)
+			hashes[appId] = hash ? hash : "";
 	}
 
-	sqlite3_free(queryStr);
+	sqlite3_reset(statement);
+	return ret == SQLITE_DONE;
+}
 
-	return true;    
+void UniversalSearchPrefsDb::RecordBuffer::replay(RecordVisitor& visitor) const
+{
+	for (size_t i = 0; i < m_searchRecords.size(); i++)
+		visitor.visit(m_searchRecords[i]);
+	for (size_t i = 0; i < m_dbSearchRecords.size(); i++)
+		visitor.visit(m_dbSearchRecords[i]);
+}
+
+//Reads the table fields from consecutive columns. NULL text reads as an empty string;
+//assigning keeps the capacity of the reused record.
+struct ColumnReader {
+	ColumnReader(sqlite3_stmt* statement, int column) : statement(statement), column(column) {}
+	
+	template <class Reply>
+	void operator()(const char*, std::string& value, Reply)
+	{
+		const char* text = (const char*) sqlite3_column_text(statement, column);
+		if (text)
+			value.assign(text, sqlite3_column_bytes(statement, column));
+		else
+			value.clear();
+		column++;
+	}
+	
+	template <class Reply>
+	void operator()(const char*, bool& value, Reply) { value = sqlite3_column_int(statement, column++) == 1; }
+	template <class Reply>
+	void operator()(const char*, int& value, Reply) { value = sqlite3_column_int(statement, column++); }
+	
+	sqlite3_stmt* statement;
+	int column;
+};
+
+//id, category, the table fields, position.
+template <class Fields, class Record>
+static void readRecord(sqlite3_stmt* statement, Record& record)
+{
+	ColumnReader reader(statement, 0);
+	
+	reader(NULL, record.id, ReplyValue());
+	reader(NULL, record.category, ReplyValue());
+	Fields::visit(record, reader);
+	record.hasPosition = sqlite3_column_type(statement, reader.column) != SQLITE_NULL;
+	record.position = sqlite3_column_int(statement, reader.column);
 }
 
-int UniversalSearchPrefsDb::readPrefDb(json_object* searchListJsonObj) 
+int UniversalSearchPrefsDb::readPrefDb(RecordVisitor& visitor) 
 {
+	if (!m_uspDb)
+		return 0;
+	
+	return readPrefDb(visitor, m_dbPath);
+}
+
+/*
+ * Called from the startup pool, so it reads through a connection of its own instead
+ * of sharing m_uspDb with the main thread, and records no statistics.
+ */
+int UniversalSearchPrefsDb::readPrefDb(RecordVisitor& visitor, const std::string& dbPath) 
+{
+	sqlite3* db = 0;
 	sqlite3_stmt* statement = 0;
 	const char* tail = 0;
 	int ret = 0;
 	int numOfRows = 0;
-	char* queryStr = 0;
-	
-	if (!m_uspDb)
-		return numOfRows;
+	const char* queryStr = 0;
+	SearchRecord searchRecord;
+	DBSearchRecord dbSearchRecord;
 
-	queryStr = (char *) "SELECT * FROM SEARCHLIST";
-	
-	ret = sqlite3_prepare(m_uspDb, queryStr, -1, &statement, &tail);
+	ret = sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, NULL);
 	if (ret) {
-		luna_critical (s_logChannel, "Failed to prepare sql statement: %s", queryStr);
+		luna_critical (s_logChannel, "Failed to open read connection: %s", sqlite3_errmsg(db));
 		goto Done;
 	}
 
-	ret = sqlite3_step(statement);
+	//Rows without a position (older databases) sort first, in insertion order.
+	queryStr = "SELECT id, category, " SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_COLUMN)
+			"position FROM SearchList ORDER BY position, rowid";
 	
-	while (ret == SQLITE_ROW) {
-		json_object* root = json_object_new_object();
-		char* res[8];
-		bool enabled;
-		int version;
-		
-		res[0] = (char *)sqlite3_column_text(statement, 0);
-		res[1] = (char *)sqlite3_column_text(statement, 1);
-		res[2] = (char *)sqlite3_column_text(statement, 2);
-		res[3] = (char *)sqlite3_column_text(statement, 3);
-		res[4] = (char *)sqlite3_column_text(statement, 4);
-		res[5] = (char *)sqlite3_column_text(statement, 5);
-		res[6] = (char *)sqlite3_column_text(statement, 6);
-		res[7] = (char *)sqlite3_column_text(statement, 7);
-		
-		json_object_object_add(root, "id", json_object_new_string(res[0]));
-		json_object_object_add(root, "category", json_object_new_string(res[1]));
-		json_object_object_add(root, "displayName", json_object_new_string(res[2]));
-		json_object_object_add(root, "iconFilePath", json_object_new_string(res[3]));
-		json_object_object_add(root, "url", json_object_new_string(res[4]));
-		json_object_object_add(root, "suggestURL", json_object_new_string(res[5]));
-		json_object_object_add(root, "launchParam", json_object_new_string(res[6]));
-		json_object_object_add(root, "type", json_object_new_string(res[7]));
-		 
-		enabled = (((int) sqlite3_column_int(statement, 8)) == 1) ? true : false;
-		
-		
-		json_object_object_add(root, "enabled", json_object_new_boolean(enabled));
-		
-		version = (int) sqlite3_column_int(statement, 9);
-		json_object_object_add(root, "version", json_object_new_int(version));
+	ret = sqlite3_prepare_v2(db, queryStr, -1, &statement, &tail);
+	if (ret) {
+		luna_critical (s_logChannel, "Failed to prepare sql statement: %s", queryStr);
+		goto Done;
+	}
 
-		json_object_array_add(searchListJsonObj, json_object_get(root));
+	while (sqlite3_step(statement) == SQLITE_ROW) {
+		readRecord<SearchProviderFields>(statement, searchRecord);
+		visitor.visit(searchRecord);
 		numOfRows++;
-		ret = sqlite3_step(statement);
 	}
 	
-	queryStr = (char *) "SELECT * FROM DBSEARCHLIST";
+	sqlite3_finalize(statement);
+	statement = 0;
 	
-	ret = sqlite3_prepare(m_uspDb, queryStr, -1, &statement, &tail);
+	queryStr = "SELECT id, category, " DB_SEARCH_ITEM_FIELDS(PROVIDER_FIELD_COLUMN)
+			"position FROM DBSearchList ORDER BY position, rowid";
+	
+	ret = sqlite3_prepare_v2(db, queryStr, -1, &statement, &tail);
 	if (ret) {
 		luna_critical (s_logChannel, "Failed to prepare sql statement: %s", queryStr);
 		goto Done;
 	}
 
-	ret = sqlite3_step(statement);
-	
-	while (ret == SQLITE_ROW) {
-		json_object* root = json_object_new_object();
-		char* res[10];
-		bool enabled, batchQuery;
-		int version;
-		
-		res[0] = (char *)sqlite3_column_text(statement, 0);
-		res[1] = (char *)sqlite3_column_text(statement, 1);
-		res[2] = (char *)sqlite3_column_text(statement, 2);
-		res[3] = (char *)sqlite3_column_text(statement, 3);
-		res[4] = (char *)sqlite3_column_text(statement, 4);
-		res[5] = (char *)sqlite3_column_text(statement, 5);
-		res[6] = (char *)sqlite3_column_text(statement, 6);
-		res[7] = (char *)sqlite3_column_text(statement, 7);
-		res[8] = (char *)sqlite3_column_text(statement, 8);
-		res[9] = (char *)sqlite3_column_text(statement, 9);
-		
-		json_object_object_add(root, "id", json_object_new_string(res[0]));
-		json_object_object_add(root, "category", json_object_new_string(res[1]));
-		json_object_object_add(root, "displayName", json_object_new_string(res[2]));
-		json_object_object_add(root, "iconFilePath", json_object_new_string(res[3]));
-		json_object_object_add(root, "url", json_object_new_string(res[4]));
-		json_object_object_add(root, "launchParam", json_object_new_string(res[5]));
-		json_object_object_add(root, "launchParamDbField", json_object_new_string(res[6]));
-		json_object_object_add(root, "dbQuery", json_object_new_string(res[7]));
-		json_object_object_add(root, "displayFields", json_object_new_string(res[8]));
-		
-		batchQuery = (((int) sqlite3_column_int(statement, 9)) == 1) ? true : false;
-		enabled = (((int) sqlite3_column_int(statement, 10)) == 1) ? true : false;
-		
-		json_object_object_add(root, "batchQuery", json_object_new_boolean(batchQuery));
-		json_object_object_add(root, "enabled", json_object_new_boolean(enabled));
-		
-		version = (int) sqlite3_column_int(statement, 9);
-		json_object_object_add(root, "version", json_object_new_int(version));
-
-		json_object_array_add(searchListJsonObj, json_object_get(root));
+	while (sqlite3_step(statement) == SQLITE_ROW) {
+		readRecord<DBSearchItemFields>(statement, dbSearchRecord);
+		visitor.visit(dbSearchRecord);
 		numOfRows++;
-		ret = sqlite3_step(statement);
 	}
 		
 	Done:
@@ -452,132 +968,93 @@ int UniversalSearchPrefsDb::readPrefDb(json_object* searchListJsonObj)
 	if (statement)
 		sqlite3_finalize(statement);
 
+	if (db)
+		sqlite3_close(db);
 
 	return numOfRows;   
 }
 
 std::string UniversalSearchPrefsDb::getSearchPreference(const std::string& key)
 {
-	sqlite3_stmt* statement = 0;
-	const char* tail = 0;
-	int ret = 0;
-	char * queryStr = 0;
-	
-	std::string result;
-
-	if (!m_uspDb)
-		return result;
+	STATS_COUNT("sqlite.getSearchPreference");
+	PreferenceMap::const_iterator it;
 
-	if (key.empty())
-		goto Done;
+	if (!m_uspDb || key.empty())
+		return std::string();
 	
-	queryStr = sqlite3_mprintf("SELECT value FROM SearchPreference WHERE key=%Q",key.c_str());
-
-	if (!queryStr)
-		goto Done;
+	it = m_preferences.find(key);
+	if (it == m_preferences.end())
+		return std::string();
 	
-	ret = sqlite3_prepare(m_uspDb, queryStr, -1, &statement, &tail);
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to prepare sql statement: %s", queryStr);
-		goto Done;
-	}
-
-	ret = sqlite3_step(statement);
-	if (ret == SQLITE_ROW) {
-		result = (char *)sqlite3_column_text(statement, 0);
-	}
-
-Done:
-
-	if (statement)
-		sqlite3_finalize(statement);
-
-	if (queryStr)
-		sqlite3_free(queryStr);
-	
-	return result;    
+	return it->second;
 }
 
 bool UniversalSearchPrefsDb::setSearchPreference(const std::string& key, const std::string& val)
 {
-	char * queryStr = 0;
+	STATS_COUNT("sqlite.setSearchPreference");
 	if (!m_uspDb)
 		return false;
 
 	if (key.empty())
 		return false;
 	
-	queryStr = sqlite3_mprintf("INSERT INTO SearchPreference "
-									  "VALUES (%Q, %Q)",
-									  key.c_str(), val.c_str());
+	//The map is written through, so an unchanged value needs no row.
+	PreferenceMap::iterator it = m_preferences.find(key);
+	if (it != m_preferences.end() && it->second == val)
+		return true;
 	
-	if (!queryStr)
-		return false;
-
-	int ret = sqlite3_exec(m_uspDb, queryStr, NULL, NULL, NULL);
-
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to prepare sql statement: %s", queryStr);
-		sqlite3_free(queryStr);
+	//Inside a transaction the row is held back until commitTransaction();
+	//a rollback drops it and restores the map.
+	if (!queueWrite(Write(InsertPreference).text(key.c_str()).text(val.c_str())))
 		return false;
-	}
 	
-	sqlite3_free(queryStr);
+	m_preferences[key] = val;
+	preferencesChanged();
+	m_generation++;
 	return true;    
 	
 }
 
 bool UniversalSearchPrefsDb::getAllSearchPreference(json_object* searchPrefObj)
 {
-	
-	sqlite3_stmt* statement = 0;
-	 json_object* root = json_object_new_object();
-	const char* tail = 0;
-	int ret = 0;
-	char * queryStr = 0;
-	bool result = false;
+	STATS_COUNT("sqlite.getAllSearchPreference");
+	json_object* root = NULL;
 
 	if (!m_uspDb)
-		goto Done;
-	
-	queryStr = (char *)"SELECT key,value FROM SearchPreference";
-	
-	ret = sqlite3_prepare(m_uspDb, queryStr, -1, &statement, &tail);
+		return false;
 	
-	if (ret) {
-		luna_critical (s_logChannel, "Failed to prepare sql statement: %s", queryStr);
-		goto Done;
+	root = json_object_new_object();
+	for (PreferenceMap::const_iterator it = m_preferences.begin(); it != m_preferences.end(); ++it) {
+		if (it->first != "databaseversion")
+			json_object_object_add(root, it->first.c_str(), json_object_new_string(it->second.c_str()));
 	}
+	json_object_object_add(searchPrefObj, (char*)"SearchPreference", root);
+	
+	return true;    
+}
 
-	ret = sqlite3_step(statement);
-
-	while (ret == SQLITE_ROW) {
-	   
-		std::string key;
-		std::string val;
-		
-		key = (char*) sqlite3_column_text(statement, 0);
-		val = (char*) sqlite3_column_text(statement, 1);
-
-		if(key == "databaseversion") {
-			ret = sqlite3_step(statement);
-			continue;
-		}
-		json_object_object_add(root, key.c_str(), json_object_new_string(val.c_str()));
-		ret = sqlite3_step(statement);
-	}
-	json_object_object_add(searchPrefObj, (char*)"SearchPreference", json_object_get(root));
-	result = true;
-
-Done:
-
-	if (statement)
-		sqlite3_finalize(statement);
+/*
+ * The reply of getAllSearchPreference and of its subscriptions only changes with a
+ * preference, so it is serialized once per change instead of once per call.
+ */
+const std::string& UniversalSearchPrefsDb::getAllSearchPreferenceJson()
+{
+	STATS_COUNT("sqlite.getAllSearchPreferenceJson");
+	JsonWriter writer;
 	
-	if(root && !is_error(root))
-		json_object_put(root);
+	if (m_preferencesJsonValid)
+		return m_preferencesJson;
 	
-	return result;    
+	writer.beginObject();
+	for (PreferenceMap::const_iterator it = m_preferences.begin(); it != m_preferences.end(); ++it) {
+		if (it->first != "databaseversion")
+			writer.key(it->first.c_str()).value(it->second);
+	}
+	writer.endObject();
+	m_preferencesJson = writer.str();
+	m_preferencesJsonValid = true;
+	
+	return m_preferencesJson;
 }
 
 bool UniversalSearchPrefsDb::syncSearchPreferenceDb(const char* jsonStr) 
@@ -633,8 +1110,70 @@ bool UniversalSearchPrefsDb::syncSearchPreferenceDb(const char* jsonStr)
 	return true;
 }
 
+bool UniversalSearchPrefsDb::beginTransaction()
+{
+	STATS_COUNT("sqlite.beginTransaction");
+	if (!m_uspDb) {
+		luna_critical(s_logChannel, "Invalid DB handler");
+		return false;
+	}
+	
+	if (m_inTransaction) {
+		luna_critical(s_logChannel, "Transaction already in progress");
+		return false;
+	}
+	
+	m_inTransaction = true;
+	m_transactionPreferences = m_preferences;
+	return true;
+}
+
+bool UniversalSearchPrefsDb::commitTransaction()
+{
+	STATS_COUNT("sqlite.commitTransaction");
+	if (!m_inTransaction)
+		return false;
+	
+	m_inTransaction = false;
+	m_transactionPreferences.clear();
+	
+	if (!m_transactionWrites.empty()) {
+		WriteOp* op = new WriteOp(WriteOp::Statements);
+		op->writes.swap(m_transactionWrites);
+		pushWriteOp(op);
+	}
+	
+	return true;
+}
+
+void UniversalSearchPrefsDb::rollbackTransaction()
+{
+	STATS_COUNT("sqlite.rollbackTransaction");
+	if (!m_inTransaction)
+		return;
+	
+	//Nothing has been queued yet, dropping the statements is enough.
+	m_transactionWrites.clear();
+	m_preferences.swap(m_transactionPreferences);
+	m_transactionPreferences.clear();
+	preferencesChanged();
+	
+	m_inTransaction = false;
+	//Preferences written in the transaction are gone again.
+	m_generation++;
+}
+
 bool UniversalSearchPrefsDb::purgeDatabase() {
+	STATS_COUNT("sqlite.purgeDatabase");
 	
+	if (!m_uspDb)
+		return false;
+	
+	//Let the writer drain its queue before the tables go away.
+	stopWriter();
+	m_readStatements.close();
+	m_preferences.clear();
+	preferencesChanged();
 	
 	int ret = sqlite3_exec(m_uspDb, "DROP TABLE SearchList", NULL, NULL, NULL);
 	
@@ -643,8 +1182,7 @@ bool UniversalSearchPrefsDb::purgeDatabase() {
 	ret = sqlite3_exec(m_uspDb, "DROP TABLE SearchPreference", NULL, NULL, NULL);
 	
 	closeUniversalSearchPrefsDb();
+	m_generation++;
 	
 	return true;
 }
-
-
@@ -23,6 +23,10 @@
 #include <sys/stat.h>
 #include "Logging.h"
 #include "OpenSearchHandler.h"
+#include "ServiceStats.h"
+#include "StringPool.h"
+#include "BusCapture.h"
+#include "JsonWriter.h"
 
 #define VERSION	"1.0"
 #define MAXOPENSEARCHES 50
@@ -39,6 +43,7 @@ static bool cbUpdateSearchItem(LSHandle* lshandle, LSMessage *message, void *use
 static bool cbAddSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data);
 static bool cbRemoveSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data);
 static bool cbReorderSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data);
+static bool cbApplySearchItemChanges(LSHandle* lshandle, LSMessage *message, void *user_data);
 //static bool cbGetSearchServiceList(LSHandle* lshandle, LSMessage *message, void *user_data);
 //static bool cbAddSearchService(LSHandle* lshandle, LSMessage *message, void *user_data);
 //static bool cbUpdateSearchService(LSHandle* lshandle, LSMessage *message, void *user_data);
@@ -51,6 +56,7 @@ static bool cbGetOptionalSearchList(LSHandle* lshandle, LSMessage *message, void
 static bool cbClearOptionalSearchList(LSHandle* lshandle, LSMessage *message, void *user_data);
 static bool cbRemoveOptionalSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data);
 static bool cbUpdateAllSearchItems(LSHandle* lshandle, LSMessage *message, void *user_data);
+static bool cbGetStats(LSHandle* lshandle, LSMessage *message, void *user_data);
 
 
 /*! \page com_palm_universalsearch Service API com.palm.universalsearch
@@ -58,6 +64,7 @@ static bool cbUpdateAllSearchItems(LSHandle* lshandle, LSMessage *message, void
  * Public methods:
  *  - \ref com_palm_universalsearch_add_optional_search_desc
  *  - \ref com_palm_universalsearch_add_search_item
+ *  - \ref com_palm_universalsearch_apply_search_item_changes
  *  - \ref com_palm_universalsearch_clear_optional_search_list
  *  - \ref com_palm_universalsearch_get_all_search_preference
  *  - \ref com_palm_universalsearch_get_optional_search_list
@@ -70,6 +77,9 @@ static bool cbUpdateAllSearchItems(LSHandle* lshandle, LSMessage *message, void
  *  - \ref com_palm_universalsearch_set_search_preference
  *  - \ref com_palm_universalsearch_update_all_search_items
  *  - \ref com_palm_universalsearch_update_search_item
+ *
+ * Private methods:
+ *  - \ref com_palm_universalsearch_get_stats
  */
 static LSMethod s_methods[]  = {
 	{ "getVersion",		cbGetVersion},
@@ -78,6 +88,7 @@ static LSMethod s_methods[]  = {
 	{ "addSearchItem", cbAddSearchItem},
 	{ "removeSearchItem", cbRemoveSearchItem},
 	{ "reorderSearchItem", cbReorderSearchItem},
+	{ "applySearchItemChanges", cbApplySearchItemChanges},
 	{ "updateAllSearchItems", cbUpdateAllSearchItems},
 //	{ "getSearchServiceList", cbGetSearchServiceList},
 //	{ "addSearchService", cbAddSearchService},
@@ -93,9 +104,20 @@ static LSMethod s_methods[]  = {
 	{0,0}
 };
 
+static LSMethod s_privateMethods[]  = {
+	{ "getStats", cbGetStats},
+	{0,0}
+};
+
 UniversalSearchService::UniversalSearchService()
 {
 	m_mainLoop = gMainLoop;
+	m_searchListPosted = false;
+	m_postedSearchListGeneration = 0;
+	m_deltaBaseValid = false;
+	m_deltaBaseGeneration = 0;
+	m_notificationScheduler = new NotificationScheduler();
+	m_startupPipeline = NULL;
 
 	this->startService();
 }
@@ -145,11 +167,14 @@ void UniversalSearchService::startService() {
 	LSError lsError;
 	LSErrorInit(&lsError);
 
+	//Capture timestamps count from here, where tools/replay starts as well.
+	BusCapture::instance();
+
 	result = LSRegisterPalmService("com.palm.universalsearch", &m_service, &lsError);
 	if (!result)
 		goto Done;
 
-	result = LSPalmServiceRegisterCategory(m_service, "/", s_methods,NULL, NULL, NULL, &lsError);
+	result = LSPalmServiceRegisterCategory(m_service, "/", s_methods, s_privateMethods, NULL, NULL, &lsError);
 	if (!result)
 		goto Done;
 	
@@ -169,6 +194,13 @@ void UniversalSearchService::startService() {
 	//Instantiate Open Search Handler;
 	openSearchHandler = OpenSearchHandler::instance();
 
+	//Database and plugins are read right away, only the merge waits for the locale.
+	m_startupPipeline = new StartupPipeline();
+	m_startupPipeline->start(openSearchHandler->getPluginPath());
+
+	//Application manager and installer replies are held by the pipeline until the lists are ready.
+	postInit();
+
 	result = LSCall(m_serviceHandlePrivate, "palm://com.palm.bus/signal/registerServerStatus",
 			    "{\"serviceName\":\"com.palm.systemservice\", \"subscribe\":true}",
 			    UniversalSearchService::cbSysServiceBusStatusNotification, this, NULL, &lsError);
@@ -192,6 +224,16 @@ void UniversalSearchService::stopService() {
 	LSErrorInit(&lsError);
 	bool result;
 
+	//Subscribers must not miss the last changes.
+	m_notificationScheduler->flush();
+	delete m_notificationScheduler;
+	m_notificationScheduler = NULL;
+
+	//The writer thread may still hold changes.
+	UniversalSearchPrefsDb::instance()->flush();
+
+	BusCapture::instance()->close();
+
 	result = LSUnregisterPalmService(m_service, &lsError);
 	if (!result)
 		LSErrorFree(&lsError);
@@ -204,6 +246,32 @@ LSHandle* UniversalSearchService::getServiceHandle()
 	return m_serviceHandlePrivate;
 }
 
+/*
+ * Switches to the lists of another locale without restarting: the database moves to
+ * the partition of the locale, the lists are rebuilt with the user's toggles carried
+ * over, and listApps is asked again for the app provided items. Subscriptions stay;
+ * they get the new lists as an update.
+ */
+void UniversalSearchService::switchLocale(const std::string& locale)
+{
+	STATS_SCOPE("switchLocale");
+	LSError lsError;
+	LSErrorInit(&lsError);
+	
+	m_locale = locale;
+	UniversalSearchPrefsDb::instance()->setLocale(locale);
+	searchItemsMgr->reloadForLocale();
+	
+	if (!LSCall(m_serviceHandlePrivate, "palm://com.palm.applicationManager/listApps", "{}",
+			UniversalSearchService::cbAppMgrAppList, NULL, NULL, &lsError)) {
+		luna_critical(s_logChannel, "call to applicationmanager/listApps failed");
+		LSErrorFree(&lsError);
+	}
+	
+	postSearchListChange("update");
+	postSearchPreferenceChange();
+}
+
 std::string UniversalSearchService::getLocale() 
 {
 	return m_locale;
@@ -256,6 +324,8 @@ Example response for a succesful call:
 \endcode
 */
 bool cbGetVersion(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("getVersion");
+	BUS_CAPTURE("getVersion", message);
 
 	LSError lserror;
 	std::string result;
@@ -289,11 +359,29 @@ Get a list of items related to the Universal Search feature.
 \subsection com_palm_universalsearch_get_universal_search_list_syntax Syntax:
 \code
 {
-    "subscribe": boolean
+    "subscribe": boolean,
+    "categories": [ string array ],
+    "fields": [ string array ],
+    "offset": int,
+    "limit": int,
+    "ifNoneMatch": string,
+    "deltas": boolean,
+    "instanceId": int,
+    "sinceGeneration": int
 }
 \endcode
 
 \param subscribe Set to true to receive notifications when items in the list change.
+\param categories Lists to return: "search", "action" and/or "dbsearch". All of them by default.
+\param fields Item properties to return, for example [ "id", "displayName", "enabled" ]. All of them by default.
+\param offset Index of the first item returned from each list. Defaults to 0.
+\param limit Maximum number of items returned from each list. No limit by default.
+\param ifNoneMatch The \e etag of the lists the caller already has, requested with the same parameters.
+If the lists are unchanged, they are not returned.
+\param deltas Set to true to receive the changes to the lists instead of the full lists, where possible.
+Deltas always describe all the lists; \e categories, \e fields, \e offset and \e limit are ignored.
+\param instanceId Instance ID from a previous reply. Only used with \e deltas.
+\param sinceGeneration Generation of the lists already held by the caller. Only used with \e deltas.
 
 \subsection com_palm_universalsearch_get_universal_search_list_returns Returns:
 \code
@@ -303,7 +391,13 @@ Get a list of items related to the Universal Search feature.
     "ActionList": [ object array ],
     "DBSearchItemList": [ object array ],
     "defaultSearchEngine": string,
-    "subscribed": boolean
+    "etag": string,
+    "notModified": boolean,
+    "instanceId": int,
+    "generation": int,
+    "deltas": [ object array ],
+    "subscribed": boolean,
+    "errorMessage": string
 }
 \endcode
 
@@ -311,8 +405,20 @@ Get a list of items related to the Universal Search feature.
 \param UniversalSearchList Contains objects of search engines used by Universal Search.
 \param ActionList List of action providers.
 \param DBSearchItemList Items related to database searches.
-\param defaultSearchEngine The default search engine.
+\param defaultSearchEngine The default search engine. Returned with the \e search category.
+\param etag Identifies this version of the lists.
+\param notModified True if \e ifNoneMatch matched and the lists were left out.
+\param instanceId Identifies this run of the service. Only returned with \e deltas.
+\param generation Generation of the lists. Only returned with \e deltas.
+\param deltas Returned instead of the lists when \e instanceId and \e sinceGeneration are still valid.
+Each step holds "fromGeneration", "generation" and "changes". A change has an "op" of "removed",
+"added", "moved" or "fieldChanged", the "list" and the "id" of the item, the new "index" for
+"added" and "moved", the "item" for "added", and "field" and "value" for "fieldChanged" (value is
+null for a removed field). A new default search engine is a "fieldChanged" with "field" set to
+"defaultSearchEngine" and no "list" or "id", since it changes a member of the reply rather than an
+item. Changes are applied in order; steps the caller already holds are skipped.
 \param subscribed True if subscribed to receive notifications items in the list change.
+\param errorMessage Describes the error if one of the parameters is not valid.
 
 \subsection com_palm_universalsearch_get_universal_search_list_examples Examples:
 \code
@@ -558,42 +664,263 @@ Example response for a succesful call:
 \endcode
 */
 
+/*
+ * Builds a getUniversalSearchList payload around the serialized lists ('body', usually
+ * the snapshot). 'tail' holds the trailing member(s) specific to a reply or a broadcast.
+ */
+static std::string buildSearchListPayload(const std::string& body, const std::string& tail)
+{
+	std::string payload;
+	
+	payload.reserve(body.size() + tail.size() + 32);
+	payload = "{ \"returnValue\": true, ";
+	payload += body;
+	payload += ", ";
+	payload += tail;
+	payload += " }";
+	
+	return payload;
+}
+
+/*
+ * Delta payload: the change steps replace the lists.
+ */
+static std::string buildSearchListDeltaPayload(const std::string& changes, const std::string& tail)
+{
+	std::string payload;
+	
+	payload.reserve(changes.size() + tail.size() + 48);
+	payload = "{ \"returnValue\": true, \"deltas\": ";
+	payload += changes;
+	payload += ", ";
+	payload += tail;
+	payload += " }";
+	
+	return payload;
+}
+
+/*
+ * Reads the optional categories, fields, offset and limit parameters.
+ */
+static bool parseSearchListQuery(json_object* root, SearchItemsManager::SearchListQuery& query, std::string& errorText)
+{
+	json_object* label = NULL;
+	
+	label = json_object_object_get(root, "categories");
+	if (label && !is_error(label)) {
+		if (!json_object_is_type(label, json_type_array)) {
+			errorText = "categories must be an array";
+			return false;
+		}
+		query.categories = 0;
+		for (int i = 0; i < json_object_array_length(label); i++) {
+			json_object* category = json_object_array_get_idx(label, i);
+			const char* name = category ? json_object_get_string(category) : NULL;
+			if (name && strcmp(name, "search") == 0)
+				query.categories |= SearchItemsManager::SearchListQuery::CategorySearch;
+			else if (name && strcmp(name, "action") == 0)
+				query.categories |= SearchItemsManager::SearchListQuery::CategoryAction;
+			else if (name && strcmp(name, "dbsearch") == 0)
+				query.categories |= SearchItemsManager::SearchListQuery::CategoryDBSearch;
+			else {
+				errorText = "unknown category";
+				return false;
+			}
+		}
+	}
+	
+	label = json_object_object_get(root, "fields");
+	if (label && !is_error(label)) {
+		if (!json_object_is_type(label, json_type_array) || json_object_array_length(label) == 0) {
+			errorText = "fields must be a non-empty array";
+			return false;
+		}
+		for (int i = 0; i < json_object_array_length(label); i++) {
+			json_object* field = json_object_array_get_idx(label, i);
+			if (!field || !json_object_is_type(field, json_type_string)) {
+				errorText = "fields must be strings";
+				return false;
+			}
+			query.fields.insert(json_object_get_string(field));
+		}
+	}
+	
+	label = json_object_object_get(root, "offset");
+	if (label && !is_error(label)) {
+		if (!json_object_is_type(label, json_type_int) || json_object_get_int(label) < 0) {
+			errorText = "offset must be a positive integer";
+			return false;
+		}
+		query.offset = json_object_get_int(label);
+	}
+	
+	label = json_object_object_get(root, "limit");
+	if (label && !is_error(label)) {
+		if (!json_object_is_type(label, json_type_int) || json_object_get_int(label) < 0) {
+			errorText = "limit must be a positive integer";
+			return false;
+		}
+		query.limit = json_object_get_int(label);
+	}
+	
+	return true;
+}
+
+static bool parseSearchListQuery(const char* payload, SearchItemsManager::SearchListQuery& query)
+{
+	std::string errorText;
+	bool success = false;
+	json_object* root = payload ? json_tokener_parse(payload) : NULL;
+	
+	if (root && !is_error(root)) {
+		success = parseSearchListQuery(root, query, errorText);
+		json_object_put(root);
+	}
+	return success;
+}
+
+/*
+ * Entity tags for conditional gets. They include the instance id so that a tag from a
+ * previous run never matches. The search list tag follows the client visible list
+ * generation; the optional list also depends on the search items it excludes.
+ */
+static std::string searchListETag(const SearchItemsManager* searchItemsMgr, const SearchItemsManager::SearchListSnapshot* snapshot)
+{
+	char etag[32];
+	snprintf(etag, sizeof(etag), "%x-%u", searchItemsMgr->getSearchListInstanceId(), snapshot->listGeneration);
+	return etag;
+}
+
+static std::string optionalSearchListETag()
+{
+	char etag[48];
+	snprintf(etag, sizeof(etag), "%x-%u-%u", SearchItemsManager::instance()->getSearchListInstanceId(),
+			OpenSearchHandler::instance()->getGeneration(), SearchItemsManager::instance()->getGeneration());
+	return etag;
+}
+
+static std::string searchListGenerationMembers(const SearchItemsManager* searchItemsMgr, const SearchItemsManager::SearchListSnapshot* snapshot)
+{
+	char members[64];
+	snprintf(members, sizeof(members), "\"instanceId\": %u, \"generation\": %u, ", searchItemsMgr->getSearchListInstanceId(), snapshot->listGeneration);
+	return members;
+}
+
 bool cbGetUniversalSearchList(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("getUniversalSearchList");
+	BUS_CAPTURE("getUniversalSearchList", message);
 	LSError lserror;
 	std::string result;
+	std::string tail;
+	std::string changes;
 	bool subscribed = false;
-	std::string defaultSearchEngineValue;
+	bool deltas = false;
+	bool haveSince = false;
+	unsigned int sinceGeneration = 0;
+	unsigned int instanceId = 0;
+	json_object* root = NULL;
+	json_object* label = NULL;
+	const char* payload = LSMessageGetPayload(message);
+	SearchItemsManager* searchItemsMgr = UniversalSearchService::instance()->searchItemsMgr;
+	SearchItemsManager::SearchListQuery query;
+	std::string errorText;
+	std::string ifNoneMatch;
+	std::string etag;
+	bool validQuery = true;
+	const char* subscriptionKey = "getUniversalSearchList";
 		
 	LSErrorInit(&lserror);
+	
+	if (payload) {
+		root = json_tokener_parse(payload);
+		if (root && !is_error(root)) {
+			label = json_object_object_get(root, "deltas");
+			if (label && !is_error(label))
+				deltas = json_object_get_boolean(label);
 			
-	json_object* response = json_object_new_object();
-	json_object_object_add (response, "returnValue", json_object_new_boolean (true));
-	json_object_object_add(response, (char*) "UniversalSearchList", UniversalSearchService::instance()->searchItemsMgr->getSearchList());
-	json_object_object_add(response, (char*) "ActionList", UniversalSearchService::instance()->searchItemsMgr->getActionProvidersList());
-	json_object_object_add(response, (char*) "DBSearchItemList", UniversalSearchService::instance()->searchItemsMgr->getDBSearchItemList());
+			label = json_object_object_get(root, "sinceGeneration");
+			if (label && !is_error(label)) {
+				sinceGeneration = json_object_get_int(label);
+				haveSince = true;
+			}
+			
+			label = json_object_object_get(root, "instanceId");
+			if (label && !is_error(label))
+				instanceId = json_object_get_int(label);
+			
+			label = json_object_object_get(root, "ifNoneMatch");
+			if (label && !is_error(label))
+				ifNoneMatch = json_object_get_string(label);
+			
+			//Deltas always describe the complete lists.
+			if (!deltas)
+				validQuery = parseSearchListQuery(root, query, errorText);
+			
+			json_object_put(root);
+		}
+	}
 	
-	defaultSearchEngineValue = UniversalSearchPrefsDb::instance()->getSearchPreference("defaultSearchEngine");
-	json_object_object_add (response, "defaultSearchEngine", json_object_new_string (defaultSearchEngineValue.c_str()));
+	if (!validQuery) {
+		json_object* response = json_object_new_object();
+		json_object_object_add (response, "returnValue", json_object_new_boolean (false));
+		json_object_object_add (response, "errorMessage", json_object_new_string (errorText.c_str()));
+		if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
+		    LSErrorPrint (&lserror, stderr);
+		    LSErrorFree(&lserror);
+		}
+		json_object_put(response);
+		return true;
+	}
 	
+	if (deltas)
+		subscriptionKey = "getUniversalSearchListDeltas";
+	else if (!query.isDefault())
+		subscriptionKey = "getUniversalSearchListFiltered";
+			
+	const SearchItemsManager::SearchListSnapshot* snapshot = searchItemsMgr->getSearchListSnapshot();
 	
 	if (LSMessageIsSubscription(message)) {		
-		if (!LSSubscriptionAdd(lshandle, "getUniversalSearchList",
+		if (!LSSubscriptionAdd(lshandle, subscriptionKey,
 				message, &lserror)) {
 			LSErrorFree(&lserror);
 			subscribed = false;
 		}
-		else 
+		else {
 			subscribed = true;
+			if (deltas)
+				UniversalSearchService::instance()->searchListDeltaSubscriptionAdded(snapshot);
+			else
+				UniversalSearchService::instance()->searchListSubscriptionAdded(snapshot);
+		}
 	}
 	
-	json_object_object_add(response, (char*) "subscribed", json_object_new_boolean(subscribed));
+	etag = searchListETag(searchItemsMgr, snapshot);
+	tail = "\"etag\": \"" + etag + "\", ";
+	if (deltas)
+		tail += searchListGenerationMembers(searchItemsMgr, snapshot);
+	tail += subscribed ? "\"subscribed\": true" : "\"subscribed\": false";
+	
+	//Unchanged lists are not sent again. Deltas are only worth it if the caller is from
+	//this run and the changes are smaller than the lists.
+	if (!ifNoneMatch.empty() && ifNoneMatch == etag)
+		result = "{ \"returnValue\": true, \"notModified\": true, " + tail + " }";
+	else if (deltas && haveSince && instanceId == searchItemsMgr->getSearchListInstanceId()
+		&& searchItemsMgr->getSearchListChanges(sinceGeneration, changes) && changes.size() < snapshot->body.size())
+		result = buildSearchListDeltaPayload(changes, tail);
+	else if (!query.isDefault())
+		result = buildSearchListPayload(searchItemsMgr->getSearchListBody(query), tail);
+	else
+		result = buildSearchListPayload(snapshot->body, tail);
 	
-	if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
+	STATS_RECORD("getUniversalSearchList", ServiceStats::PayloadSize, result.size());
+	
+	if (!LSMessageReply( lshandle, message, result.c_str(), &lserror )) 	{
 	    LSErrorPrint (&lserror, stderr);
 	    LSErrorFree(&lserror);
 	}
+	else
+		UniversalSearchService::instance()->getStartupPipeline()->listReplySent();
 	
-	json_object_put(response);
 	return true;
 }
 
@@ -655,52 +982,31 @@ Example response for a failed call:
 \endcode
 */
 bool cbUpdateSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("updateSearchItem");
+	BUS_CAPTURE("updateSearchItem", message);
 	LSError lserror;
 	json_object* response = json_object_new_object();
+	RequestArena arena;
+	DecodedPayload<UpdateItemPayload> request(arena);
 	std::string category;
+	std::string errorText = "Unable to get data";
 	bool success = true;
 	
-	
 	LSErrorInit(&lserror);
-	json_object* label = NULL;
-	json_object* root = NULL;
-	const char* payload = LSMessageGetPayload(message);
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
-		success = false;
-		goto Done;
-	}
-		
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "unable to parse the json message");
+	if(!request.decode(LSMessageGetPayload(message), errorText)) {
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
 	
-	//check the category key
-	label = json_object_object_get(root, "category");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "category field is missing");
-		success = false;
-		goto Done;
-	}
-	
-	category = json_object_get_string(label);
-	
-	if(category.compare("search") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->modifySearchItem(payload);
-	else if(category.compare("action") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->modifyActionProvider(payload);
-	else if(category.compare("dbsearch") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->modifyDBSearchItem(payload);
-	else
-		success = false;
+	category = request[UpdateItemPayload::category].str();
+	success = UniversalSearchService::instance()->searchItemsMgr->modifyItem(category, request[UpdateItemPayload::id].str(),
+			request[UpdateItemPayload::enabled].boolean, request[UpdateItemPayload::setDefault].boolean);
 	
 	Done:
 		if(!success) {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (false));
-			json_object_object_add (response, "errorMessage", json_object_new_string("Unable to get data"));
+			json_object_object_add (response, "errorMessage", json_object_new_string(errorText.c_str()));
 		}
 		else {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (true));
@@ -717,12 +1023,6 @@ bool cbUpdateSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data)
 				UniversalSearchService::instance()->postOptionalSearchListChange();
 		}
 		
-		if (root && !is_error(root))
-			json_object_put(root);
-		
-		if (label && !is_error(label))
-			json_object_put(label);
-		
 		json_object_put(response);
 		return true;
 		
@@ -784,52 +1084,30 @@ Example response for a failed call:
 \endcode
 */
 bool cbUpdateAllSearchItems(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("updateAllSearchItems");
+	BUS_CAPTURE("updateAllSearchItems", message);
 	LSError lserror;
 	json_object* response = json_object_new_object();
+	RequestArena arena;
+	DecodedPayload<UpdateAllItemsPayload> request(arena);
 	std::string category;
+	std::string errorText = "Unable to get data";
 	bool success = true;
-
-
+	
 	LSErrorInit(&lserror);
-	json_object* label = NULL;
-	json_object* root = NULL;
-	const char* payload = LSMessageGetPayload(message);
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
+	if(!request.decode(LSMessageGetPayload(message), errorText)) {
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
-
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "unable to parse the json message");
-		success = false;
-		goto Done;
-	}
-
-	//check the category key
-	label = json_object_object_get(root, "category");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "category field is missing");
-		success = false;
-		goto Done;
-	}
-
-	category = json_object_get_string(label);
-
-	if(category.compare("search") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->modifyAllSearchItems(payload);
-	else if(category.compare("action") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->modifyAllActionProviders(payload);
-	else if(category.compare("dbsearch") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->modifyAllDBSearchItems(payload);
-	else
-		success = false;
-
+	
+	category = request[UpdateAllItemsPayload::category].str();
+	success = UniversalSearchService::instance()->searchItemsMgr->modifyAllItems(category, request[UpdateAllItemsPayload::enabled].boolean);
+	
 	Done:
 		if(!success) {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (false));
-			json_object_object_add (response, "errorMessage", json_object_new_string("Unable to get data"));
+			json_object_object_add (response, "errorMessage", json_object_new_string(errorText.c_str()));
 		}
 		else {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (true));
@@ -846,12 +1124,6 @@ bool cbUpdateAllSearchItems(LSHandle* lshandle, LSMessage *message, void *user_d
 				UniversalSearchService::instance()->postOptionalSearchListChange();*/
 		}
 
-		if (root && !is_error(root))
-			json_object_put(root);
-
-		if (label && !is_error(label))
-			json_object_put(label);
-
 		json_object_put(response);
 		return true;
 
@@ -964,53 +1236,38 @@ Example response for a failed call:
 */
 
 bool cbAddSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("addSearchItem");
+	BUS_CAPTURE("addSearchItem", message);
 	LSError lserror;
 	json_object* response = json_object_new_object();
+	RequestArena arena;
+	DecodedPayload<ItemPayload> request(arena);
 	std::string category;
+	std::string errorText = "Unable to add item";
 	bool success = true;
-			
-	LSErrorInit(&lserror);
-	json_object* label = NULL;
-	json_object* root = NULL;
 	
-	const char* payload = LSMessageGetPayload(message);
-	
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
+	LSErrorInit(&lserror);
+	if(!request.decode(LSMessageGetPayload(message), errorText)) {
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
 	
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "unable to parse the json message");
-		success = false;
-		goto Done;
-	}
-
-	//check the category key
-	label = json_object_object_get(root, "category");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "category field is missing");
+	//The schema is shared with the app items, which have no category.
+	if(!request[ItemPayload::category].present()) {
+		errorText = "'category' is missing";
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
-			
-	category = json_object_get_string(label);
-			
-	if(category.compare("search") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->addSearchItem(payload, true, false,true);
-	else if(category.compare("action") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->addActionProvider(payload, true, false, true);
-	else if(category.compare("dbsearch") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->addDBSearchItem(payload, true, false,true);
-	else
-		success = false;
-		
+	
+	category = request[ItemPayload::category].str();
+	success = UniversalSearchService::instance()->searchItemsMgr->addItem(category, request, true, false, true);
+	
 	Done:
 		if(!success) {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (false));
-			json_object_object_add (response, "errorMessage", json_object_new_string("Unable to add item"));
+			json_object_object_add (response, "errorMessage", json_object_new_string(errorText.c_str()));
 		}
 		else {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (true));
@@ -1028,9 +1285,6 @@ bool cbAddSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data) {
 				UniversalSearchService::instance()->postOptionalSearchListChange();
 		}
 		
-		if (label && !is_error(label))
-			json_object_put(label);
-		
 		json_object_put(response);
 		
 	return true;
@@ -1090,52 +1344,30 @@ Example response for a failed call:
 \endcode
 */
 bool cbRemoveSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("removeSearchItem");
+	BUS_CAPTURE("removeSearchItem", message);
 	LSError lserror;
 	json_object* response = json_object_new_object();
+	RequestArena arena;
+	DecodedPayload<RemoveItemPayload> request(arena);
 	std::string category;
+	std::string errorText = "Unable to remove item";
 	bool success = true;
-				
-	LSErrorInit(&lserror);
-	json_object* label = NULL;
-	json_object* root = NULL;
 	
-	const char* payload = LSMessageGetPayload(message);
-		
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
-		goto Done;
-	}
-	
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "unable to parse the json message");
+	LSErrorInit(&lserror);
+	if(!request.decode(LSMessageGetPayload(message), errorText)) {
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
 	
-	//check the category key
-	label = json_object_object_get(root, "category");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "category field is missing");
-		success = false;
-		goto Done;
-	}
-		
-	category = json_object_get_string(label);
-		
-	if(category.compare("search") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->removeSearchItem(payload);
-	else if(category.compare("action") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->removeActionProvider(payload);
-	else if(category.compare("dbsearch") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->removeDBSearchItem(payload);
-	else
-		success = false;
-		
+	category = request[RemoveItemPayload::category].str();
+	success = UniversalSearchService::instance()->searchItemsMgr->removeItem(category, request[RemoveItemPayload::id].str());
+	
 	Done:
 		if(!success) {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (false));
-			json_object_object_add (response, "errorMessage", json_object_new_string("Unable to remove item"));
+			json_object_object_add (response, "errorMessage", json_object_new_string(errorText.c_str()));
 		}
 		else {
 			json_object_object_add (response, "returnValue", json_object_new_boolean (true));
@@ -1153,9 +1385,6 @@ bool cbRemoveSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data)
 				UniversalSearchService::instance()->postOptionalSearchListChange();
 		}
 		
-		if (label && !is_error(label))
-			json_object_put(label);
-		
 		
 	return true;
 }
@@ -1217,114 +1446,533 @@ Example response for a failed call:
 */
 bool cbReorderSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data) 
 {
+	STATS_SCOPE("reorderSearchItem");
+	BUS_CAPTURE("reorderSearchItem", message);
 	LSError lserror;
 	json_object* response = json_object_new_object();
+	RequestArena arena;
+	DecodedPayload<ReorderItemPayload> request(arena);
 	std::string category;
+	std::string errorText = "Unable to reorder item";
 	bool success = true;
-				
+	
 	LSErrorInit(&lserror);
-	json_object* label = NULL;
+	if(!request.decode(LSMessageGetPayload(message), errorText)) {
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
+		success = false;
+		goto Done;
+	}
+	
+	category = request[ReorderItemPayload::category].str();
+	success = UniversalSearchService::instance()->searchItemsMgr->reorderItem(category, request[ReorderItemPayload::id].str(),
+			request[ReorderItemPayload::fromIndex].present() ? request[ReorderItemPayload::fromIndex].toInt() : -1,
+			request[ReorderItemPayload::toIndex].toInt());
+	
+	Done:
+		if(!success) {
+			json_object_object_add (response, "returnValue", json_object_new_boolean (false));
+			json_object_object_add (response, "errorMessage", json_object_new_string(errorText.c_str()));
+		}
+		else {
+			json_object_object_add (response, "returnValue", json_object_new_boolean (true));
+		}
+		if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
+			LSErrorPrint (&lserror, stderr);
+			LSErrorFree(&lserror);
+		}
+		json_object_put (response);
+			
+		if(success) {
+			luna_critical(s_logChannel, "Posting change notificaiton");
+			UniversalSearchService::instance()->postSearchListChange("reorder");
+		}
+		
+	return true;
+
+}
+
+/*!
+\page com_palm_universalsearch
+\n
+\section com_palm_universalsearch_apply_search_item_changes applySearchItemChanges
+
+\e Public.
+
+com.palm.universalsearch/applySearchItemChanges
+
+Apply several add, update, remove and reorder operations at once. Either all of them are applied or none is.
+Subscribers receive a single change notification.
+
+\subsection com_palm_universalsearch_apply_search_item_changes_syntax Syntax:
+\code
+{
+    "operations": [ object array ]
+}
+\endcode
+
+\param operations The operations, in the order they are applied. \e Required. Each object has an "op" ("add", "update",
+"remove" or "reorder") and a "category" ("search", "action" or "dbsearch"), and takes the same fields as the
+addSearchItem, updateSearchItem, removeSearchItem or reorderSearchItem call for that op. All the operations are checked
+before any is applied, each against the lists as the operations before it leave them: an id must exist at that point,
+and the fromIndex of an "action" or "dbsearch" reorder must be where the item is by then.
+
+\subsection com_palm_universalsearch_apply_search_item_changes_returns Returns:
+\code
+{
+    "returnValue": boolean,
+    "errorMessage": string,
+    "failedIndex": int
+}
+\endcode
+
+\param returnValue Indicates if the call was succesful.
+\param errorMessage Describes the error if call was not succesful.
+\param failedIndex Index of the operation that failed, if any.
+
+\subsection com_palm_universalsearch_apply_search_item_changes_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.universalsearch/applySearchItemChanges '{ "operations": [ { "op": "update", "category": "search", "id": "wikipedia", "enabled": true }, { "op": "reorder", "category": "search", "id": "wikipedia", "toIndex": 0 } ] }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "returnValue": true
+}
+\endcode
+
+Example response for a failed call:
+\code
+{
+    "returnValue": false,
+    "errorMessage": "no search item wikipedia",
+    "failedIndex": 1
+}
+\endcode
+
+A batch with a bad operation in the middle. The first operation moves the item to the top, so the second one, which
+gives its old place as fromIndex, is rejected and none of the three is applied:
+\code
+luna-send -n 1 -f luna://com.palm.universalsearch/applySearchItemChanges '{ "operations": [ { "op": "reorder", "category": "action", "id": "com.palm.app.email", "fromIndex": 2, "toIndex": 0 }, { "op": "reorder", "category": "action", "id": "com.palm.app.email", "fromIndex": 2, "toIndex": 1 }, { "op": "update", "category": "action", "id": "com.palm.app.email", "enabled": false } ] }'
+\endcode
+
+Response:
+\code
+{
+    "returnValue": false,
+    "errorMessage": "fromIndex is out of range",
+    "failedIndex": 1
+}
+\endcode
+*/
+bool cbApplySearchItemChanges(LSHandle* lshandle, LSMessage *message, void *user_data) {
+	STATS_SCOPE("applySearchItemChanges");
+	BUS_CAPTURE("applySearchItemChanges", message);
+	LSError lserror;
+	json_object* response = json_object_new_object();
 	json_object* root = NULL;
+	json_object* operations = NULL;
+	json_object* label = NULL;
+	std::string errorText;
+	std::string eventName;
+	int failedIndex = -1;
+	bool success = true;
+	bool optionalListChanged = false;
+	SearchItemsManager* searchItemsMgr = UniversalSearchService::instance()->searchItemsMgr;
+	
+	LSErrorInit(&lserror);
 	
 	const char* payload = LSMessageGetPayload(message);
-		
 	if(!payload) {
 		luna_critical(s_logChannel, "Payload is missing");
+		errorText = "Payload is missing";
+		success = false;
 		goto Done;
 	}
 	
 	root = json_tokener_parse(payload);
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "unable to parse the json message");
+		errorText = "Unable to parse the payload";
+		root = NULL;
 		success = false;
 		goto Done;
 	}
 	
-	//check the category key
-	label = json_object_object_get(root, "category");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "category field is missing");
+	operations = json_object_object_get(root, "operations");
+	
+	//Nothing is touched unless every operation is valid.
+	if(!searchItemsMgr->validateSearchItemChanges(operations, failedIndex, errorText)) {
+		luna_critical(s_logChannel, "Rejected batch: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
+	
+	if(!searchItemsMgr->beginBatch()) {
+		errorText = "Unable to start the transaction";
+		success = false;
+		goto Done;
+	}
+	
+	for(int i = 0; i < json_object_array_length(operations) && success; i++) {
+		json_object* operation = json_object_array_get_idx(operations, i);
+		std::string op = json_object_get_string(json_object_object_get(operation, "op"));
+		std::string category = json_object_get_string(json_object_object_get(operation, "category"));
 		
-	category = json_object_get_string(label);
+		if(op == "add") {
+			if(category == "search")
+				success = searchItemsMgr->addSearchItem(operation, true, false, true);
+			else if(category == "action")
+				success = searchItemsMgr->addActionProvider(operation, true, false, true);
+			else
+				success = searchItemsMgr->addDBSearchItem(operation, true, false, true);
+		}
+		else if(op == "update") {
+			if(category == "search")
+				success = searchItemsMgr->modifySearchItem(operation);
+			else if(category == "action")
+				success = searchItemsMgr->modifyActionProvider(operation);
+			else
+				success = searchItemsMgr->modifyDBSearchItem(operation);
+		}
+		else if(op == "remove") {
+			if(category == "search")
+				success = searchItemsMgr->removeSearchItem(operation);
+			else if(category == "action")
+				success = searchItemsMgr->removeActionProvider(operation);
+			else
+				success = searchItemsMgr->removeDBSearchItem(operation);
+		}
+		else {
+			if(category == "search")
+				success = searchItemsMgr->reorderSearchItem(operation);
+			else if(category == "action")
+				success = searchItemsMgr->reorderActionProvider(operation);
+			else
+				success = searchItemsMgr->reorderDBSearchItem(operation);
+		}
 		
-	if(category.compare("search") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->reorderSearchItem(payload);
-	else if(category.compare("action") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->reorderActionProvider(payload);
-	else if(category.compare("dbsearch") == 0)
-		success = UniversalSearchService::instance()->searchItemsMgr->reorderDBSearchItem(payload);
-	else
-		success = false;
+		if(!success) {
+			failedIndex = i;
+			errorText = "Unable to " + op + " " + category + " item";
+			break;
+		}
 		
+		//The change event keeps the op name if the whole batch agrees on it.
+		if(eventName.empty())
+			eventName = op;
+		else if(eventName != op)
+			eventName = "update";
+		
+		if(category == "search" && op != "reorder")
+			optionalListChanged = true;
+	}
+	
+	if(!success) {
+		searchItemsMgr->rollbackBatch();
+		goto Done;
+	}
+	
+	searchItemsMgr->commitBatch();
+	
 	Done:
+		json_object_object_add (response, "returnValue", json_object_new_boolean (success));
 		if(!success) {
-			json_object_object_add (response, "returnValue", json_object_new_boolean (false));
-			json_object_object_add (response, "errorMessage", json_object_new_string("Unable to reorder item"));
-		}
-		else {
-			json_object_object_add (response, "returnValue", json_object_new_boolean (true));
+			json_object_object_add (response, "errorMessage", json_object_new_string(errorText.c_str()));
+			if(failedIndex >= 0)
+				json_object_object_add (response, "failedIndex", json_object_new_int(failedIndex));
 		}
+		
 		if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
 			LSErrorPrint (&lserror, stderr);
 			LSErrorFree(&lserror);
 		}
-		json_object_put (response);
-			
+		
 		if(success) {
 			luna_critical(s_logChannel, "Posting change notificaiton");
-			UniversalSearchService::instance()->postSearchListChange("reorder");
+			UniversalSearchService::instance()->postSearchListChange(eventName.c_str());
+			if(optionalListChanged)
+				UniversalSearchService::instance()->postOptionalSearchListChange();
 		}
 		
-		if (label && !is_error(label))
-			json_object_put(label);
+		if (root)
+			json_object_put(root);
+		
+		json_object_put(response);
 		
 	return true;
+}
+
+/*
+ * A new subscriber starts from 'snapshot'. If that differs from what was last posted,
+ * the next change must be posted even when it returns to the posted content.
+ */
+void UniversalSearchService::searchListSubscriptionAdded(const SearchItemsManager::SearchListSnapshot* snapshot)
+{
+	if (m_searchListPosted && snapshot->listGeneration != m_postedSearchListGeneration)
+		m_searchListPosted = false;
+}
+
+/*
+ * A delta subscriber holds 'snapshot'. The next change is posted as the steps after the
+ * oldest generation held by any delta subscriber; each one skips the steps it already has.
+ */
+void UniversalSearchService::searchListDeltaSubscriptionAdded(const SearchItemsManager::SearchListSnapshot* snapshot)
+{
+	searchListSubscriptionAdded(snapshot);
+	
+	if (!m_deltaBaseValid || snapshot->listGeneration < m_deltaBaseGeneration) {
+		m_deltaBaseGeneration = snapshot->listGeneration;
+		m_deltaBaseValid = true;
+	}
+}
+
+/*
+ * Change notifications are coalesced by the scheduler, which calls the broadcast
+ * methods once the burst is over.
+ */
+void UniversalSearchService::postSearchListChange(const char* eventName)
+{
+	m_notificationScheduler->markSearchListDirty(eventName);
+}
+
+void UniversalSearchService::postSearchPreferenceChange()
+{
+	m_notificationScheduler->markSearchPreferenceDirty();
+}
+
+void UniversalSearchService::postOptionalSearchListChange()
+{
+	m_notificationScheduler->markOptionalSearchListDirty();
+}
+
+void UniversalSearchService::broadcastSearchListChange(const char* eventName)
+{
+	STATS_SCOPE("broadcastSearchListChange");
+	int receivers = 0;
+	LSSubscriptionIter *iter=NULL;
+	LSError lserror;
+	LSHandle * lsHandle;
+		
+	LSErrorInit(&lserror);
+	
+	const SearchItemsManager::SearchListSnapshot* snapshot = searchItemsMgr->getSearchListSnapshot();
+	
+	//Subscribers already have this content. Nothing to post.
+	if (m_searchListPosted && snapshot->listGeneration == m_postedSearchListGeneration) {
+		luna_log(s_logChannel, "Search list unchanged (generation %u), skipping %s notification", snapshot->generation, eventName);
+		return;
+	}
+	
+	std::string tail = "\"etag\": \"" + searchListETag(searchItemsMgr, snapshot) + "\", \"event\": ";
+	tail += JsonWriter::quote(eventName);
+	
+	std::string response = buildSearchListPayload(snapshot->body, tail);
+	STATS_RECORD("broadcastSearchListChange", ServiceStats::PayloadSize, response.size());
+
+	// Find out which handle this subscription needs to go to
+	bool retVal = LSSubscriptionAcquire(m_serviceHandlePrivate, "getUniversalSearchList", &iter, &lserror);
+	if (retVal) {
+		lsHandle = m_serviceHandlePrivate;
+		while (LSSubscriptionHasNext(iter)) {
+			LSMessage *message = LSSubscriptionNext(iter);
+			receivers++;
+			if (!LSMessageReply(lsHandle,message,response.c_str(),&lserror)) {
+				LSErrorPrint(&lserror,stderr);
+				LSErrorFree(&lserror);
+			}
+		}
+
+		LSSubscriptionRelease(iter);
+	}
+	else {
+		LSErrorFree(&lserror);
+	}
+	
+	//Filtered subscribers get their own lists, built once per distinct request.
+	if (LSSubscriptionAcquire(m_serviceHandlePrivate, "getUniversalSearchListFiltered", &iter, &lserror)) {
+		std::map<std::string, std::string> responses;
+		
+		while (LSSubscriptionHasNext(iter)) {
+			LSMessage *message = LSSubscriptionNext(iter);
+			receivers++;
+			const char* payload = LSMessageGetPayload(message);
+			std::string& filtered = responses[payload ? payload : ""];
+			
+			if (filtered.empty()) {
+				SearchItemsManager::SearchListQuery query;
+				parseSearchListQuery(payload, query);
+				filtered = buildSearchListPayload(searchItemsMgr->getSearchListBody(query), tail);
+			}
+			
+			if (!LSMessageReply(m_serviceHandlePrivate, message, filtered.c_str(), &lserror)) {
+				LSErrorPrint(&lserror,stderr);
+				LSErrorFree(&lserror);
+			}
+		}
+		
+		LSSubscriptionRelease(iter);
+	}
+	else {
+		LSErrorFree(&lserror);
+	}
+	
+	if (m_deltaBaseValid && m_deltaBaseGeneration != snapshot->listGeneration) {
+		std::string changes;
+		std::string deltaTail = searchListGenerationMembers(searchItemsMgr, snapshot) + tail;
+		
+		//Fall back to the full lists if the steps were evicted or are larger.
+		if (searchItemsMgr->getSearchListChanges(m_deltaBaseGeneration, changes) && changes.size() < snapshot->body.size())
+			response = buildSearchListDeltaPayload(changes, deltaTail);
+		else
+			response = buildSearchListPayload(snapshot->body, deltaTail);
+		
+		if (LSSubscriptionAcquire(m_serviceHandlePrivate, "getUniversalSearchListDeltas", &iter, &lserror)) {
+			while (LSSubscriptionHasNext(iter)) {
+				LSMessage *message = LSSubscriptionNext(iter);
+				receivers++;
+				if (!LSMessageReply(m_serviceHandlePrivate, message, response.c_str(), &lserror)) {
+					LSErrorPrint(&lserror,stderr);
+					LSErrorFree(&lserror);
+				}
+			}
+			
+			LSSubscriptionRelease(iter);
+		}
+		else {
+			LSErrorFree(&lserror);
+		}
+	}
+	
+	if (m_deltaBaseValid)
+		m_deltaBaseGeneration = snapshot->listGeneration;
+	
+	m_searchListPosted = true;
+	m_postedSearchListGeneration = snapshot->listGeneration;
+	
+	STATS_RECORD("broadcastSearchListChange", ServiceStats::Subscribers, receivers);
+}
+
+/*!
+\page com_palm_universalsearch
+\n
+\section com_palm_universalsearch_get_stats getStats
+
+\e Private.
+
+com.palm.universalsearch/getStats
 
+Get the runtime statistics of the service: latency histograms of the methods and callbacks,
+payload size and subscriber count histograms, and counters such as the SQLite calls.
+
+\subsection com_palm_universalsearch_get_stats_syntax Syntax:
+\code
+{
+    "reset": boolean
 }
+\endcode
 
-void UniversalSearchService::postSearchListChange(const char* eventName)
+\param reset Set to true to clear the statistics after they have been returned.
+
+\subsection com_palm_universalsearch_get_stats_returns Returns:
+\code
+{
+    "returnValue": boolean,
+    "stats": {
+        "periodMs": int,
+        "latency": object,
+        "payloadSize": object,
+        "subscribers": object,
+        "counters": object,
+        "strings": object
+    }
+}
+\endcode
+
+\param returnValue Indicates if the call was succesful.
+\param periodMs Time since the statistics were last reset.
+\param latency Per method or callback: "count", "mean" and "max" in microseconds, and a "histogram" array of
+{ "below", "count" } buckets with power of two bounds.
+\param payloadSize Same as \e latency, for the size in bytes of replies and broadcasts.
+\param subscribers Same as \e latency, for the number of subscribers that received a broadcast.
+\param counters Number of calls, for example of each database operation.
+\param strings The interned strings of the provider items: "strings" and "references" (handles to them),
+"internedBytes" taken by the pool and "rawBytes" that a copy per item would take. Not cleared by \e reset.
+
+\subsection com_palm_universalsearch_get_stats_examples Examples:
+\code
+luna-send -n 1 -f luna://com.palm.universalsearch/getStats '{ "reset": true }'
+\endcode
+
+Example response for a succesful call:
+\code
+{
+    "returnValue": true,
+    "stats": {
+        "periodMs": 60000,
+        "latency": {
+            "getUniversalSearchList": {
+                "count": 3,
+                "max": 410,
+                "mean": 180,
+                "histogram": [
+                    { "below": 128, "count": 2 },
+                    { "below": 512, "count": 1 }
+                ]
+            }
+        },
+        "payloadSize": { },
+        "subscribers": { },
+        "counters": {
+            "sqlite.getSearchPreference": 3
+        },
+        "strings": {
+            "strings": 212,
+            "references": 1347,
+            "internedBytes": 9410,
+            "rawBytes": 41873
+        }
+    }
+}
+\endcode
+*/
+static bool cbGetStats(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
-	LSSubscriptionIter *iter=NULL;
 	LSError lserror;
-	LSHandle * lsHandle;
-		
+	json_object* response = json_object_new_object();
+	json_object* stats = NULL;
+	json_object* root = NULL;
+	json_object* label = NULL;
+	bool reset = false;
+	
 	LSErrorInit(&lserror);
 	
-	std::string defaultSearchEngineValue;
+	const char* payload = LSMessageGetPayload(message);
+	if (payload) {
+		root = json_tokener_parse(payload);
+		if (root && !is_error(root)) {
+			label = json_object_object_get(root, "reset");
+			if (label && !is_error(label))
+				reset = json_object_get_boolean(label);
+			json_object_put(root);
+		}
+	}
 	
-	json_object* response = json_object_new_object();
+	stats = ServiceStats::instance()->toJson();
+	json_object_object_add(stats, "strings", StringPool::instance()->toJson());
 	json_object_object_add (response, "returnValue", json_object_new_boolean (true));
-	json_object_object_add(response, (char*) "UniversalSearchList", UniversalSearchService::instance()->searchItemsMgr->getSearchList());
-	json_object_object_add(response, (char*) "ActionList", UniversalSearchService::instance()->searchItemsMgr->getActionProvidersList());
-	json_object_object_add(response, (char*) "DBSearchItemList", UniversalSearchService::instance()->searchItemsMgr->getDBSearchItemList());
+	json_object_object_add (response, "stats", stats);
 	
-	defaultSearchEngineValue = UniversalSearchPrefsDb::instance()->getSearchPreference("defaultSearchEngine");
-	json_object_object_add (response, "defaultSearchEngine", json_object_new_string (defaultSearchEngineValue.c_str()));
+	if (reset)
+		ServiceStats::instance()->reset();
 	
-	json_object_object_add (response, "event", json_object_new_string (eventName));
-
-	// Find out which handle this subscription needs to go to
-	bool retVal = LSSubscriptionAcquire(m_serviceHandlePrivate, "getUniversalSearchList", &iter, &lserror);
-	if (retVal) {
-		lsHandle = m_serviceHandlePrivate;
-		while (LSSubscriptionHasNext(iter)) {
-			LSMessage *message = LSSubscriptionNext(iter);
-			if (!LSMessageReply(lsHandle,message,json_object_to_json_string (response),&lserror)) {
-				LSErrorPrint(&lserror,stderr);
-				LSErrorFree(&lserror);
-			}
-		}
-
-		LSSubscriptionRelease(iter);
-	}
-	else {
+	if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
+		LSErrorPrint (&lserror, stderr);
 		LSErrorFree(&lserror);
 	}
 	
 	json_object_put(response);
+	return true;
 }
 
 /*!
@@ -1381,6 +2029,8 @@ Example response for a failed call:
 
 bool cbGetSearchPreference(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("getSearchPreference");
+	BUS_CAPTURE("getSearchPreference", message);
 	LSError lserror;
 	std::string key;
 	std::string value;
@@ -1490,32 +2140,29 @@ Example response for a succesful call:
 
 bool cbGetAllSearchPreference(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("getAllSearchPreference");
+	BUS_CAPTURE("getAllSearchPreference", message);
 	LSError lserror;
-	std::string key;
-	std::string value;
+	std::string result;
 	bool subscribed = false;
-	bool success = true;
 		
 	LSErrorInit(&lserror);
 			
-	json_object* response = json_object_new_object();
 	json_object* root = NULL;
 	
 	const char* payload = LSMessageGetPayload(message);
 		
 	if(!payload) {
 		luna_critical(s_logChannel, "Payload is missing");
-		success = false;
 		goto Done;
 	}
 	
 	root = json_tokener_parse(payload);
 	if(!root || is_error(root)) {
 		luna_critical(s_logChannel, "unable to parse the json message");
-		success = false;
+		root = NULL;
 		goto Done;
 	}
-	value = UniversalSearchPrefsDb::instance()->getAllSearchPreference(response);
 
 	if (LSMessageIsSubscription(message)) {		
 		if (!LSSubscriptionAdd(lshandle, "getAllSearchPreference",
@@ -1527,21 +2174,25 @@ bool cbGetAllSearchPreference(LSHandle* lshandle, LSMessage *message, void *user
 			subscribed = true;
 	}
 	
-	json_object_object_add(response, (char*) "subscribed", json_object_new_boolean(subscribed));
+	//The preferences come serialized already, only the envelope is built per call.
+	result = "{ \"SearchPreference\": " + UniversalSearchPrefsDb::instance()->getAllSearchPreferenceJson();
+	result += subscribed ? ", \"subscribed\": true" : ", \"subscribed\": false";
+	result += ", \"returnValue\": true }";
 	
 	Done:
 		
-		json_object_object_add (response, (char*) "returnValue", json_object_new_boolean (success));
+		if (result.empty())
+			result = "{ \"returnValue\": false }";
 		
-		if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
+		if (!LSMessageReply( lshandle, message, result.c_str(), &lserror )) 	{
 	    	LSErrorPrint (&lserror, stderr);
 	    	LSErrorFree(&lserror);
 		}
 	
-		json_object_put(response);
+		if (root)
+			json_object_put(root);
 	return true;
 
-	
 }
 
 /*!
@@ -1564,16 +2215,18 @@ Add a new or change an existing search preference.
 \endcode
 
 \param key Key for the preference.
-\param value Value for the preference.
+\param value Value for the preference. A value that is not a string is stored as its JSON text.
 
 \subsection com_palm_universalsearch_set_search_preference_returns Returns:
 \code
 {
-    "returnValue": boolean
+    "returnValue": boolean,
+    "errorMessage": string
 }
 \endcode
 
 \param returnValue Indicates if the call was succesful.
+\param errorMessage What is wrong with the payload, if it could not be decoded.
 
 \subsection com_palm_universalsearch_set_search_preference_examples Examples:
 \code
@@ -1593,55 +2246,33 @@ Example response for a failed call:
 */
 bool cbSetSearchPreference(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("setSearchPreference");
+	BUS_CAPTURE("setSearchPreference", message);
 	LSError lserror;
-	std::string key;
-	std::string value;
+	RequestArena arena;
+	DecodedPayload<SearchPreferencePayload> request(arena);
+	std::string errorText;
 	bool success = true;
 		
 	LSErrorInit(&lserror);
 			
 	json_object* response = json_object_new_object();
-	json_object* root = NULL;
-	json_object* label = NULL;
-	
-	const char* payload = LSMessageGetPayload(message);
-		
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
-		success = false;
-		goto Done;
-	}
-	
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "unable to parse the json message");
-		success = false;
-		goto Done;
-	}
-	
-	//check the key
-	label = json_object_object_get(root, "key");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "key field is missing");
-		success = false;
-		goto Done;
-	}
-	key = json_object_get_string(label);
 	
-	label = json_object_object_get(root, "value");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "value field is missing");
+	if(!request.decode(LSMessageGetPayload(message), errorText)) {
+		luna_critical(s_logChannel, "Invalid payload: %s", errorText.c_str());
 		success = false;
 		goto Done;
 	}
-	value = json_object_get_string(label);
 	
-	success = UniversalSearchPrefsDb::instance()->setSearchPreference(key, value);
+	success = UniversalSearchPrefsDb::instance()->setSearchPreference(request[SearchPreferencePayload::key].str(),
+			request[SearchPreferencePayload::value].str());
 
 	
 	Done:
 		
 		json_object_object_add (response, "returnValue", json_object_new_boolean (success));
+		if (!errorText.empty())
+			json_object_object_add (response, "errorMessage", json_object_new_string (errorText.c_str()));
 		
 		if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
 	    	LSErrorPrint (&lserror, stderr);
@@ -1656,18 +2287,18 @@ bool cbSetSearchPreference(LSHandle* lshandle, LSMessage *message, void *user_da
 
 }
 
-void UniversalSearchService::postSearchPreferenceChange() 
+void UniversalSearchService::broadcastSearchPreferenceChange()
 {
+	STATS_SCOPE("broadcastSearchPreferenceChange");
+	int receivers = 0;
 	LSSubscriptionIter *iter=NULL;
 	LSError lserror;
 	LSHandle * lsHandle;
 		
 	LSErrorInit(&lserror);
 	
-	json_object* response = json_object_new_object();
-	json_object_object_add (response, "returnValue", json_object_new_boolean (true));
-	
-	UniversalSearchPrefsDb::instance()->getAllSearchPreference(response);
+	std::string response = "{ \"returnValue\": true, \"SearchPreference\": "
+		+ UniversalSearchPrefsDb::instance()->getAllSearchPreferenceJson() + " }";
 	
 	// Find out which handle this subscription needs to go to
 	bool retVal = LSSubscriptionAcquire(m_serviceHandlePrivate, "getAllSearchPreference", &iter, &lserror);
@@ -1675,7 +2306,8 @@ void UniversalSearchService::postSearchPreferenceChange()
 		lsHandle = m_serviceHandlePrivate;
 		while (LSSubscriptionHasNext(iter)) {
 			LSMessage *message = LSSubscriptionNext(iter);
-			if (!LSMessageReply(lsHandle,message,json_object_to_json_string (response),&lserror)) {
+			receivers++;
+			if (!LSMessageReply(lsHandle,message,response.c_str(),&lserror)) {
 				LSErrorPrint(&lserror,stderr);
 				LSErrorFree(&lserror);
 			}
@@ -1687,8 +2319,7 @@ void UniversalSearchService::postSearchPreferenceChange()
 		LSErrorFree(&lserror);
 	}
 	
-	json_object_put(response);
-
+	STATS_RECORD("broadcastSearchPreferenceChange", ServiceStats::Subscribers, receivers);
 }
 /*
 void UniversalSearchService::postServiceListChange() 
@@ -1879,6 +2510,8 @@ static bool cbRemoveSearchService(LSHandle* lshandle, LSMessage *message, void *
 */
 bool UniversalSearchService::cbSysServiceBusStatusNotification(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("cbSysServiceBusStatusNotification");
+	BUS_CAPTURE("cbSysServiceBusStatusNotification", message);
 	LSError lsError;
 	LSErrorInit(&lsError);
 	
@@ -1921,6 +2554,8 @@ bool UniversalSearchService::cbSysServiceBusStatusNotification(LSHandle* lshandl
 
 bool UniversalSearchService::cbGetLocalePref(LSHandle* lshandle, LSMessage *message,void *user_data)
 {
+	STATS_SCOPE("cbGetLocalePref");
+	BUS_CAPTURE("cbGetLocalePref", message);
 	LSError lserror;
 	LSErrorInit(&lserror);
 	
@@ -1935,6 +2570,11 @@ bool UniversalSearchService::cbGetLocalePref(LSHandle* lshandle, LSMessage *mess
 	
 	bool success = true;
 	
+	//A change that comes before the first locale has been merged is handled after it.
+	if (!UniversalSearchService::instance()->getLocale().empty()
+			&& UniversalSearchService::instance()->m_startupPipeline->deferUntilReady(lshandle, message, cbGetLocalePref))
+		return true;
+	
 	const char* payload = LSMessageGetPayload(message);
 	if( !payload ) {
 		success = false;
@@ -1985,19 +2625,14 @@ bool UniversalSearchService::cbGetLocalePref(LSHandle* lshandle, LSMessage *mess
 		//First time query. m_locale is empty.
 		if(UniversalSearchService::instance()->getLocale().empty()) {
 			UniversalSearchService::instance()->setLocale(newLocale);
-			luna_critical(s_logChannel, "Got the locale %s --- calling init functions ", newLocale.c_str());
-			//Call the init functions..
-			UniversalSearchService::instance()->searchItemsMgr->init();
-			UniversalSearchService::instance()->openSearchHandler->scanExistingPlugins();
-			UniversalSearchService::instance()->postInit();
+			luna_critical(s_logChannel, "Got the locale %s --- merging the locale resources ", newLocale.c_str());
+			//The pipeline switches the database to the locale's partition.
+			UniversalSearchService::instance()->m_startupPipeline->localeKnown();
 		}
 		else {
 			if(UniversalSearchService::instance()->getLocale() != newLocale) {
-				luna_critical(s_logChannel, "Locale Changed from  %s :: to %s - shutting down... ", UniversalSearchService::instance()->getLocale().c_str(), newLocale.c_str());
-				//locale changed. wipe out the database and quit!!!.
-				UniversalSearchPrefsDb::instance()->purgeDatabase();
-			
-				exit(0);
+				luna_critical(s_logChannel, "Locale Changed from  %s :: to %s ", UniversalSearchService::instance()->getLocale().c_str(), newLocale.c_str());
+				UniversalSearchService::instance()->switchLocale(newLocale);
 			}
 		}
 
@@ -2006,6 +2641,8 @@ bool UniversalSearchService::cbGetLocalePref(LSHandle* lshandle, LSMessage *mess
 
 bool UniversalSearchService::cbAppMgrBusStatusNotification(LSHandle* lshandle, LSMessage *message,void *user_data) 
 {
+	STATS_SCOPE("cbAppMgrBusStatusNotification");
+	BUS_CAPTURE("cbAppMgrBusStatusNotification", message);
 	
 	LSError lsError;
 	LSErrorInit(&lsError);
@@ -2046,122 +2683,141 @@ bool UniversalSearchService::cbAppMgrBusStatusNotification(LSHandle* lshandle, L
 	return true;
 }
 
-bool UniversalSearchService::cbAppMgrAppList(LSHandle* lshandle, LSMessage *message,void *user_data) 
+/*
+ * Adds the items of an app's universalSearch block. Each item takes the app id, search
+ * and action items take it as their url too, and the app icon is the default
+ * iconFilePath. Like the items themselves, the block is read with skipUnknown set.
+ * Returns true only if every item was decoded and added.
+ */
+static bool addAppSearchItems(SearchItemsManager* manager, const PayloadValue& universalSearch,
+		const std::string& id, const std::string& icon, RequestArena& arena)
 {
-	LSError lserror;
-	LSErrorInit(&lserror);
-	json_object* label = NULL; 
-	json_object* root = NULL;
-	json_object* app = NULL;
-	json_object* searchInfo = NULL;
-	array_list* apps;
-	std::string emailId;
-	std::string id;
-	std::string icon;
+	static const char* s_categories[] = { "search", "action", "dbsearch" };
+	static const int s_blocks[] = { AppSearchItemsPayload::search, AppSearchItemsPayload::action, AppSearchItemsPayload::dbsearch };
+	DecodedPayload<AppSearchItemsPayload> blocks(arena);
+	std::string error;
 	bool success = true;
-	
-	const char* payload = LSMessageGetPayload(message);		
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
-		success = false;
-		goto Done;
-	}
-	
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Unable to parse json content");
-		success = false;
-		goto Done;
+
+	if(!blocks.decode(universalSearch, error, true)) {
+		luna_critical(s_logChannel, "Invalid universalSearch of %s: %s", id.c_str(), error.c_str());
+		return false;
 	}
-	
-	label = json_object_object_get(root, "apps");
-	if(!label || is_error(label)) {
-		luna_critical(s_logChannel, "apps is missing");
-		success = false;
-		goto Done;
+
+	for(int i = 0; i < 3; i++) {
+		const PayloadValue& block = blocks[s_blocks[i]];
+		ItemRequest item(arena);
+
+		if(!block.present())
+			continue;
+
+		if(!item.decode(block, error, true)) {
+			luna_critical(s_logChannel, "Invalid %s item of %s: %s", s_categories[i], id.c_str(), error.c_str());
+			success = false;
+			continue;
+		}
+
+		item.set(ItemPayload::id, id);
+		//For apps, override the value of "url" property to set AppId value.
+		if(s_blocks[i] != AppSearchItemsPayload::dbsearch)
+			item.set(ItemPayload::url, id);
+		if(s_blocks[i] == AppSearchItemsPayload::search)
+			item.set(ItemPayload::type, "app");
+		if(!item[ItemPayload::iconFilePath].present())
+			item.set(ItemPayload::iconFilePath, icon);
+
+		success = manager->addItem(s_categories[i], item, true, true, true) && success;
 	}
-	apps = json_object_get_array(label);
-	if(!apps) {
-		luna_critical(s_logChannel, "unable to get apps array from the payload");
-		success = false;
-		goto Done;
+
+	return success;
+}
+
+bool UniversalSearchService::cbAppMgrAppList(LSHandle* lshandle, LSMessage *message,void *user_data) 
+{
+	STATS_SCOPE("cbAppMgrAppList");
+	BUS_CAPTURE("cbAppMgrAppList", message);
+	if (UniversalSearchService::instance()->m_startupPipeline->deferUntilReady(lshandle, message, cbAppMgrAppList))
+		return true;
+
+	RequestArena arena;
+	DecodedPayload<AppListPayload> reply(arena);
+	DecodedPayload<AppPayload> app(arena);
+	PayloadValue element;
+	std::string error;
+	std::string id;
+	std::string icon;
+	std::string hash;
+	std::set<std::string> installedAppIds;
+	SearchItemsManager* manager = UniversalSearchService::instance()->searchItemsMgr;
+	bool transaction;
+	
+	//Only the members below are read; the rest of each app is skipped over.
+	if(!reply.decode(LSMessageGetPayload(message), error, true)) {
+		luna_critical(s_logChannel, "Invalid listApps reply: %s", error.c_str());
+		return false;
 	}
 	
-	for (int i = 0; i < array_list_length(apps); i++) {
-		json_object* obj = (json_object*) array_list_get_idx(apps, i);
-
+	PayloadArrayReader apps(reply[AppListPayload::apps], arena);
+	while (apps.next(element)) {
 		//Check appId and Vendor defined in the appInfo. If so, copy those properties into UniversalSearch property.
-		label = json_object_object_get(obj, "id");
-		if(!label || is_error(label))
+		if(!app.decode(element, error, true) || !app[AppPayload::id].present())
 			continue;
-		id = json_object_get_string(label);
+		id = app[AppPayload::id].str();
+		installedAppIds.insert(id);
 	
 		//check if the appInfo object has UniversalSearch property defined.
-		app = json_object_object_get(obj, "universalSearch");
-		if(!app || is_error(app)) {
+		if(!app[AppPayload::universalSearch].present()) {
+			if(manager->isAppWithoutDescriptor(id)) {
+				STATS_COUNT("appList.withoutDescriptor");
+				continue;
+			}
 			//We need to check whether this app was supporting JustType previously. If yes and exist in the list then remove it.
-			if(UniversalSearchService::instance()->searchItemsMgr->isItemExist(id)) {
-				UniversalSearchService::instance()->searchItemsMgr->removeSearchItem(json_object_get_string(obj));
-				UniversalSearchService::instance()->searchItemsMgr->removeActionProvider(json_object_get_string(obj));
-				UniversalSearchService::instance()->searchItemsMgr->removeDBSearchItem(json_object_get_string(obj));
+			if(manager->isItemExist(id)) {
+				manager->removeItem("search", id);
+				manager->removeItem("action", id);
+				manager->removeItem("dbsearch", id);
 			}
+			manager->setAppDescriptorHash(id, "");
 			continue;
 		}
 		
 		//Get the icon from app descriptor
-		label = json_object_object_get(obj, "icon");
-		if(label && !is_error(label))
-			icon = json_object_get_string(label);
+		icon = app[AppPayload::icon].str();
 		
-		//Is Search item exist?
-		searchInfo = json_object_object_get(app, "search");
-		if(searchInfo && !is_error(searchInfo)) {
-			json_object_object_add(searchInfo, "id", json_object_new_string(id.c_str()));
-			//For apps, override the value of "url" property to set AppId value.
-			json_object_object_add(searchInfo, "url", json_object_new_string(id.c_str()));
-			json_object_object_add(searchInfo, "type", json_object_new_string("app"));
-			label = json_object_object_get(searchInfo, "iconFilePath");
-			if(!label || is_error(label)) {
-				json_object_object_add(searchInfo, "iconFilePath", json_object_new_string(icon.c_str()));
-			}
-			UniversalSearchService::instance()->searchItemsMgr->addSearchItem(json_object_get_string(searchInfo), true, true,true);
-		}
-		
-		//Is Action item exist?
-		searchInfo = json_object_object_get(app, "action");
-		if(searchInfo && !is_error(searchInfo)) {
-			json_object_object_add(searchInfo, "id", json_object_new_string(id.c_str()));
-			//For apps, override the value of "url" property to set AppId value.
-			json_object_object_add(searchInfo, "url", json_object_new_string(id.c_str()));
-			label = json_object_object_get(searchInfo, "iconFilePath");
-			if(!label || is_error(label)) {
-				json_object_object_add(searchInfo, "iconFilePath", json_object_new_string(icon.c_str()));
-			}
-			UniversalSearchService::instance()->searchItemsMgr->addActionProvider(json_object_get_string(searchInfo), true, true, true);
+		//Unchanged apps keep their items.
+		hash = SearchItemsManager::appDescriptorHash(app[AppPayload::universalSearch].str(), icon);
+		if(manager->isAppDescriptorUnchanged(id, hash)) {
+			manager->markAppItemsExist(id);
+			STATS_COUNT("appList.unchanged");
+			continue;
 		}
+		STATS_COUNT("appList.reconciled");
 		
-		//Is MojoDb Search item exist?
-		searchInfo = json_object_object_get(app, "dbsearch");
-		if(searchInfo && !is_error(searchInfo)) {
-			json_object_object_add(searchInfo, "id", json_object_new_string(id.c_str()));
-			label = json_object_object_get(searchInfo, "iconFilePath");
-			if(!label || is_error(label)) {
-				json_object_object_add(searchInfo, "iconFilePath", json_object_new_string(icon.c_str()));
-			}
-			UniversalSearchService::instance()->searchItemsMgr->addDBSearchItem(json_object_get_string(searchInfo), true, true,true);
-		}
+		/*
+		 * The items and the hash go to the database as one unit, so a row that fails to
+		 * be written cannot leave the hash behind. The hash is only kept if every item
+		 * was added; otherwise the app is reconciled again next time, and an item that
+		 * was rejected is rejected again rather than coming back from its old row.
+		 */
+		transaction = UniversalSearchPrefsDb::instance()->beginTransaction();
+		if(addAppSearchItems(manager, app[AppPayload::universalSearch], id, icon, arena))
+			manager->setAppDescriptorHash(id, hash);
+		else
+			manager->forgetAppDescriptor(id);
+		if(transaction)
+			UniversalSearchPrefsDb::instance()->commitTransaction();
+	}
+	
+	//The apps after a broken element are unknown; they must not be taken as removed.
+	if(!apps.error().empty()) {
+		luna_critical(s_logChannel, "Invalid listApps reply: %s", apps.error().c_str());
+		return false;
 	}
 
-	UniversalSearchService::instance()->searchItemsMgr->checkIntegrity();
-				
-	Done:
-	
-		if (root && !is_error(root))
-			json_object_put(root);
-	
-		if(!success) {
-			return false;
-		}
+	manager->forgetMissingApps(installedAppIds);
+	manager->checkIntegrity();
+	//Toggles from before a locale switch, for the app items that are back now.
+	manager->applyCarriedEnabledStates();
+	manager->scheduleCatalogueSave();
 
 	return true;
 	
@@ -2169,6 +2825,8 @@ bool UniversalSearchService::cbAppMgrAppList(LSHandle* lshandle, LSMessage *mess
 
 bool UniversalSearchService::cbAppInstallerBusStatusNotification(LSHandle* lshandle, LSMessage *message,void *user_data) 
 {
+	STATS_SCOPE("cbAppInstallerBusStatusNotification");
+	BUS_CAPTURE("cbAppInstallerBusStatusNotification", message);
 	LSError lsError;
 	LSErrorInit(&lsError);
 	
@@ -2211,6 +2869,11 @@ bool UniversalSearchService::cbAppInstallerBusStatusNotification(LSHandle* lshan
 
 bool UniversalSearchService::cbAppInstallerNotifyOnChange(LSHandle* lshandle, LSMessage *message,void *user_data)
 {
+	STATS_SCOPE("cbAppInstallerNotifyOnChange");
+	BUS_CAPTURE("cbAppInstallerNotifyOnChange", message);
+	if (UniversalSearchService::instance()->m_startupPipeline->deferUntilReady(lshandle, message, cbAppInstallerNotifyOnChange))
+		return true;
+
 	json_object* label = NULL; 
 	json_object* root = NULL;
 	json_object* params = json_object_new_object();
@@ -2264,9 +2927,9 @@ bool UniversalSearchService::cbAppInstallerNotifyOnChange(LSHandle* lshandle, LS
 		if(UniversalSearchService::instance()->searchItemsMgr->isItemExist(appId)) {
 			//App has been removed. Remove the Search entry from all 3 lists.
 			json_object_object_add(root, "id", json_object_new_string(appId.c_str()));
-			UniversalSearchService::instance()->searchItemsMgr->removeSearchItem(json_object_get_string(root));
-			UniversalSearchService::instance()->searchItemsMgr->removeActionProvider(json_object_get_string(root));
-			UniversalSearchService::instance()->searchItemsMgr->removeDBSearchItem(json_object_get_string(root));
+			UniversalSearchService::instance()->searchItemsMgr->removeSearchItem(root);
+			UniversalSearchService::instance()->searchItemsMgr->removeActionProvider(root);
+			UniversalSearchService::instance()->searchItemsMgr->removeDBSearchItem(root);
 			
 			luna_critical(s_logChannel, "Posting change notificaiton");
 			UniversalSearchService::instance()->postSearchListChange("remove");
@@ -2292,54 +2955,37 @@ bool UniversalSearchService::cbAppInstallerNotifyOnChange(LSHandle* lshandle, LS
 
 bool UniversalSearchService::cbAppMgrGetAppInfo(LSHandle* lshandle, LSMessage *message,void *user_data)
 {
-	LSError lserror;
-	LSErrorInit(&lserror);
-	json_object* label = NULL; 
-	json_object* root = NULL;
-	json_object* appInfo = NULL;
-	json_object* searchInfo = NULL;
-	json_object* iconProp = NULL;
+	STATS_SCOPE("cbAppMgrGetAppInfo");
+	BUS_CAPTURE("cbAppMgrGetAppInfo", message);
+	RequestArena arena;
+	DecodedPayload<AppInfoPayload> reply(arena);
+	DecodedPayload<AppPayload> appInfo(arena);
+	SearchItemsManager* manager = UniversalSearchService::instance()->searchItemsMgr;
+	std::string error;
 	std::string id;
-	std::string icon;
 	bool success = true;
 	
-	const char* payload = LSMessageGetPayload(message);		
-	if(!payload) {
-		luna_critical(s_logChannel, "Payload is missing");
-		success = false;
-		goto Done;
-	}
-	
-	root = json_tokener_parse(payload);
-	if(!root || is_error(root)) {
-		luna_critical(s_logChannel, "Unable to parse json content");
-		success = false;
-		goto Done;
-	}
-	
-	appInfo = json_object_object_get(root, "appInfo");
-	if(!appInfo || is_error(appInfo)) {
-		luna_critical(s_logChannel, "appInfo is missing");
+	if(!reply.decode(LSMessageGetPayload(message), error, true) ||
+			!appInfo.decode(reply[AppInfoPayload::appInfo], error, true)) {
+		luna_critical(s_logChannel, "Invalid getAppInfo reply: %s", error.c_str());
 		success = false;
 		goto Done;
 	}
 
 	//Get the AppId.
-	label = json_object_object_get(appInfo, "id");
-	if(!label || is_error(label)) {
+	if(!appInfo[AppPayload::id].present()) {
 		success = false;
 		goto Done;
 	}
 		
-	id = json_object_get_string(label);
+	id = appInfo[AppPayload::id].str();
 
-	searchInfo = json_object_object_get(appInfo, "universalSearch");
-	if(!searchInfo || is_error(searchInfo)) {
-		if(UniversalSearchService::instance()->searchItemsMgr->isItemExist(id)) {
+	if(!appInfo[AppPayload::universalSearch].present()) {
+		if(manager->isItemExist(id)) {
 			//App has been removed. Remove the Search entry from all 3 lists.
-			UniversalSearchService::instance()->searchItemsMgr->removeSearchItem(json_object_get_string(appInfo));
-			UniversalSearchService::instance()->searchItemsMgr->removeActionProvider(json_object_get_string(appInfo));
-			UniversalSearchService::instance()->searchItemsMgr->removeDBSearchItem(json_object_get_string(appInfo));
+			manager->removeItem("search", id);
+			manager->removeItem("action", id);
+			manager->removeItem("dbsearch", id);
 
 			luna_critical(s_logChannel, "Posting change notificaiton");
 			UniversalSearchService::instance()->postSearchListChange("remove");
@@ -2348,55 +2994,11 @@ bool UniversalSearchService::cbAppMgrGetAppInfo(LSHandle* lshandle, LSMessage *m
 		goto Done;
 	}
 	
-	//Property exist. Check appId and Vendor defined in the appInfo. If so, copy those properties into UniversalSearch property.
-	//Get the icon from app descriptor
-	label = json_object_object_get(appInfo, "icon");
-	if(label && !is_error(label))
-		icon = json_object_get_string(label);
-	
-	//Is Search item exist?
-	label = json_object_object_get(searchInfo, "search");
-	if(label && !is_error(label)) {
-		json_object_object_add(label, "id", json_object_new_string(id.c_str()));
-		//For apps, override the value of "url" property to set AppId value.
-		json_object_object_add(label, "url", json_object_new_string(id.c_str()));
-		json_object_object_add(label, "type", json_object_new_string("app"));
-		iconProp = json_object_object_get(label, "iconFilePath");
-		if(!iconProp || is_error(iconProp)) {
-			json_object_object_add(label, "iconFilePath", json_object_new_string(icon.c_str()));
-		}
-		success = UniversalSearchService::instance()->searchItemsMgr->addSearchItem(json_object_get_string(label), true, true,true);
-	}
-	
-	//Is Action item exist?
-	label = json_object_object_get(searchInfo, "action");
-	if(label && !is_error(label)) {
-		json_object_object_add(label, "id", json_object_new_string(id.c_str()));
-		//For apps, override the value of "url" property to set AppId value.
-		json_object_object_add(label, "url", json_object_new_string(id.c_str()));
-		iconProp = json_object_object_get(label, "iconFilePath");
-		if(!iconProp || is_error(iconProp)) {
-			json_object_object_add(label, "iconFilePath", json_object_new_string(icon.c_str()));
-		}
-		success = UniversalSearchService::instance()->searchItemsMgr->addActionProvider(json_object_get_string(label), true, true, true);
-	}
-	
-	//Is MojoDb Search item exist?
-	label = json_object_object_get(searchInfo, "dbsearch");
-	if(label && !is_error(label)) {
-		json_object_object_add(label, "id", json_object_new_string(id.c_str()));
-		iconProp = json_object_object_get(label, "iconFilePath");
-		if(!iconProp || is_error(iconProp)) {
-			json_object_object_add(label, "iconFilePath", json_object_new_string(icon.c_str()));
-		}
-		success = UniversalSearchService::instance()->searchItemsMgr->addDBSearchItem(json_object_get_string(label), true, true,true);
-	}
+	//Property exist. Add its items, with the icon from app descriptor.
+	success = addAppSearchItems(manager, appInfo[AppPayload::universalSearch], id, appInfo[AppPayload::icon].str(), arena);
 	
 	Done:
 	
-		if (root && !is_error(root))
-			json_object_put(root);
-	
 		if(!success) {
 			return false;
 		}
@@ -2463,35 +3065,23 @@ Example response for a failed call:
 */
 static bool cbAddOptionalSearchDesc(LSHandle* lshandle, LSMessage *message, void *user_data) 
 {
+	STATS_SCOPE("addOptionalSearchDesc");
+	BUS_CAPTURE("addOptionalSearchDesc", message);
     LSError lserror;
     LSErrorInit(&lserror);
     bool success = false;
 
-    const char* payload = NULL;
-    json_object *root = NULL, *label = NULL, *response = NULL;
+    RequestArena arena;
+    DecodedPayload<OptionalSearchDescPayload> request(arena);
+    json_object *response = NULL;
     std::string errMsg;
     std::string xmlUrl;
     char* uriScheme;
 
-    payload = LSMessageGetPayload (message);
-    if (!payload) {
-	errMsg = "No payload, ignoring call";
-	goto done;
-    }
-
-    root = json_tokener_parse (payload);
-    if (!root || is_error (root)) {
-	errMsg = "Unable to parse payload, ignoring call";
-	goto done;
-    }
-
-    label = json_object_object_get (root, "xmlUrl");
-    if (!label || is_error (label)) {
-	errMsg = "No xmlUrl parameter, invalid call";
+    if (!request.decode (LSMessageGetPayload (message), errMsg))
 	goto done;
-    }
 
-    xmlUrl = json_object_get_string (label);
+    xmlUrl = request[OptionalSearchDescPayload::xmlUrl].str();
     if (xmlUrl.empty()) {
 	errMsg = "xmlUrl link does not exist";
 	goto done;
@@ -2536,9 +3126,6 @@ done:
        LSErrorFree(&lserror);
    }
 
-   if (root && !is_error (root))
-       json_object_put (root);
-
    json_object_put (response);
 
    return true;
@@ -2558,22 +3145,28 @@ Get the list of open optional searches.
 \subsection  com_palm_universalsearch_get_optional_search_list_syntax Syntax:
 \code
 {
-    "subscribe": boolean
+    "subscribe": boolean,
+    "ifNoneMatch": string
 }
 \endcode
 
 \param subscribe Set to true to receive notifications when items in the optional search list change.
+\param ifNoneMatch The \e etag of the list the caller already has. If the list is unchanged, \e Options is not returned.
 
 \subsection com_palm_universalsearch_get_optional_search_list_returns Returns:
 \code
 {
     "Options": [ array ],
+    "etag": string,
+    "notModified": boolean,
     "subscribed": boolean,
     "returnValue": boolean
 }
 \endcode
 
 \param Options An array containing the search options.
+\param etag Identifies this version of the list.
+\param notModified True if \e ifNoneMatch matched and \e Options was left out.
 \param subscribed True if subscribed to receive notifications when search preferences change.
 \param returnValue Indicates if the call was sucessful.
 
@@ -2594,9 +3187,25 @@ Example response for a succesful call:
 */
 static bool cbGetOptionalSearchList(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("getOptionalSearchList");
+	BUS_CAPTURE("getOptionalSearchList", message);
     LSError lserror;
     LSErrorInit(&lserror);
     bool subscribed = false;
+    std::string ifNoneMatch;
+    std::string etag = optionalSearchListETag();
+    JsonWriter response;
+    const char* payload = LSMessageGetPayload(message);
+    
+    if (payload) {
+    	json_object* root = json_tokener_parse(payload);
+    	if (root && !is_error(root)) {
+    		json_object* label = json_object_object_get(root, "ifNoneMatch");
+    		if (label && !is_error(label))
+    			ifNoneMatch = json_object_get_string(label);
+    		json_object_put(root);
+    	}
+    }
     
     if (LSMessageIsSubscription(message)) {		
     		if (!LSSubscriptionAdd(lshandle, "getOptionalSearchList",
@@ -2608,18 +3217,22 @@ static bool cbGetOptionalSearchList(LSHandle* lshandle, LSMessage *message, void
     			subscribed = true;
     }
 
-    json_object* response = OpenSearchHandler::instance()->getOpenSearchList();
+    response.beginObject();
+    if (!ifNoneMatch.empty() && ifNoneMatch == etag)
+    	response.key("notModified").value(true);
+    else
+    	OpenSearchHandler::instance()->writeOpenSearchList(response);
     
-    json_object_object_add(response, (char*) "subscribed", json_object_new_boolean(subscribed));
-    json_object_object_add (response, "returnValue", json_object_new_boolean (true));
+    response.key("etag").value(etag);
+    response.key("subscribed").value(subscribed);
+    response.key("returnValue").value(true);
+    response.endObject();
 
-    if (!LSMessageReply( lshandle, message, json_object_to_json_string (response), &lserror )) 	{
+    if (!LSMessageReply( lshandle, message, response.str().c_str(), &lserror )) 	{
 	LSErrorPrint (&lserror, stderr);
 	LSErrorFree(&lserror);
     }
 
-    json_object_put (response);
-
     return true;
 }
 
@@ -2663,6 +3276,8 @@ Example response for a succesful call:
 */
 static bool cbClearOptionalSearchList(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("clearOptionalSearchList");
+	BUS_CAPTURE("clearOptionalSearchList", message);
     LSError lserror;
     LSErrorInit(&lserror);
     bool postSearchListUpdate = false;
@@ -2687,8 +3302,10 @@ static bool cbClearOptionalSearchList(LSHandle* lshandle, LSMessage *message, vo
     return true;
 }
 
-void UniversalSearchService::postOptionalSearchListChange() 
+void UniversalSearchService::broadcastOptionalSearchListChange()
 {
+	STATS_SCOPE("broadcastOptionalSearchListChange");
+	int receivers = 0;
 	LSSubscriptionIter *iter=NULL;
 
 	LSError lserror;
@@ -2696,8 +3313,12 @@ void UniversalSearchService::postOptionalSearchListChange()
 		
 	LSErrorInit(&lserror);
 	
-	json_object* response = OpenSearchHandler::instance()->getOpenSearchList();
-	json_object_object_add (response, "returnValue", json_object_new_boolean (true));
+	JsonWriter response;
+	response.beginObject();
+	OpenSearchHandler::instance()->writeOpenSearchList(response);
+	response.key("etag").value(optionalSearchListETag());
+	response.key("returnValue").value(true);
+	response.endObject();
 	
 	// Find out which handle this subscription needs to go to
 	bool retVal = LSSubscriptionAcquire(m_serviceHandlePrivate, "getOptionalSearchList", &iter, &lserror);
@@ -2705,7 +3326,8 @@ void UniversalSearchService::postOptionalSearchListChange()
 		lsHandle = m_serviceHandlePrivate;
 		while (LSSubscriptionHasNext(iter)) {
 			LSMessage *message = LSSubscriptionNext(iter);
-			if (!LSMessageReply(lsHandle,message,json_object_to_json_string (response),&lserror)) {
+			receivers++;
+			if (!LSMessageReply(lsHandle,message,response.str().c_str(),&lserror)) {
 				LSErrorPrint(&lserror,stderr);
 				LSErrorFree(&lserror);
 			}
@@ -2717,7 +3339,7 @@ void UniversalSearchService::postOptionalSearchListChange()
 		LSErrorFree(&lserror);
 	}
 	
-	json_object_put(response);
+	STATS_RECORD("broadcastOptionalSearchListChange", ServiceStats::Subscribers, receivers);
 }
 
 /*!
@@ -2773,6 +3395,8 @@ Example response for a failed call:
 */
 static bool cbRemoveOptionalSearchItem(LSHandle* lshandle, LSMessage *message, void *user_data)
 {
+	STATS_SCOPE("removeOptionalSearchItem");
+	BUS_CAPTURE("removeOptionalSearchItem", message);
     LSError lserror;
     LSErrorInit(&lserror);
 
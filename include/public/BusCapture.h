@@ -0,0 +1,71 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __BusCapture_h__
+#define __BusCapture_h__
+
+#include <string>
+#include <stdio.h>
+#include <glib.h>
+#include <lunaservice.h>
+
+/*
+ * Capture of the inbound bus traffic, for replay with tools/replay.
+ *
+ * Enabled by pointing UNIVERSALSEARCH_CAPTURE at a file before the service starts.
+ * Every request and callback payload is appended as one line:
+ *
+ *     <microseconds since start> TAB <handler> TAB <s if subscription, else -> TAB <payload>
+ *
+ * The handler is the name the call is timed under in getStats. Backslash, tab, CR and
+ * LF in the payload are escaped with a backslash.
+ */
+class BusCapture {
+
+public:
+	static const char* s_header;
+
+	static BusCapture* instance();
+
+	bool isEnabled() const { return m_file != NULL; }
+
+	void record(const char* handler, LSMessage* message);
+	void close();
+
+	//Messages handed to their callback a second time are not captured again.
+	void setSuspended(bool suspended) { m_suspended = suspended; }
+
+	static std::string escape(const char* payload);
+	static std::string unescape(const char* data, gsize length);
+
+private:
+	BusCapture();
+
+	FILE* m_file;
+	gint64 m_start;
+	bool m_suspended;
+};
+
+#define BUS_CAPTURE(handler, message) \
+	do { \
+		BusCapture* busCapture = BusCapture::instance(); \
+		if (busCapture->isEnabled()) \
+			busCapture->record(handler, message); \
+	} while (0)
+
+#endif
@@ -0,0 +1,83 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __CatalogueSnapshot_h__
+#define __CatalogueSnapshot_h__
+
+#include <string>
+#include <glib.h>
+
+/*
+ * File container of the binary startup snapshot of the provider lists.
+ *
+ * Layout: magic, format version, key length, payload length and a checksum (FNV-1a
+ * over key and payload), all little endian 32 bit; then the key and the payload. The
+ * key describes the inputs the content was built from; a snapshot is only used if
+ * it matches the current key exactly. The payload is a sequence of fields written
+ * with Writer and read back in the same order with Reader.
+ */
+class CatalogueSnapshot {
+
+public:
+	static const guint32 s_formatVersion = 3;
+
+	class Writer {
+	public:
+		void putUInt(guint32 value);
+		void putBool(bool value);
+		void putString(const std::string& value);
+
+		const std::string& data() const { return m_data; }
+
+	private:
+		std::string m_data;
+	};
+
+	//Bounds checked; every get fails once the data is exhausted.
+	class Reader {
+	public:
+		Reader(const char* data, gsize length) : m_pos(data), m_end(data + length) {}
+
+		bool getUInt(guint32& value);
+		bool getBool(bool& value);
+		bool getString(std::string& value);
+		bool atEnd() const { return m_pos == m_end; }
+
+	private:
+		const char* m_pos;
+		const char* m_end;
+	};
+
+	CatalogueSnapshot();
+	~CatalogueSnapshot();
+
+	static bool save(const std::string& path, const std::string& key, const Writer& payload);
+
+	//Maps the file. Fails if it is missing, damaged, of another format or for another key.
+	bool load(const std::string& path, const std::string& key);
+	Reader reader() const { return Reader(m_payload, m_payloadLength); }
+
+private:
+	static guint32 checksum(guint32 hash, const char* data, gsize length);
+
+	GMappedFile* m_file;
+	const char* m_payload;
+	gsize m_payloadLength;
+};
+
+#endif
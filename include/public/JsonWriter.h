@@ -0,0 +1,77 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __JsonWriter_h__
+#define __JsonWriter_h__
+
+#include <string>
+#include <vector>
+
+/*
+ * Writes JSON text straight into a buffer, for replies that would otherwise build a
+ * json_object tree only to serialize it. The spacing is that of
+ * json_object_to_json_string ("{ \"a\": 1, \"b\": [ 2, 3 ] }"), so the output is the
+ * same as before apart from '/', which is not escaped.
+ *
+ * The writer puts the commas in. At the top level it writes object members without
+ * the braces, which is what the reply bodies are made of; a whole document is one
+ * beginObject()/endObject() pair. clear() keeps the buffer, so a writer that is kept
+ * around only allocates while its replies grow.
+ */
+class JsonWriter {
+
+public:
+	JsonWriter();
+
+	void clear();
+	void reserve(size_t size) { m_buffer.reserve(size); }
+
+	JsonWriter& beginObject();
+	JsonWriter& endObject();
+	JsonWriter& beginArray();
+	JsonWriter& endArray();
+
+	//Member name; the value written next belongs to it.
+	JsonWriter& key(const char* name);
+
+	JsonWriter& value(const std::string& text) { return value(text.data(), text.size()); }
+	JsonWriter& value(const char* text);
+	JsonWriter& value(const char* text, size_t length);
+	JsonWriter& value(bool flag);
+	JsonWriter& value(int number);
+	JsonWriter& null();
+
+	//A value that is serialized already, written as it is.
+	JsonWriter& raw(const std::string& json);
+
+	const std::string& str() const { return m_buffer; }
+	size_t size() const { return m_buffer.size(); }
+
+	//Appends 'text' as a quoted JSON string.
+	static void quote(std::string& out, const char* text, size_t length);
+	static std::string quote(const std::string& text);
+
+private:
+	void separate();
+
+	std::string m_buffer;
+	std::vector<bool> m_hasElements;	//per open object or array, and the top level
+	bool m_afterKey;
+};
+
+#endif
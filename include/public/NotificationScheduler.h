@@ -0,0 +1,75 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __NotificationScheduler_h__
+#define __NotificationScheduler_h__
+
+#include <string>
+#include <glib.h>
+
+/*
+ * Coalesces subscription broadcasts. Changes only mark a list dirty; the broadcasts
+ * run once from the main loop after the coalescing window has been quiet, and never
+ * later than the maximum delay after the first pending change.
+ *
+ * Both intervals are in milliseconds and can be set from the environment with
+ * UNIVERSALSEARCH_NOTIFY_WINDOW_MS and UNIVERSALSEARCH_NOTIFY_MAX_DELAY_MS.
+ * A window of 0 flushes from an idle source.
+ */
+class NotificationScheduler {
+
+public:
+	enum Dirty {
+		DirtySearchList = 1 << 0,
+		DirtyOptionalSearchList = 1 << 1,
+		DirtySearchPreference = 1 << 2
+	};
+
+	NotificationScheduler();
+	~NotificationScheduler();
+
+	void markSearchListDirty(const char* eventName);
+	void markOptionalSearchListDirty();
+	void markSearchPreferenceDirty();
+
+	//Sends whatever is pending right away.
+	void flush();
+
+	void setWindow(guint windowMs) { m_windowMs = windowMs; }
+	void setMaxDelay(guint maxDelayMs) { m_maxDelayMs = maxDelayMs; }
+	guint getWindow() const { return m_windowMs; }
+	guint getMaxDelay() const { return m_maxDelayMs; }
+
+private:
+	static gboolean cbFlush(gpointer user_data);
+	static guint readInterval(const char* name, guint defaultValue);
+
+	void markDirty(unsigned int dirty);
+	void schedule();
+
+	guint m_windowMs;
+	guint m_maxDelayMs;
+
+	unsigned int m_dirty;
+	std::string m_searchListEvent;
+	unsigned int m_pendingChanges;
+	gint64 m_firstPending;
+	guint m_sourceId;
+};
+
+#endif
@@ -21,6 +21,9 @@
 
 #include <string>
 #include <map>
+#include <vector>
+
+#include "JsonWriter.h"
 
 class OpenSearchHandler {
     public:
@@ -43,7 +46,9 @@ class OpenSearchHandler {
 	int 	getOptionalListSize();
 	bool 	notifyOpenSearchItemAvailable(std::string& displayName);
 
-	json_object*	getOpenSearchList();
+	//The items that are not search items yet: "Options": [ ... ], a member of the reply.
+	void		writeOpenSearchList(JsonWriter& writer);
+	void		getOpenSearchItems(std::vector<OpenSearchInfo>& items);
 	bool		clearOpenSearchList();
 	bool		clearOpenSearchItem (const std::string id);
 
@@ -51,6 +56,16 @@ class OpenSearchHandler {
 	static bool cbDownloadManagerIconUpdate(LSHandle* lshandle, LSMessage *message, void *user_data);
 	void		scanExistingPlugins();
 	
+	//The reading half of the scan, it only touches the files and may run on any thread.
+	static void	readPluginDirectory (const std::string& path, std::vector<OpenSearchInfo>& plugins);
+	static bool	readPluginFile (const std::string& xmlFile, OpenSearchInfo& info);
+	void		addScannedPlugins (std::vector<OpenSearchInfo>& plugins);
+	bool		addPlugin (OpenSearchInfo& info, bool scanningDir);
+	const std::string& getPluginPath() const { return m_searchPluginPath; }
+	
+	//Bumped whenever the optional search items change.
+	unsigned int	getGeneration() const { return m_generation; }
+	
     private:
 	OpenSearchHandler();
 
@@ -59,6 +74,7 @@ class OpenSearchHandler {
 	std::string m_searchPluginPath;
 	std::map<std::string, OpenSearchInfo> m_osItems;
 	std::string m_searchPluginIconPath;
+	unsigned int m_generation;
 };
 
 #endif // OPENSEARCHHANDLER_H
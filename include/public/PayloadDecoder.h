@@ -0,0 +1,215 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __PayloadDecoder_h__
+#define __PayloadDecoder_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <glib.h>
+
+/*
+ * Memory of one request, taken in bumps and freed all at once when the arena goes
+ * out of scope at the end of the handler. The first kilobyte is part of the arena
+ * itself, which is enough for the payloads of the service's own methods.
+ */
+class RequestArena {
+
+public:
+	RequestArena();
+	~RequestArena();
+
+	char* allocate(size_t size);
+	const char* copy(const char* text, size_t length);	//NUL terminated
+
+private:
+	RequestArena(const RequestArena&);
+	RequestArena& operator=(const RequestArena&);
+
+	struct Block {
+		Block* next;
+	};
+
+	static const size_t s_inlineSize = 1024;
+	static const size_t s_blockSize = 4096;
+
+	char m_inline[s_inlineSize];
+	char* m_next;
+	size_t m_left;
+	Block* m_blocks;
+};
+
+//JSON types, as bits so that a schema member can take several of them.
+enum PayloadType {
+	PayloadMissing = 0,
+	PayloadNull = 1 << 0,
+	PayloadBool = 1 << 1,
+	PayloadNumber = 1 << 2,
+	PayloadString = 1 << 3,
+	PayloadObject = 1 << 4,
+	PayloadArray = 1 << 5,
+	PayloadAny = PayloadNull | PayloadBool | PayloadNumber | PayloadString | PayloadObject | PayloadArray
+};
+
+/*
+ * A decoded member. Strings are unescaped into the arena and NUL terminated; any other
+ * value is its text in the payload, which is not, and which the decoder has checked.
+ * Objects and arrays are decoded further with DecodedPayload or PayloadArrayReader.
+ */
+struct PayloadValue {
+	PayloadType type;
+	const char* text;
+	size_t length;
+	bool boolean;
+	double number;
+
+	bool present() const { return type != PayloadMissing; }
+	std::string str() const { return std::string(text, length); }
+	int toInt() const { return type == PayloadString ? atoi(text) : (int) number; }
+};
+
+struct PayloadField {
+	const char* name;
+	unsigned int types;		//PayloadType bits
+	bool required;
+};
+
+struct PayloadSchema {
+	const PayloadField* fields;
+	int count;
+};
+
+/*
+ * Decodes the members of one JSON object into the slots of a schema, in one pass over
+ * its text and without a DOM. Members outside the schema are an error unless
+ * skipUnknown is set, which is for the replies of other services. A member that
+ * occurs twice keeps its last value, as with json_tokener_parse.
+ *
+ * Errors say what is wrong and where, e.g. "'toIndex' must be a number (at 41)".
+ */
+class PayloadDecoder {
+
+public:
+	static bool decode(const PayloadSchema& schema, const char* text, size_t length, PayloadValue* values,
+			RequestArena& arena, bool skipUnknown, std::string& error);
+
+	static const int s_maxDepth = 64;
+};
+
+/*
+ * Schemas are tables of X(name, types, required) rows, like the field tables of
+ * ProviderFields.h. DEFINE_PAYLOAD makes a struct with an enumerator per row, the slot
+ * index of the member, and the schema:
+ *
+ *     #define REMOVE_ITEM_PAYLOAD(X) \
+ *         X(category, PayloadString, true) \
+ *         X(id,       PayloadString, true)
+ *     DEFINE_PAYLOAD(RemoveItemPayload, REMOVE_ITEM_PAYLOAD)
+ *
+ *     DecodedPayload<RemoveItemPayload> request(arena);
+ *     if (request.decode(payload, error))
+ *         removeItem(request[RemoveItemPayload::category].str(), ...);
+ */
+#define PAYLOAD_MEMBER_INDEX(name, types, required) name,
+#define PAYLOAD_MEMBER_FIELD(name, types, required) { #name, types, required },
+
+#define DEFINE_PAYLOAD(Payload, TABLE) \
+	struct Payload { \
+		enum { TABLE(PAYLOAD_MEMBER_INDEX) MemberCount }; \
+		static const PayloadSchema& schema() \
+		{ \
+			static const PayloadField s_fields[] = { TABLE(PAYLOAD_MEMBER_FIELD) }; \
+			static const PayloadSchema s_schema = { s_fields, MemberCount }; \
+			return s_schema; \
+		} \
+	};
+
+template <class Payload>
+class DecodedPayload {
+
+public:
+	DecodedPayload(RequestArena& arena) : m_arena(arena) { clear(); }
+
+	bool decode(const char* text, std::string& error, bool skipUnknown = false)
+	{
+		return decode(text, text ? strlen(text) : 0, error, skipUnknown);
+	}
+
+	bool decode(const char* text, size_t length, std::string& error, bool skipUnknown = false)
+	{
+		clear();
+		return PayloadDecoder::decode(Payload::schema(), text, length, m_values, m_arena, skipUnknown, error);
+	}
+
+	//A member that holds an object.
+	bool decode(const PayloadValue& object, std::string& error, bool skipUnknown = false)
+	{
+		return decode(object.text, object.length, error, skipUnknown);
+	}
+
+	const PayloadValue& operator[](int index) const { return m_values[index]; }
+	const PayloadValue* values() const { return m_values; }
+
+	//Sets a string member, copied into the arena.
+	void set(int index, const std::string& text)
+	{
+		PayloadValue& value = m_values[index];
+		value.type = PayloadString;
+		value.text = m_arena.copy(text.data(), text.size());
+		value.length = text.size();
+	}
+
+private:
+	void clear()
+	{
+		for (int i = 0; i < Payload::MemberCount; i++) {
+			m_values[i].type = PayloadMissing;
+			m_values[i].text = "";
+			m_values[i].length = 0;
+			m_values[i].boolean = false;
+			m_values[i].number = 0;
+		}
+	}
+
+	RequestArena& m_arena;
+	PayloadValue m_values[Payload::MemberCount];
+};
+
+/*
+ * The elements of an array member, one at a time. Elements are decoded like members;
+ * next() returns false at the end of the array or on an error, which error() tells.
+ */
+class PayloadArrayReader {
+
+public:
+	PayloadArrayReader(const PayloadValue& array, RequestArena& arena);
+
+	bool next(PayloadValue& element);
+	const std::string& error() const { return m_error; }
+
+private:
+	const char* m_start;
+	const char* m_next;
+	const char* m_end;
+	RequestArena& m_arena;
+	bool m_first;
+	std::string m_error;
+};
+
+#endif
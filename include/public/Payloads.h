@@ -0,0 +1,123 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __Payloads_h__
+#define __Payloads_h__
+
+#include "PayloadDecoder.h"
+
+/*
+ * Schemas of the payloads the service decodes with PayloadDecoder: the requests of its
+ * own methods, and the parts of the application manager replies it reads. Rows are
+ * X(name, types, required); see DEFINE_PAYLOAD.
+ */
+
+/*
+ * An item of addSearchItem, and of the universalSearch block of an app: the fields of
+ * the three categories (ProviderFields.h) and the members of the request. Which of
+ * them an item needs depends on its category, so none is required here.
+ */
+#define ITEM_PAYLOAD(X) \
+	X(category,           PayloadString,                 false) \
+	X(id,                 PayloadString,                 false) \
+	X(setDefault,         PayloadBool,                   false) \
+	X(displayName,        PayloadString,                 false) \
+	X(iconFilePath,       PayloadString,                 false) \
+	X(url,                PayloadString,                 false) \
+	X(suggestURL,         PayloadString,                 false) \
+	X(launchParam,        PayloadString | PayloadObject, false) \
+	X(type,               PayloadString,                 false) \
+	X(enabled,            PayloadBool,                   false) \
+	X(version,            PayloadNumber | PayloadString, false) \
+	X(launchParamDbField, PayloadString,                 false) \
+	X(dbQuery,            PayloadObject | PayloadString, false) \
+	X(displayFields,      PayloadArray | PayloadString,  false) \
+	X(batchQuery,         PayloadBool,                   false)
+DEFINE_PAYLOAD(ItemPayload, ITEM_PAYLOAD)
+
+//updateSearchItem
+#define UPDATE_ITEM_PAYLOAD(X) \
+	X(category,   PayloadString, true) \
+	X(id,         PayloadString, true) \
+	X(enabled,    PayloadBool,   true) \
+	X(setDefault, PayloadBool,   false)
+DEFINE_PAYLOAD(UpdateItemPayload, UPDATE_ITEM_PAYLOAD)
+
+//updateAllSearchItems
+#define UPDATE_ALL_ITEMS_PAYLOAD(X) \
+	X(category, PayloadString, true) \
+	X(enabled,  PayloadBool,   true)
+DEFINE_PAYLOAD(UpdateAllItemsPayload, UPDATE_ALL_ITEMS_PAYLOAD)
+
+//removeSearchItem
+#define REMOVE_ITEM_PAYLOAD(X) \
+	X(category, PayloadString, true) \
+	X(id,       PayloadString, true)
+DEFINE_PAYLOAD(RemoveItemPayload, REMOVE_ITEM_PAYLOAD)
+
+//reorderSearchItem. Search items are found by id, the others need fromIndex.
+#define REORDER_ITEM_PAYLOAD(X) \
+	X(category,  PayloadString, true) \
+	X(id,        PayloadString, true) \
+	X(fromIndex, PayloadNumber, false) \
+	X(toIndex,   PayloadNumber, true)
+DEFINE_PAYLOAD(ReorderItemPayload, REORDER_ITEM_PAYLOAD)
+
+//setSearchPreference. A value that is not a string is stored as its JSON text.
+#define SEARCH_PREFERENCE_PAYLOAD(X) \
+	X(key,   PayloadString, true) \
+	X(value, PayloadAny,    true)
+DEFINE_PAYLOAD(SearchPreferencePayload, SEARCH_PREFERENCE_PAYLOAD)
+
+//addOptionalSearchDesc
+#define OPTIONAL_SEARCH_DESC_PAYLOAD(X) \
+	X(xmlUrl, PayloadString, true)
+DEFINE_PAYLOAD(OptionalSearchDescPayload, OPTIONAL_SEARCH_DESC_PAYLOAD)
+
+/*
+ * Application manager replies. They carry much more than this, so they are decoded
+ * with skipUnknown set.
+ */
+
+//listApps
+#define APP_LIST_PAYLOAD(X) \
+	X(apps, PayloadArray, true)
+DEFINE_PAYLOAD(AppListPayload, APP_LIST_PAYLOAD)
+
+//getAppInfo
+#define APP_INFO_PAYLOAD(X) \
+	X(appInfo, PayloadObject, true)
+DEFINE_PAYLOAD(AppInfoPayload, APP_INFO_PAYLOAD)
+
+//An app of either reply.
+#define APP_PAYLOAD(X) \
+	X(id,              PayloadString, false) \
+	X(icon,            PayloadString, false) \
+	X(universalSearch, PayloadObject, false)
+DEFINE_PAYLOAD(AppPayload, APP_PAYLOAD)
+
+//Its universalSearch block, an ItemPayload per category.
+#define APP_SEARCH_ITEMS_PAYLOAD(X) \
+	X(search,   PayloadObject, false) \
+	X(action,   PayloadObject, false) \
+	X(dbsearch, PayloadObject, false)
+DEFINE_PAYLOAD(AppSearchItemsPayload, APP_SEARCH_ITEMS_PAYLOAD)
+
+typedef DecodedPayload<ItemPayload> ItemRequest;
+
+#endif
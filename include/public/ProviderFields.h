@@ -0,0 +1,136 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __ProviderFields_h__
+#define __ProviderFields_h__
+
+#include <string>
+
+#include "StringPool.h"
+
+/*
+ * Field tables of the three provider categories. A row is X(type, name, reply): the
+ * C++ type of the member, its name (which is also its JSON key and database column)
+ * and how it goes into the getUniversalSearchList reply. Rows are in the column order
+ * of the database table. id and category come before them and position comes after,
+ * and those three are handled on their own.
+ *
+ * The item and record structs and every per-field operation are generated from the
+ * tables: JSON decoding, the list reply, the database row and statements, the
+ * catalogue snapshot and the comparison. The field visitors are resolved by overloading
+ * on the member type and the reply tag, so nothing is dispatched at run time.
+ *
+ * Text members are PooledStrings (StringPool.h): an item holds a handle per field, and
+ * equal values in all the lists share one copy. Records keep plain strings (see
+ * RecordMember), since database rows are also read on the startup threads.
+ */
+
+//Reply tags.
+struct ReplyOmit {};		//not in the reply
+struct ReplyValue {};		//as a string, boolean or number
+struct ReplyParsed {};		//stored serialized, sent as the parsed JSON
+struct ReplyParsedArray {};	//parsed if it is an array, sent as a string otherwise
+
+//SearchList, "search" rows.
+#define SEARCH_PROVIDER_FIELDS(X) \
+	X(PooledString, displayName,        ReplyValue) \
+	X(PooledString, iconFilePath,       ReplyValue) \
+	X(PooledString, url,                ReplyValue) \
+	X(PooledString, suggestURL,         ReplyValue) \
+	X(PooledString, launchParam,        ReplyValue) \
+	X(PooledString, type,               ReplyValue) \
+	X(bool,        enabled,            ReplyValue) \
+	X(int,         version,            ReplyOmit)
+
+//SearchList, "action" rows. Same columns, a shorter reply.
+#define ACTION_PROVIDER_FIELDS(X) \
+	X(PooledString, displayName,        ReplyValue) \
+	X(PooledString, iconFilePath,       ReplyValue) \
+	X(PooledString, url,                ReplyValue) \
+	X(PooledString, suggestURL,         ReplyOmit) \
+	X(PooledString, launchParam,        ReplyValue) \
+	X(PooledString, type,               ReplyOmit) \
+	X(bool,        enabled,            ReplyValue) \
+	X(int,         version,            ReplyOmit)
+
+//DBSearchList.
+#define DB_SEARCH_ITEM_FIELDS(X) \
+	X(PooledString, displayName,        ReplyValue) \
+	X(PooledString, iconFilePath,       ReplyValue) \
+	X(PooledString, url,                ReplyOmit) \
+	X(PooledString, launchParam,        ReplyValue) \
+	X(PooledString, launchParamDbField, ReplyValue) \
+	X(PooledString, dbQuery,            ReplyParsed) \
+	X(PooledString, displayFields,      ReplyParsedArray) \
+	X(bool,        batchQuery,         ReplyValue) \
+	X(bool,        enabled,            ReplyValue) \
+	X(int,         version,            ReplyOmit)
+
+//Type of a field in the database records.
+template <class Field>
+struct RecordMember { typedef Field Type; };
+template <>
+struct RecordMember<PooledString> { typedef std::string Type; };
+
+#define PROVIDER_FIELD_MEMBER(type, name, reply) type name;
+#define PROVIDER_FIELD_RECORD_MEMBER(type, name, reply) RecordMember<type>::Type name;
+#define PROVIDER_FIELD_COLUMN(type, name, reply) #name ", "
+#define PROVIDER_FIELD_PARAMETER(type, name, reply) "?, "
+#define PROVIDER_FIELD_INDEX(type, name, reply) name,
+#define PROVIDER_FIELD_VISIT(type, name, reply) visitor(#name, item.name, reply());
+#define PROVIDER_FIELD_VISIT_PAIR(type, name, reply) visitor(#name, first.name, second.name);
+#define PROVIDER_FIELD_PAYLOAD_SLOT(type, name, reply) Payload::name,
+
+/*
+ * visit() calls visitor(name, member, reply tag) for every field of the item, and
+ * visitPairs() calls visitor(name, first member, second member) for two items. Any
+ * struct with the members will do, and const items give const members. The fields
+ * are visited in table order; the enumerators are their indexes.
+ *
+ * payloadSlots() maps those indexes to the slots of a DEFINE_PAYLOAD payload
+ * (PayloadDecoder.h) that has a member of the same name for every field.
+ */
+#define DEFINE_PROVIDER_FIELDS(Fields, TABLE) \
+	struct Fields { \
+		enum Index { TABLE(PROVIDER_FIELD_INDEX) Count }; \
+		template <class Item, class Visitor> \
+		static void visit(Item& item, Visitor& visitor) { TABLE(PROVIDER_FIELD_VISIT) } \
+		template <class First, class Second, class Visitor> \
+		static void visitPairs(First& first, Second& second, Visitor& visitor) { TABLE(PROVIDER_FIELD_VISIT_PAIR) } \
+		template <class Payload> \
+		static const int* payloadSlots() { static const int s_slots[] = { TABLE(PROVIDER_FIELD_PAYLOAD_SLOT) }; return s_slots; } \
+	};
+
+//The fields a request or resource file has, by index.
+class ProviderFieldSet {
+
+public:
+	ProviderFieldSet() : m_bits(0) {}
+
+	void add(int index) { m_bits |= 1u << index; }
+	bool has(int index) const { return (m_bits & (1u << index)) != 0; }
+
+private:
+	unsigned int m_bits;
+};
+
+DEFINE_PROVIDER_FIELDS(SearchProviderFields, SEARCH_PROVIDER_FIELDS)
+DEFINE_PROVIDER_FIELDS(ActionProviderFields, ACTION_PROVIDER_FIELDS)
+DEFINE_PROVIDER_FIELDS(DBSearchItemFields, DB_SEARCH_ITEM_FIELDS)
+
+#endif
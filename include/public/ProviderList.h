@@ -0,0 +1,378 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __ProviderList_h__
+#define __ProviderList_h__
+
+#include <string>
+#include <glib.h>
+#include <cjson/json.h>
+
+#include "ProviderRegistry.h"
+#include "ProviderFields.h"
+#include "CatalogueSnapshot.h"
+#include "JsonWriter.h"
+#include "SearchListChangeLog.h"
+#include "Payloads.h"
+
+/*
+ * A provider list of one category: the registry plus everything that handles the
+ * fields, generated from the category's field table (see ProviderFields.h).
+ *
+ * Traits describes the category:
+ *   Item      the list item: id, the table fields, position, appExist and dirty
+ *   Record    the database row: id, category, the table fields, hasPosition and position
+ *   Fields    the field table, as defined with DEFINE_PROVIDER_FIELDS
+ *   TypeOf    the type used by the secondary index
+ *   category  "search", "action" or "dbsearch"
+ */
+template <class Traits>
+class ProviderList : public ProviderRegistry<typename Traits::Item, typename Traits::TypeOf> {
+
+public:
+	typedef typename Traits::Item Item;
+	typedef typename Traits::Record Record;
+	typedef typename Traits::Fields Fields;
+	typedef ProviderRegistry<Item, typename Traits::TypeOf> Registry;
+	typedef typename Registry::iterator iterator;
+	typedef typename Registry::const_iterator const_iterator;
+
+	static const char* category() { return Traits::category(); }
+
+	//Sets the fields present in the object, and in present, and leaves the others alone.
+	static void decode(json_object* root, Item& item, ProviderFieldSet& present)
+	{
+		JsonDecoder decoder(root);
+		Fields::visit(item, decoder);
+		present = decoder.present;
+	}
+
+	//The same from a decoded request, whose schema has a member for every field.
+	static void decode(const ItemRequest& request, Item& item, ProviderFieldSet& present)
+	{
+		PayloadFieldDecoder decoder(request);
+		Fields::visit(item, decoder);
+		present = decoder.present;
+	}
+
+	static void toRecord(const Item& item, Record& record)
+	{
+		Copier copier;
+		record.id = item.id;
+		record.category = category();
+		Fields::visitPairs(item, record, copier);
+		record.hasPosition = true;
+		record.position = item.position;
+	}
+
+	//Fields and position only; appExist and dirty are up to the caller.
+	static void fromRecord(const Record& record, Item& item)
+	{
+		Copier copier;
+		item.id = record.id;
+		Fields::visitPairs(record, item, copier);
+		item.position = record.position;
+	}
+
+	//Same id and fields; the position and the flags do not count.
+	static bool sameContent(const Item& first, const Item& second)
+	{
+		Comparer comparer;
+		if (first.id != second.id)
+			return false;
+		Fields::visitPairs(first, second, comparer);
+		return comparer.same;
+	}
+
+	/*
+	 * Writes the list as a JSON array. Query needs inPage(index) and wants(field), see
+	 * SearchItemsManager::SearchListQuery. With a capture, the serialized items and their
+	 * members are also recorded for the change log.
+	 */
+	template <class Query>
+	void write(JsonWriter& writer, const Query& query, SearchListChangeLog::ListState* capture = NULL) const
+	{
+		JsonEncoder<Query> encoder(writer, query);
+		int index = 0;
+
+		writer.beginArray();
+		for (const_iterator it = this->begin(); it != this->end(); ++it, ++index) {
+			if (!query.inPage(index))
+				continue;
+
+			if (capture) {
+				capture->push_back(SearchListChangeLog::ItemState());
+				encoder.item = &capture->back();
+				encoder.item->id = it->id;
+			}
+
+			writer.beginObject();
+			size_t start = writer.size() - 1;
+			if (query.wants("id"))
+				writer.key("id").value(it->id);
+			Fields::visit(*it, encoder);
+			writer.endObject();
+
+			if (capture)
+				encoder.item->item.assign(writer.str(), start, std::string::npos);
+		}
+		writer.endArray();
+	}
+
+	void save(CatalogueSnapshot::Writer& writer) const
+	{
+		SnapshotWriter fieldWriter(writer);
+
+		writer.putUInt((guint32) this->size());
+		for (const_iterator it = this->begin(); it != this->end(); ++it) {
+			writer.putString(it->id);
+			Fields::visit(*it, fieldWriter);
+			writer.putUInt((guint32) it->position);
+		}
+	}
+
+	//Appends the items of save(); they are clean and their apps not seen yet.
+	bool load(CatalogueSnapshot::Reader& reader)
+	{
+		SnapshotReader fieldReader(reader);
+		guint32 count = 0;
+		guint32 position = 0;
+		std::string id;
+		bool ok = reader.getUInt(count);
+
+		for (guint32 i = 0; ok && i < count; i++) {
+			Item item = Item();
+			ok = reader.getString(id);
+			item.id = id;
+			Fields::visit(item, fieldReader);
+			ok = ok && fieldReader.ok && reader.getUInt(position);
+			item.position = (int) position;
+			item.appExist = false;
+			item.dirty = false;
+			if (ok)
+				this->push_back(item);
+		}
+		return ok;
+	}
+
+private:
+	struct JsonDecoder {
+		JsonDecoder(json_object* root) : root(root), index(0) {}
+
+		json_object* member(const char* name)
+		{
+			json_object* label = json_object_object_get(root, name);
+			if (label && !is_error(label)) {
+				present.add(index++);
+				return label;
+			}
+			index++;
+			return NULL;
+		}
+
+		template <class Reply>
+		void operator()(const char* name, PooledString& value, Reply)
+		{
+			json_object* label = member(name);
+			if (label)
+				value = json_object_get_string(label);
+		}
+
+		template <class Reply>
+		void operator()(const char* name, bool& value, Reply)
+		{
+			json_object* label = member(name);
+			if (label)
+				value = json_object_get_boolean(label);
+		}
+
+		template <class Reply>
+		void operator()(const char* name, int& value, Reply)
+		{
+			json_object* label = member(name);
+			if (label)
+				value = json_object_get_int(label);
+		}
+
+		json_object* root;
+		int index;
+		ProviderFieldSet present;
+	};
+
+	/*
+	 * Strings and objects go in as their text; the schema has checked the other types.
+	 * The request member of each field is found by its index, not its name.
+	 */
+	struct PayloadFieldDecoder {
+		PayloadFieldDecoder(const ItemRequest& request)
+			: request(request), slots(Fields::template payloadSlots<ItemPayload>()), index(0) {}
+
+		const PayloadValue* member()
+		{
+			const PayloadValue& value = request[slots[index]];
+			if (value.present()) {
+				present.add(index++);
+				return &value;
+			}
+			index++;
+			return NULL;
+		}
+
+		template <class Reply>
+		void operator()(const char* name, PooledString& value, Reply)
+		{
+			const PayloadValue* label = member();
+			if (label)
+				value.assign(label->text, label->length);
+		}
+
+		template <class Reply>
+		void operator()(const char* name, bool& value, Reply)
+		{
+			const PayloadValue* label = member();
+			if (label)
+				value = label->boolean;
+		}
+
+		template <class Reply>
+		void operator()(const char* name, int& value, Reply)
+		{
+			const PayloadValue* label = member();
+			if (label)
+				value = label->toInt();
+		}
+
+		const ItemRequest& request;
+		const int* slots;
+		int index;
+		ProviderFieldSet present;
+	};
+
+	template <class Query>
+	struct JsonEncoder {
+		JsonEncoder(JsonWriter& writer, const Query& query) : writer(writer), query(query), item(NULL), start(0) {}
+
+		template <class Value>
+		void operator()(const char* name, const Value& value, ReplyOmit) {}
+
+		template <class Value>
+		void operator()(const char* name, const Value& value, ReplyValue)
+		{
+			if (!query.wants(name))
+				return;
+			begin(name);
+			writer.value(value);
+			end(name);
+		}
+
+		//Stored serialized and checked when the item was added; empty means absent.
+		void operator()(const char* name, const std::string& value, ReplyParsed)
+		{
+			if (!query.wants(name) || value.empty())
+				return;
+			begin(name);
+			writer.raw(value);
+			end(name);
+		}
+
+		void operator()(const char* name, const std::string& value, ReplyParsedArray)
+		{
+			if (!query.wants(name))
+				return;
+			begin(name);
+			if (value.find_first_of('[') != std::string::npos)
+				writer.raw(value);
+			else
+				writer.value(value);
+			end(name);
+		}
+
+		void begin(const char* name)
+		{
+			writer.key(name);
+			start = writer.size();
+		}
+
+		void end(const char* name)
+		{
+			if (item)
+				item->fields[name].assign(writer.str(), start, std::string::npos);
+		}
+
+		JsonWriter& writer;
+		const Query& query;
+		SearchListChangeLog::ItemState* item;
+		size_t start;
+	};
+
+	struct SnapshotWriter {
+		SnapshotWriter(CatalogueSnapshot::Writer& writer) : writer(writer) {}
+
+		template <class Reply>
+		void operator()(const char*, const std::string& value, Reply) { writer.putString(value); }
+		template <class Reply>
+		void operator()(const char*, bool value, Reply) { writer.putBool(value); }
+		template <class Reply>
+		void operator()(const char*, int value, Reply) { writer.putUInt((guint32) value); }
+
+		CatalogueSnapshot::Writer& writer;
+	};
+
+	//Stops reading at the first failure.
+	struct SnapshotReader {
+		SnapshotReader(CatalogueSnapshot::Reader& reader) : reader(reader), ok(true) {}
+
+		//Read into one buffer, so only strings new to the pool are copied.
+		template <class Reply>
+		void operator()(const char*, PooledString& value, Reply)
+		{
+			ok = ok && reader.getString(text);
+			value = text;
+		}
+		template <class Reply>
+		void operator()(const char*, bool& value, Reply) { ok = ok && reader.getBool(value); }
+		template <class Reply>
+		void operator()(const char*, int& value, Reply)
+		{
+			guint32 number = 0;
+			ok = ok && reader.getUInt(number);
+			value = (int) number;
+		}
+
+		CatalogueSnapshot::Reader& reader;
+		bool ok;
+		std::string text;
+	};
+
+	//Between pooled and plain strings, too.
+	struct Copier {
+		template <class From, class To>
+		void operator()(const char*, const From& from, To& to) { to = from; }
+	};
+
+	struct Comparer {
+		Comparer() : same(true) {}
+
+		template <class Value>
+		void operator()(const char*, const Value& first, const Value& second) { same = same && first == second; }
+
+		bool same;
+	};
+};
+
+#endif
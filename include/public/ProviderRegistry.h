@@ -0,0 +1,214 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __ProviderRegistry_h__
+#define __ProviderRegistry_h__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <tr1/unordered_map>
+
+//Type of the items for the index by type; Item::type by default.
+template <class Item>
+struct ProviderType {
+	const std::string& operator()(const Item& item) const { return item.type; }
+};
+
+/*
+ * Ordered list of providers (search, action or db search items) in contiguous storage,
+ * with a hash index by id. It has the parts of the std::list interface the lists were
+ * used with, so the order is what it always was: push_back appends, insert goes before
+ * the given position and move() behaves like splicing one item.
+ *
+ * Lookups by id are O(1). If an id occurs more than once the index gives the first
+ * occurrence, as a scan from the front would. Inserting, erasing and moving shift the
+ * later items and re-index them.
+ *
+ * The secondary index, of the positions by type, is built on first use after a change.
+ * Any non-const access counts as a change; the id must never be changed through it.
+ */
+template <class Item, class TypeOf = ProviderType<Item> >
+class ProviderRegistry {
+
+public:
+	typedef std::vector<Item> Items;
+	typedef typename Items::iterator iterator;
+	typedef typename Items::const_iterator const_iterator;
+	typedef typename Items::size_type size_type;
+	typedef std::vector<size_type> Positions;
+
+	static const size_type npos = (size_type) -1;
+
+	ProviderRegistry() : m_secondaryValid(false) {}
+
+	iterator begin() { m_secondaryValid = false; return m_items.begin(); }
+	iterator end() { return m_items.end(); }
+	const_iterator begin() const { return m_items.begin(); }
+	const_iterator end() const { return m_items.end(); }
+
+	size_type size() const { return m_items.size(); }
+	bool empty() const { return m_items.empty(); }
+
+	Item& operator[](size_type pos) { m_secondaryValid = false; return m_items[pos]; }
+	const Item& operator[](size_type pos) const { return m_items[pos]; }
+
+	size_type indexOf(const std::string& id) const
+	{
+		typename Index::const_iterator it = m_index.find(id);
+		return it != m_index.end() ? it->second : npos;
+	}
+
+	bool contains(const std::string& id) const { return m_index.find(id) != m_index.end(); }
+
+	iterator find(const std::string& id)
+	{
+		size_type pos = indexOf(id);
+		return pos != npos ? begin() + pos : end();
+	}
+
+	const_iterator find(const std::string& id) const
+	{
+		size_type pos = indexOf(id);
+		return pos != npos ? begin() + pos : end();
+	}
+
+	void push_back(const Item& item)
+	{
+		m_items.push_back(item);
+		m_index.insert(std::make_pair(item.id, m_items.size() - 1));
+		m_secondaryValid = false;
+	}
+
+	iterator insert(iterator position, const Item& item)
+	{
+		size_type pos = position - m_items.begin();
+		m_items.insert(position, item);
+		reindexFrom(pos);
+		return begin() + pos;
+	}
+
+	iterator erase(iterator position)
+	{
+		size_type pos = position - m_items.begin();
+		typename Index::iterator it = m_index.find(position->id);
+		if (it != m_index.end() && it->second == pos)
+			m_index.erase(it);
+
+		m_items.erase(position);
+		reindexFrom(pos);
+		return begin() + pos;
+	}
+
+	template <class Predicate>
+	void remove_if(Predicate pred)
+	{
+		m_items.erase(std::remove_if(m_items.begin(), m_items.end(), pred), m_items.end());
+		m_index.clear();
+		reindexFrom(0);
+	}
+
+	//Moves the item at from in front of the item at to (to may be size()).
+	void move(size_type from, size_type to)
+	{
+		if (from >= m_items.size() || to > m_items.size() || to == from || to == from + 1)
+			return;
+
+		if (from < to) {
+			std::rotate(m_items.begin() + from, m_items.begin() + from + 1, m_items.begin() + to);
+			reindex(from, to);
+		}
+		else {
+			std::rotate(m_items.begin() + to, m_items.begin() + from, m_items.begin() + from + 1);
+			reindex(to, from + 1);
+		}
+	}
+
+	void clear()
+	{
+		m_items.clear();
+		m_index.clear();
+		m_secondaryValid = false;
+	}
+
+	void swap(ProviderRegistry& other)
+	{
+		m_items.swap(other.m_items);
+		m_index.swap(other.m_index);
+		m_secondaryValid = false;
+		other.m_secondaryValid = false;
+	}
+
+	//Positions in list order.
+	const Positions& positionsOfType(const std::string& type) const
+	{
+		static const Positions s_none;
+
+		buildSecondary();
+		typename TypeIndex::const_iterator it = m_byType.find(type);
+		return it != m_byType.end() ? it->second : s_none;
+	}
+
+private:
+	typedef std::tr1::unordered_map<std::string, size_type> Index;
+	typedef std::map<std::string, Positions> TypeIndex;
+
+	void reindexFrom(size_type pos) { reindex(pos, m_items.size()); }
+
+	//Entries in [first, last) are stale; the ones outside are left alone.
+	void reindex(size_type first, size_type last)
+	{
+		for (size_type i = first; i < last; i++) {
+			typename Index::iterator it = m_index.find(m_items[i].id);
+			if (it != m_index.end() && it->second >= first && it->second < last)
+				m_index.erase(it);
+		}
+
+		//An id may also occur before first; insert keeps the first occurrence.
+		for (size_type i = first; i < last; i++) {
+			std::pair<typename Index::iterator, bool> result = m_index.insert(std::make_pair(m_items[i].id, i));
+			if (!result.second && result.first->second > i)
+				result.first->second = i;
+		}
+
+		m_secondaryValid = false;
+	}
+
+	void buildSecondary() const
+	{
+		if (m_secondaryValid)
+			return;
+
+		TypeOf typeOf;
+		m_byType.clear();
+		for (size_type i = 0; i < m_items.size(); i++)
+			m_byType[typeOf(m_items[i])].push_back(i);
+
+		m_secondaryValid = true;
+	}
+
+	Items m_items;
+	Index m_index;
+
+	mutable bool m_secondaryValid;
+	mutable TypeIndex m_byType;
+};
+
+#endif
@@ -24,13 +24,43 @@
 #include <iostream>
 #include <cjson/json.h>
 #include <list>
+#include <map>
+#include <set>
 
 #include "UniversalSearchPrefsDb.h"
+#include "SearchListChangeLog.h"
+#include "ProviderList.h"
+#include "JsonWriter.h"
+#include "Payloads.h"
 
 
 class SearchItemsManager {
 	
 public:
+	/*
+	 * Restricts the lists returned by getUniversalSearchList. The default query returns
+	 * every category and field of every item. offset and limit apply to each list.
+	 */
+	struct SearchListQuery {
+		enum {
+			CategorySearch = 1 << 0,
+			CategoryAction = 1 << 1,
+			CategoryDBSearch = 1 << 2,
+			AllCategories = CategorySearch | CategoryAction | CategoryDBSearch
+		};
+		
+		SearchListQuery() : categories(AllCategories), offset(0), limit(-1) {}
+		
+		unsigned int categories;
+		std::set<std::string> fields;	//empty means all fields
+		int offset;
+		int limit;						//-1 means no limit
+		
+		bool wants(const char* field) const { return fields.empty() || fields.count(field) > 0; }
+		bool inPage(int index) const { return index >= offset && (limit < 0 || index < offset + limit); }
+		bool isDefault() const { return categories == AllCategories && fields.empty() && offset == 0 && limit < 0; }
+	};
+	
 	SearchItemsManager();
 	~SearchItemsManager();
 	static SearchItemsManager* instance();
@@ -42,131 +72,371 @@ public:
 	
 	void findTarget(const std::string& url);
 	void readFromDatabase();
+	void readFromDatabase(const UniversalSearchPrefsDb::RecordBuffer& records);
 	void readFromDefaultFile();
 	void readFromCustFile();
 	
-	json_object* getSearchList();
 	bool addSearchItem(const char* jsonStr, bool dbSync, bool overwrite, bool checkAppExist);
+	bool addSearchItem(json_object* root, bool dbSync, bool overwrite, bool checkAppExist);
 	bool modifySearchItem(const char* jsonStr);
+	bool modifySearchItem(json_object* root);
 	bool removeSearchItem(const char* jsonStr);
+	bool removeSearchItem(json_object* root);
 	bool reorderSearchItem(const char* jsonStr);
+	bool reorderSearchItem(json_object* root);
 	bool isSearchItemExist(const std::string& id);
 	bool replaceSearchItem(const std::string& id, const std::string& url, const std::string& suggestUrl, const std::string& displayName);
 	bool moveSearchItem(const std::string& id, int fromIndex, int toIndex);
 	bool modifyAllSearchItems(const char* jsonStr);
+	bool modifyAllSearchItems(json_object* root);
 	bool removeDisabledOpenSearchItem(const std::string& id);
 	
 	//Action Providers
 	bool addActionProvider(const char* jsonStr, bool dbSync, bool overwrite, bool checkAppExist);
+	bool addActionProvider(json_object* root, bool dbSync, bool overwrite, bool checkAppExist);
 	bool modifyActionProvider(const char* jsonStr);
+	bool modifyActionProvider(json_object* root);
 	bool removeActionProvider(const char* jsonStr);
+	bool removeActionProvider(json_object* root);
 	bool reorderActionProvider(const char* jsonStr);
-	json_object* getActionProvidersList();
+	bool reorderActionProvider(json_object* root);
 	bool moveActionItem(const std::string& id, int fromIndex, int toIndex);
 	bool modifyAllActionProviders(const char* jsonStr);
+	bool modifyAllActionProviders(json_object* root);
 	
 	//MojoDb Search Items
 	bool addDBSearchItem(const char* jsonStr, bool dbSync, bool overwrite, bool checkAppExist);
+	bool addDBSearchItem(json_object* root, bool dbSync, bool overwrite, bool checkAppExist);
 	bool modifyDBSearchItem(const char* jsonStr);
+	bool modifyDBSearchItem(json_object* root);
 	bool removeDBSearchItem(const char* jsonStr);
+	bool removeDBSearchItem(json_object* root);
 	bool reorderDBSearchItem(const char* jsonStr);
-	json_object* getDBSearchItemList();
+	bool reorderDBSearchItem(json_object* root);
 	bool moveDBSearchItem(const std::string& id, int fromIndex, int toIndex);
 	bool modifyAllDBSearchItems(const char* jsonStr);
+	bool modifyAllDBSearchItems(json_object* root);
 	
 	bool validateDbSearchItem(std::string appId, const char* dbQuery);
 	
+	/*
+	 * The bus methods, from their decoded payloads (Payloads.h). category is "search",
+	 * "action" or "dbsearch"; fromIndex is not used for search items, which are found
+	 * by their id.
+	 */
+	bool addItem(const std::string& category, const ItemRequest& request, bool dbSync, bool overwrite, bool checkAppExist);
+	bool modifyItem(const std::string& category, const std::string& id, bool enabled, bool setDefault);
+	bool modifyAllItems(const std::string& category, bool enabled);
+	bool removeItem(const std::string& category, const std::string& id);
+	bool reorderItem(const std::string& category, const std::string& id, int fromIndex, int toIndex);
+	
 	bool isItemExist(const std::string& id);
 	
 	void init();
+	void init(const UniversalSearchPrefsDb::RecordBuffer& dbRows);
+	
+	/*
+	 * Live locale switch: rebuilds the lists from the (already switched) database and the
+	 * resource files of the new locale. Enabled toggles are carried over by category and
+	 * id; app items only come back with the next listApps reply, so the toggles are kept
+	 * until applyCarriedEnabledStates() is called after it.
+	 */
+	void reloadForLocale();
+	void applyCarriedEnabledStates();
+	
+	/*
+	 * Binary snapshot of the merged lists, next to the database partition. It is keyed
+	 * by the locale and the mtime and size of the resource, customization and database
+	 * files, and lets init() skip reading and merging when none of them has changed.
+	 * Saved once the pending writes are on disk, after the startup and listApps merges.
+	 */
+	bool loadCatalogueSnapshot();
+	void scheduleCatalogueSave();
 	
 	void checkIntegrity();
+	
+	/*
+	 * Incremental listApps reconciliation. A hash of every app's universalSearch block
+	 * and icon is kept in the database partition: an app whose hash is unchanged only
+	 * gets its items marked as present, and apps known to have no block are skipped.
+	 * Removing an app item drops the hash, so the next listApps adds the item again;
+	 * so does an app whose items were not all added, see forgetAppDescriptor().
+	 */
+	static std::string appDescriptorHash(const std::string& universalSearch, const std::string& icon);
+	bool isAppDescriptorUnchanged(const std::string& appId, const std::string& hash);
+	bool isAppWithoutDescriptor(const std::string& appId);
+	void setAppDescriptorHash(const std::string& appId, const std::string& hash);	//empty: no block
+	void forgetAppDescriptor(const std::string& appId);
+	void markAppItemsExist(const std::string& appId);
+	void forgetMissingApps(const std::set<std::string>& installedAppIds);
+	
+	/*
+	 * Batched changes (applySearchItemChanges). The operations are checked against the
+	 * current lists before anything is applied; between beginBatch() and commitBatch()
+	 * the writes are held back, and commitBatch() queues them as one unit. rollbackBatch()
+	 * drops them and restores the lists and the app descriptor hashes.
+	 *
+	 * Durability is asynchronous: the writer applies the unit all or nothing after the
+	 * reply has gone out, and a unit that fails there is only logged.
+	 */
+	bool validateSearchItemChanges(json_object* operations, int& failedIndex, std::string& errorText);
+	bool beginBatch();
+	void commitBatch();
+	void rollbackBatch();
 
 	void dumpList();
 	void dumpActionList();
 
+	/*
+	 * Serialized members of the getUniversalSearchList reply (the three lists and
+	 * defaultSearchEngine, without the enclosing braces). A snapshot is immutable;
+	 * a new one is built only after the lists or the preferences have changed.
+	 */
+	struct SearchListSnapshot {
+		unsigned int generation;
+		unsigned int prefGeneration;
+		unsigned int listGeneration;	//client visible, advances only when the content changed
+		std::string body;
+	};
+
+	const SearchListSnapshot* getSearchListSnapshot();
+	//Valid until the next call; written into a buffer that is kept for the next one.
+	const std::string& getSearchListBody(const SearchListQuery& query);
+	unsigned int getGeneration() const { return m_generation; }
+
+	/*
+	 * Delta support for getUniversalSearchList: the changes between the given list
+	 * generation and the current snapshot. Returns false if they are no longer known.
+	 */
+	bool getSearchListChanges(unsigned int sinceGeneration, std::string& changes) const { return m_changeLog.changesSince(sinceGeneration, changes); }
+	unsigned int getSearchListInstanceId() const { return m_changeLog.instanceId(); }
+
 private:
 	
 	UniversalSearchPrefsDb* dbHandler;
 	json_object* searchListObj;
 	std::string m_searchPrefStr;
 	static SearchItemsManager* s_simgr_instance;
+	unsigned int m_generation;
+	SearchListSnapshot* m_snapshot;
+	SearchListChangeLog m_changeLog;
+	JsonWriter m_writer;
+
+	void listChanged() { m_generation++; }
 	
-	struct ActionProvider {
-		std::string id;
-		std::string displayName;
-		std::string url;
-		std::string suggestURL;
-		std::string launchParam;
-		std::string iconFilePath;
-		std::string type;
-		bool enabled;
-		int version;
-		bool appExist;
-	};
+	//"category/id" -> enabled
+	typedef std::map<std::string, bool> EnabledStates;
+	EnabledStates m_carriedEnabledStates;
+	void getEnabledStates(EnabledStates& states) const;
+	void applyEnabledStates(const EnabledStates& states);
 	
-	typedef std::list<ActionProvider> ActionProvidersList;
-	ActionProvidersList m_actionProvidersList;
+	typedef std::map<std::string, std::string> AppDescriptorHashes;
+	AppDescriptorHashes m_appDescriptorHashes;
+	std::set<std::string> m_appsWithoutDescriptor;
+	bool m_appDescriptorsLoaded;
+	void loadAppDescriptors();
+	
+	bool m_catalogueSavePending;
+	std::string catalogueSnapshotPath() const;
+	std::string catalogueSnapshotKey() const;
+	void saveCatalogueSnapshot();
+	static gboolean cbSaveCatalogueSnapshot(gpointer data);
 	
+	/*
+	 * The list items, generated from the field tables (ProviderFields.h). position is
+	 * the sort key of the persisted order; a dirty item differs from its database row
+	 * and is written by the next syncPrefDb.
+	 */
 	struct SearchProvider {
-		std::string id;
-		std::string displayName;
-		std::string url;
-		std::string suggestURL;
-		std::string launchParam;
-		std::string iconFilePath;
-		std::string type;
-		bool enabled;
-		int version;
+		PooledString id;
+		SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_MEMBER)
+		int position;
 		bool appExist;
+		bool dirty;
 	};
 	
-	typedef std::list<SearchProvider> SearchProvidersList;
-	SearchProvidersList m_searchProvidersList;
+	struct ActionProvider {
+		PooledString id;
+		ACTION_PROVIDER_FIELDS(PROVIDER_FIELD_MEMBER)
+		int position;
+		bool appExist;
+		bool dirty;
+	};
 	
 	struct MojoDBSearchItem {
-		std::string id;
-		std::string displayName;
-		std::string launchParam;
-		std::string launchParamDbField;
-		std::string url;
-		std::string iconFilePath;
-		std::string dbQuery;
-		std::string displayFields;
-		bool batchQuery;
-		bool enabled;
-		int version;
+		PooledString id;
+		DB_SEARCH_ITEM_FIELDS(PROVIDER_FIELD_MEMBER)
+		int position;
 		bool appExist;
+		bool dirty;
 	};
 	
-	typedef std::list<MojoDBSearchItem> MojoDBSearchItemList;
-	MojoDBSearchItemList m_mojodbSearchItemList;
-
-	void syncPrefDb();
+	//Db search items have no type; they all go under "dbsearch".
+	struct DBSearchType {
+		const std::string& operator()(const MojoDBSearchItem& item) const
+		{
+			static const std::string s_type("dbsearch");
+			return s_type;
+		}
+	};
 	
-	struct PredSearch
-	{
-	   bool operator()(const SearchProvider& item) const
-	   {
-	      return item.type == "app" && !item.appExist && item.id != "map";
-	   }
+	/*
+	 * Per category behavior for the generic list code below. accept() checks an item
+	 * decoded from a request or resource file (present are the fields it had) and fills
+	 * in defaults; acceptStored() does the part that still applies to a database row;
+	 * isStale() is the checkIntegrity() condition; only items of staleType(), if it is
+	 * not NULL, can meet it.
+	 */
+	struct SearchTraits {
+		typedef SearchProvider Item;
+		typedef UniversalSearchPrefsDb::SearchRecord Record;
+		typedef SearchProviderFields Fields;
+		typedef ProviderType<SearchProvider> TypeOf;
+		
+		static const char* category() { return "search"; }
+		static const bool s_generatesId = true;			//items without an id get "User-<n>"
+		static const bool s_canBeDefault = true;		//setDefault makes it the defaultSearchEngine
+		static const bool s_reorderAfterDefault = true;	//the UI shows the default item apart
+		
+		static bool accept(SearchItemsManager& manager, Item& item, const ProviderFieldSet& present);
+		static bool acceptStored(Item& item);
+		static bool isStale(const Item& item) { return item.type == "app" && !item.appExist && item.id != "map"; }
+		static const char* staleType() { return "app"; }
 	};
-
-	struct PredAction
-	{
-	   bool operator()(const ActionProvider& item) const
-	   {
-	      return !item.appExist;
-	   }
+	
+	struct ActionTraits {
+		typedef ActionProvider Item;
+		typedef UniversalSearchPrefsDb::SearchRecord Record;
+		typedef ActionProviderFields Fields;
+		typedef ProviderType<ActionProvider> TypeOf;
+		
+		static const char* category() { return "action"; }
+		static const bool s_generatesId = false;
+		static const bool s_canBeDefault = false;
+		static const bool s_reorderAfterDefault = false;
+		
+		static bool accept(SearchItemsManager& manager, Item& item, const ProviderFieldSet& present);
+		static bool acceptStored(Item& item);
+		static bool isStale(const Item& item) { return !item.appExist; }
+		static const char* staleType() { return NULL; }
+	};
+	
+	struct DBSearchTraits {
+		typedef MojoDBSearchItem Item;
+		typedef UniversalSearchPrefsDb::DBSearchRecord Record;
+		typedef DBSearchItemFields Fields;
+		typedef DBSearchType TypeOf;
+		
+		static const char* category() { return "dbsearch"; }
+		static const bool s_generatesId = false;
+		static const bool s_canBeDefault = false;
+		static const bool s_reorderAfterDefault = false;
+		
+		static bool accept(SearchItemsManager& manager, Item& item, const ProviderFieldSet& present);
+		static bool acceptStored(Item& item);
+		static bool isStale(const Item& item) { return !item.appExist; }
+		static const char* staleType() { return NULL; }
 	};
+	
+	typedef ProviderList<SearchTraits> SearchProvidersList;
+	typedef ProviderList<ActionTraits> ActionProvidersList;
+	typedef ProviderList<DBSearchTraits> MojoDBSearchItemList;
+	SearchProvidersList m_searchProvidersList;
+	ActionProvidersList m_actionProvidersList;
+	MojoDBSearchItemList m_mojodbSearchItemList;
 
-	struct PredDbSearch
-	{
-	   bool operator()(const MojoDBSearchItem& item) const
-	   {
-	      return !item.appExist;
-	   }
+	/*
+	 * Database rows go straight into the lists instead of through addItem(): they were
+	 * validated when they were added, and this way loading them builds no JSON at all.
+	 * A row keeps its stored position if that sorts after the item before it; the item
+	 * is clean then.
+	 */
+	class DatabaseReader : public UniversalSearchPrefsDb::RecordVisitor {
+	public:
+		DatabaseReader(SearchItemsManager& manager) : m_manager(manager) {}
+		void visit(const UniversalSearchPrefsDb::SearchRecord& record);
+		void visit(const UniversalSearchPrefsDb::DBSearchRecord& record) { m_manager.addDatabaseItem(m_manager.m_mojodbSearchItemList, record); }
+		
+	private:
+		SearchItemsManager& m_manager;
+	};
+	
+	template <class Traits>
+	void addDatabaseItem(ProviderList<Traits>& list, const typename Traits::Record& record);
+	
+	//The list operations, once for all categories.
+	template <class Traits>
+	bool addItem(ProviderList<Traits>& list, json_object* root, bool dbSync, bool overwrite, bool appExist);
+	template <class Traits>
+	bool addItem(ProviderList<Traits>& list, const ItemRequest& request, bool dbSync, bool overwrite, bool appExist);
+	template <class Traits>
+	bool addItem(ProviderList<Traits>& list, typename Traits::Item& item, const ProviderFieldSet& present,
+			bool setDefault, bool dbSync, bool overwrite, bool appExist);
+	template <class Traits>
+	bool modifyItem(ProviderList<Traits>& list, json_object* root);
+	template <class Traits>
+	void modifyItem(ProviderList<Traits>& list, const std::string& id, bool enabled, bool setDefault);
+	template <class Traits>
+	bool modifyAllItems(ProviderList<Traits>& list, json_object* root);
+	template <class Traits>
+	void modifyAllItems(ProviderList<Traits>& list, bool enabled);
+	template <class Traits>
+	bool removeItem(ProviderList<Traits>& list, json_object* root);
+	template <class Traits>
+	bool removeItem(ProviderList<Traits>& list, const std::string& id);
+	template <class Traits>
+	bool reorderItem(ProviderList<Traits>& list, json_object* root);
+	template <class Traits>
+	bool reorderItem(ProviderList<Traits>& list, const std::string& id, int fromIndex, int toIndex);
+	template <class Traits>
+	bool moveItem(ProviderList<Traits>& list, const std::string& id, int fromIndex, int toIndex);
+	template <class Traits>
+	void writeItem(const typename Traits::Item& item);
+	template <class Traits>
+	int syncItems(ProviderList<Traits>& list);
+	template <class Traits>
+	void getEnabledStates(const ProviderList<Traits>& list, EnabledStates& states) const;
+	template <class Traits>
+	bool applyEnabledStates(ProviderList<Traits>& list, const EnabledStates& states);
+	template <class Traits>
+	void removeStaleItems(ProviderList<Traits>& list);
+	
+	/*
+	 * A list as validateSearchItemChanges() sees it part way through the batch: the ids
+	 * in order, and the version an add has to beat.
+	 */
+	struct BatchItem {
+		std::string id;
+		int version;
 	};
+	typedef ProviderRegistry<BatchItem> BatchItems;
+	template <class Traits>
+	void getBatchItems(const ProviderList<Traits>& list, BatchItems& items) const;
+	template <class Traits>
+	bool validateChange(BatchItems& items, json_object* operation, const std::string& op, RequestArena& arena, std::string& errorText);
+
+	//Writes the dirty items, in one transaction.
+	void syncPrefDb();
+	
+	//Brings back the opensearch descriptions when all search items are enabled.
+	void addOpenSearchItems();
+	
+	/*
+	 * The order is persisted as a sort key per row. Keys are spaced apart, so an item
+	 * that is added or moved gets the midpoint of its neighbours and only its own row is
+	 * written. Only when the neighbours are adjacent is the whole list renumbered.
+	 * Returns false in that case; the positions have been written then.
+	 */
+	template <class Traits>
+	bool placeItem(ProviderList<Traits>& list, size_t pos);
+	
+	bool m_inBatch;
+	SearchProvidersList m_batchSearchProviders;
+	ActionProvidersList m_batchActionProviders;
+	MojoDBSearchItemList m_batchDBSearchItems;
+	AppDescriptorHashes m_batchAppDescriptorHashes;
+	std::set<std::string> m_batchAppsWithoutDescriptor;
+	bool m_batchAppDescriptorsLoaded;
 
 };
 
@@ -0,0 +1,102 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __SearchListChangeLog_h__
+#define __SearchListChangeLog_h__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+
+#include "JsonWriter.h"
+
+/*
+ * Keeps the last published state of the getUniversalSearchList lists and a bounded
+ * ring of the typed changes (added, removed, moved, fieldChanged) between successive
+ * states, so that delta subscribers can catch up from a known generation.
+ *
+ * The changes of an item in one of the lists are
+ *
+ *     { "op": "removed", "list": <list>, "id": <id> }
+ *     { "op": "added", "list": <list>, "id": <id>, "index": <index>, "item": <item> }
+ *     { "op": "moved", "list": <list>, "id": <id>, "index": <index> }
+ *     { "op": "fieldChanged", "list": <list>, "id": <id>, "field": <member>, "value": <value> }
+ *
+ * with a null value for a member the item no longer has. defaultSearchEngine is a
+ * member of the reply itself, not of an item, so its change has no list and no id:
+ *
+ *     { "op": "fieldChanged", "field": "defaultSearchEngine", "value": <id> }
+ */
+class SearchListChangeLog {
+
+public:
+	/*
+	 * An item as it was sent: its serialized members by name and the whole serialized
+	 * item. Captured while the list is written (see ProviderList::write), so no tree
+	 * has to be built or parsed for it.
+	 */
+	struct ItemState {
+		std::string id;
+		std::map<std::string, std::string> fields;
+		std::string item;
+	};
+	typedef std::vector<ItemState> ListState;
+
+	//UniversalSearchList, ActionList and DBSearchItemList, in this order.
+	static const int s_numLists = 3;
+
+	SearchListChangeLog();
+
+	/*
+	 * Compares 'lists' and defaultSearchEngine against the previous state, and takes
+	 * over the content of 'lists'. Returns the generation of the new state; it only
+	 * advances when something changed.
+	 */
+	unsigned int record(ListState* lists, const std::string& defaultSearchEngine);
+
+	/*
+	 * Serializes the change steps after 'generation' as a json array into 'changes'.
+	 * Returns false if that generation is unknown or has already been evicted.
+	 */
+	bool changesSince(unsigned int generation, std::string& changes) const;
+
+	unsigned int generation() const { return m_generation; }
+	unsigned int instanceId() const { return m_instanceId; }
+
+private:
+	struct ChangeStep {
+		unsigned int fromGeneration;
+		unsigned int generation;
+		std::string serialized;
+	};
+
+	static const unsigned int s_maxSteps = 64;
+	static const char* s_listNames[];
+
+	int diffList(const char* listName, const ListState& oldList, const ListState& newList, JsonWriter& changes);
+
+	unsigned int m_generation;
+	unsigned int m_instanceId;
+	bool m_hasState;
+	ListState m_lists[s_numLists];
+	std::string m_defaultSearchEngine;
+	std::deque<ChangeStep> m_steps;
+};
+
+#endif
@@ -0,0 +1,101 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __ServiceStats_h__
+#define __ServiceStats_h__
+
+#include <string>
+#include <map>
+#include <utility>
+#include <glib.h>
+#include <cjson/json.h>
+
+/*
+ * Runtime statistics reported by the private getStats method: latency histograms of
+ * the bus methods and callbacks, payload size and subscriber count histograms, and
+ * plain counters (SQLite calls). Histograms use power of two buckets.
+ *
+ * Metrics are looked up by name once and then cached in a function-local static by
+ * the macros below, so recording only costs the clock reads and a few additions.
+ */
+class ServiceStats {
+
+public:
+	enum Kind {
+		Latency,		//microseconds
+		PayloadSize,	//bytes
+		Subscribers,	//receivers of a broadcast
+		Counter
+	};
+
+	static const int s_numBuckets = 32;
+
+	struct Metric {
+		Kind kind;
+		guint64 count;
+		guint64 sum;
+		guint64 max;
+		guint64 buckets[s_numBuckets];
+
+		void record(guint64 value);
+		void reset();
+	};
+
+	class ScopeTimer {
+	public:
+		ScopeTimer(Metric* metric) : m_metric(metric), m_start(g_get_monotonic_time()) {}
+		~ScopeTimer() { m_metric->record(g_get_monotonic_time() - m_start); }
+	private:
+		Metric* m_metric;
+		gint64 m_start;
+	};
+
+	static ServiceStats* instance();
+
+	Metric* metric(const char* name, Kind kind);
+
+	json_object* toJson() const;
+	void reset();
+
+private:
+	ServiceStats();
+
+	//The same name may be used for metrics of different kinds.
+	typedef std::map<std::pair<Kind, std::string>, Metric*> MetricMap;
+	MetricMap m_metrics;
+	gint64 m_since;
+};
+
+#define STATS_METRIC(name, kind) \
+	static ServiceStats::Metric* s_statsMetric = ServiceStats::instance()->metric(name, kind)
+
+//Times the rest of the enclosing scope.
+#define STATS_SCOPE(name) \
+	STATS_METRIC(name, ServiceStats::Latency); \
+	ServiceStats::ScopeTimer statsScopeTimer(s_statsMetric)
+
+#define STATS_RECORD(name, kind, value) \
+	do { \
+		STATS_METRIC(name, kind); \
+		s_statsMetric->record(value); \
+	} while (0)
+
+#define STATS_COUNT(name) \
+	STATS_RECORD(name, ServiceStats::Counter, 1)
+
+#endif
@@ -0,0 +1,108 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __StartupPipeline_h__
+#define __StartupPipeline_h__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <glib.h>
+#include <lunaservice.h>
+#include <cjson/json.h>
+
+#include "OpenSearchHandler.h"
+#include "UniversalSearchPrefsDb.h"
+
+/*
+ * Startup as a small dependency graph rather than a chain behind the locale reply.
+ *
+ * The database read and the plugin directory scan start at launch on a thread pool.
+ * The merge with the locale specific resource files waits for the database and the
+ * locale (the database is read again if the locale selects another partition than
+ * the one read at launch); the scanned plugins are added once the lists are merged.
+ * Messages that change the lists (listApps and appinstaller replies, later locale
+ * changes) may arrive before that; they are kept and handed to their callback again
+ * when the pipeline is ready.
+ *
+ * Every stage is reported under "startup.*" in the service statistics, together with
+ * the time to the first getUniversalSearchList reply that carries the merged lists.
+ */
+class StartupPipeline {
+
+public:
+	enum Stage {
+		StageDatabase = 1 << 0,
+		StagePlugins = 1 << 1,
+		StageLocale = 1 << 2,
+		StageMerged = 1 << 3,
+		StageReady = 1 << 4
+	};
+
+	StartupPipeline();
+	~StartupPipeline();
+
+	void start(const std::string& pluginPath);
+	void localeKnown();
+
+	bool isReady() const { return (m_done & StageReady) != 0; }
+
+	//Keeps the message for later if the lists are not ready yet; returns true if it did.
+	bool deferUntilReady(LSHandle* lshandle, LSMessage* message, LSFilterFunc callback);
+
+	void listReplySent();
+
+private:
+	struct Job {
+		Stage stage;
+		StartupPipeline* pipeline;
+		UniversalSearchPrefsDb::RecordBuffer* rows;
+		std::string dbPath;
+		std::string pluginPath;
+		std::vector<OpenSearchHandler::OpenSearchInfo> plugins;
+		gint64 durationUs;
+	};
+
+	struct DeferredMessage {
+		LSHandle* lshandle;
+		LSMessage* message;
+		LSFilterFunc callback;
+	};
+
+	static void runJob(gpointer data, gpointer user_data);
+	static gboolean cbJobDone(gpointer data);
+
+	void queueDatabaseJob();
+	void queueJob(Job* job);
+	void jobDone(Job* job);
+	void advance();
+	void merge();
+	void replayDeferred();
+
+	GThreadPool* m_pool;
+	unsigned int m_done;
+	gint64 m_launchTime;
+	bool m_firstReplyRecorded;
+
+	UniversalSearchPrefsDb::RecordBuffer* m_dbRows;
+	std::string m_dbRowsPath;
+	std::vector<OpenSearchHandler::OpenSearchInfo> m_plugins;
+	std::list<DeferredMessage> m_deferred;
+};
+
+#endif
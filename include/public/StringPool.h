@@ -0,0 +1,174 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __StringPool_h__
+#define __StringPool_h__
+
+#include <string.h>
+#include <string>
+#include <utility>
+#include <tr1/unordered_map>
+#include <glib.h>
+#include <cjson/json.h>
+
+/*
+ * Interned strings of the provider items. The same types, icon paths, URLs and app ids
+ * come back in every list and on every item of an app; the pool keeps one copy of each
+ * and the items hold PooledString handles to it. An entry is counted by its handles and
+ * goes away with the last one.
+ *
+ * There is one pool for the service, like the lists it serves. It is not thread safe;
+ * everything runs on the main loop.
+ */
+class StringPool {
+
+public:
+	typedef std::pair<const std::string, guint32> Entry;	//text, handles
+
+	struct Stats {
+		guint32 strings;
+		guint64 references;
+		guint64 internedBytes;	//one copy of each string
+		guint64 rawBytes;		//a copy per handle, as plain strings would take
+	};
+
+	static StringPool* instance();
+
+	Entry* intern(const char* text, size_t length);
+	void retain(Entry* entry)
+	{
+		entry->second++;
+		m_stats.references++;
+		m_stats.rawBytes += entry->first.size();
+	}
+	void release(Entry* entry);
+
+	const Stats& stats() const { return m_stats; }
+	json_object* toJson() const;
+
+private:
+	StringPool();
+
+	/*
+	 * The index is keyed by the text of the entries, borrowed, so that looking up a string
+	 * that is already pooled copies nothing.
+	 */
+	struct Key {
+		const char* text;
+		size_t length;
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const
+		{
+			size_t hash = 5381;
+			for (size_t i = 0; i < key.length; i++)
+				hash = hash * 33 + (unsigned char) key.text[i];
+			return hash;
+		}
+	};
+
+	struct KeyEqual {
+		bool operator()(const Key& first, const Key& second) const
+		{
+			return first.length == second.length && memcmp(first.text, second.text, first.length) == 0;
+		}
+	};
+
+	typedef std::tr1::unordered_map<Key, Entry*, KeyHash, KeyEqual> Entries;
+	Entries m_entries;
+	Stats m_stats;
+};
+
+/*
+ * Handle to a pooled string: one pointer, so copying an item copies no text and two
+ * handles are equal exactly when they point to the same entry. The empty string is the
+ * null handle and takes no entry.
+ *
+ * It reads like a const std::string. Assigning a string interns it.
+ */
+class PooledString {
+
+public:
+	PooledString() : m_entry(NULL) {}
+	explicit PooledString(const std::string& text) : m_entry(intern(text.data(), text.size())) {}
+	explicit PooledString(const char* text) : m_entry(intern(text, strlen(text))) {}
+	PooledString(const PooledString& other) : m_entry(other.m_entry) { retain(); }
+	~PooledString() { release(); }
+
+	PooledString& operator=(const PooledString& other)
+	{
+		if (other.m_entry != m_entry) {
+			release();
+			m_entry = other.m_entry;
+			retain();
+		}
+		return *this;
+	}
+
+	PooledString& operator=(const std::string& text) { return assign(text.data(), text.size()); }
+	PooledString& operator=(const char* text) { return assign(text, strlen(text)); }
+	PooledString& assign(const char* text, size_t length);
+
+	void clear()
+	{
+		release();
+		m_entry = NULL;
+	}
+
+	const std::string& str() const { return m_entry ? m_entry->first : s_empty; }
+	operator const std::string&() const { return str(); }
+
+	const char* c_str() const { return str().c_str(); }
+	size_t size() const { return m_entry ? m_entry->first.size() : 0; }
+	bool empty() const { return m_entry == NULL; }
+
+	bool operator==(const PooledString& other) const { return m_entry == other.m_entry; }
+	bool operator!=(const PooledString& other) const { return m_entry != other.m_entry; }
+
+private:
+	static StringPool::Entry* intern(const char* text, size_t length)
+	{
+		return length ? StringPool::instance()->intern(text, length) : NULL;
+	}
+
+	void retain()
+	{
+		if (m_entry)
+			StringPool::instance()->retain(m_entry);
+	}
+
+	void release()
+	{
+		if (m_entry)
+			StringPool::instance()->release(m_entry);
+	}
+
+	static const std::string s_empty;
+
+	StringPool::Entry* m_entry;
+};
+
+inline bool operator==(const PooledString& first, const std::string& second) { return first.str() == second; }
+inline bool operator==(const std::string& first, const PooledString& second) { return first == second.str(); }
+inline bool operator==(const PooledString& first, const char* second) { return first.str() == second; }
+inline bool operator!=(const PooledString& first, const std::string& second) { return first.str() != second; }
+inline bool operator!=(const std::string& first, const PooledString& second) { return first != second.str(); }
+inline bool operator!=(const PooledString& first, const char* second) { return first.str() != second; }
+
+#endif
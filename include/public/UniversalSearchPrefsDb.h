@@ -20,40 +20,252 @@
 #define __UniversalSearchPrefsDb_h__
 
 #include <string>
+#include <map>
+#include <vector>
+#include <glib.h>
 #include <sqlite3.h>
 
+#include "ProviderFields.h"
+
+/*
+ * Writes are not executed on the calling (main loop) thread. Every write function
+ * queues its statement and the values to bind for a dedicated writer thread with its
+ * own connection, which commits whatever has piled up in one transaction. The database
+ * runs in WAL mode so the reads on the main connection are never blocked by it; the
+ * synchronous level of the writer can be set with UNIVERSALSEARCH_DB_SYNCHRONOUS
+ * (OFF, NORMAL or FULL, default NORMAL).
+ *
+ * Because of that, a write function only fails if the database is not open.
+ * The SearchPreference table is read into memory when the database is opened and
+ * written through from then on, so preference reads never wait for the writer and
+ * never see an older value than the last one set.
+ *
+ * Every statement the class issues more than once is prepared once per connection
+ * and reset after each use (see StatementCache).
+ *
+ * The order of the lists is kept in the position column of SearchList and DBSearchList
+ * (a sort key per row, see SearchItemsManager); readPrefDb returns the rows in that order.
+ */
+
 class UniversalSearchPrefsDb {
 public:
 	
+	/*
+	 * A row of SearchList ("search" and "action" items) or of DBSearchList, with the
+	 * columns of the field tables. NULL text columns come back empty; hasPosition is
+	 * false for rows written before the order was persisted.
+	 */
+	struct SearchRecord {
+		std::string id;
+		std::string category;
+		SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_RECORD_MEMBER)
+		bool hasPosition;
+		int position;
+	};
+	
+	struct DBSearchRecord {
+		std::string id;
+		std::string category;
+		DB_SEARCH_ITEM_FIELDS(PROVIDER_FIELD_RECORD_MEMBER)
+		bool hasPosition;
+		int position;
+	};
+	
+	//Gets every row of the lists, straight from the columns. The record is only valid during the call.
+	class RecordVisitor {
+	public:
+		virtual ~RecordVisitor() {}
+		virtual void visit(const SearchRecord& record) = 0;
+		virtual void visit(const DBSearchRecord& record) = 0;
+	};
+	
+	//Keeps the rows for another thread (the startup pool reads them, the main loop merges them).
+	class RecordBuffer : public RecordVisitor {
+	public:
+		void visit(const SearchRecord& record) { m_searchRecords.push_back(record); }
+		void visit(const DBSearchRecord& record) { m_dbSearchRecords.push_back(record); }
+		void replay(RecordVisitor& visitor) const;
+		
+	private:
+		std::vector<SearchRecord> m_searchRecords;
+		std::vector<DBSearchRecord> m_dbSearchRecords;
+	};
+	
 	static UniversalSearchPrefsDb* instance();
-	int readPrefDb(json_object* searchListJsonObj);
-	
-	bool addSearchRecord(const char* id, const char* category, const char* displayName, const char* iconFilePath, const char* url, const char* suggestURL, const char* launchParam, const char* type, int enabled, int version);
-	bool updateSearchRecord(const char* id, const char* category, int enabled);
-	bool updateAllSearchRecord(const char* category, int enabled);
-	bool removeSearchRecord(const char* id, const char* category);
-	bool addDBSearchRecord(const char* id, const char* category, const char* displayName, const char* iconFilePath, const char* url, const char* launchParam, const char* launchParamDbField, const char* dbQuery, const char* displayFields, int batchQuery, int enabled, int version);
-	bool updateDBSearchRecord(const char* id, int enabled);
-	bool updateAllDBSearchRecord(const char* category, int enabled);
-	bool removeDBSearchRecord(const char* id);
+	int readPrefDb(RecordVisitor& visitor);
+	int readPrefDb(RecordVisitor& visitor, const std::string& dbPath);
+	
+	//Switches to the partition of the locale. True if the lists have to be read again.
+	bool setLocale(const std::string& locale);
+	const std::string& getLocale() const { return m_locale; }
+	const std::string& getPath() const { return m_dbPath; }
+	
+	//Inserts or replaces the whole row.
+	bool addRecord(const SearchRecord& record);
+	bool addRecord(const DBSearchRecord& record);
+	//category "dbsearch" goes to DBSearchList, the others to SearchList.
+	bool updateRecordEnabled(const char* id, const char* category, bool enabled);
+	bool updateAllRecordsEnabled(const char* category, bool enabled);
+	bool removeRecord(const char* id, const char* category);
+	bool updateRecordPosition(const char* id, const char* category, int position);
 	std::string getSearchPreference(const std::string& key);
 	bool getAllSearchPreference(json_object* searchPrefObj);
+	//The preferences as a serialized object, without databaseversion. Built once per change.
+	const std::string& getAllSearchPreferenceJson();
 	bool setSearchPreference(const std::string& key, const std::string& val);
 	bool syncSearchPreferenceDb(const char* jsonStr);
 	
+	//appId -> hash of its universalSearch block, empty for apps without one.
+	bool readAppDescriptorHashes(std::map<std::string, std::string>& hashes);
+	bool setAppDescriptorHash(const char* appId, const char* hash);
+	bool removeAppDescriptorHash(const char* appId);
+	
 	bool purgeDatabase();
+	
+	//Blocks until every write queued so far is on disk. For shutdown only.
+	void flush();
+	
+	//Calls back from the main loop once every write queued so far is on disk.
+	void flushAsync(GSourceFunc callback, gpointer data);
+	
+	//Groups the writes until commit or rollback; they are queued as one unit on commit,
+	//and the writer applies the unit all or nothing.
+	bool beginTransaction();
+	bool commitTransaction();
+	void rollbackTransaction();
+	
+	//Bumped whenever a search preference is written.
+	unsigned int getGeneration() const { return m_generation; }
 
 private:
 	UniversalSearchPrefsDb();
 	~UniversalSearchPrefsDb();
 	
+	enum Statement {
+		InsertSearchRecord,
+		UpdateSearchEnabled,
+		UpdateAllSearchEnabled,
+		DeleteSearchRecord,
+		UpdateSearchPosition,
+		InsertDBSearchRecord,
+		UpdateDBSearchEnabled,
+		UpdateAllDBSearchEnabled,
+		DeleteDBSearchRecord,
+		UpdateDBSearchPosition,
+		InsertAppDescriptor,
+		DeleteAppDescriptor,
+		InsertPreference,
+		SelectAllPreferences,
+		SelectAppDescriptors,
+		BeginTransaction,
+		CommitTransaction,
+		RollbackTransaction,
+		Savepoint,
+		ReleaseSavepoint,
+		RollbackToSavepoint,
+		NumStatements
+	};
+	
+	//A statement with the values to bind, in parameter order. NULL text binds NULL.
+	struct Write {
+		struct Value {
+			bool isNull;
+			bool isText;
+			int number;
+			std::string text;
+		};
+		
+		Write(Statement writeStatement) : statement(writeStatement) {}
+		Write& text(const char* value);
+		Write& number(int value);
+		
+		Statement statement;
+		std::vector<Value> values;
+	};
+	
+	//Adds the table fields of a record to a Write, in column order.
+	struct FieldBinder;
+	
+	//Prepared statements of one connection, prepared on first use. Only used from the
+	//thread that owns the connection.
+	class StatementCache {
+	public:
+		StatementCache();
+		~StatementCache() { close(); }
+		
+		void open(sqlite3* db);
+		void close();
+		
+		//Reset, with no bindings; NULL if it could not be prepared.
+		sqlite3_stmt* get(Statement statement);
+		//Binds, steps to the end and resets. SQLITE_OK or the error.
+		int execute(const Write& write);
+		
+	private:
+		sqlite3* m_db;
+		sqlite3_stmt* m_statements[NumStatements];
+	};
+	
+	struct WriteOp {
+		enum Type {
+			Statements,
+			Barrier,
+			Quit
+		};
+		
+		WriteOp(Type opType) : type(opType), done(false), callback(NULL), callbackData(NULL) {}
+		
+		Type type;
+		std::vector<Write> writes;
+		bool done;
+		GSourceFunc callback;			//asynchronous barrier
+		gpointer callbackData;
+	};
+	
+	typedef std::map<std::string, std::string> PreferenceMap;
+	
 	void openUniversalSearchPrefsDb();
+	void addMissingColumn(const char* table, const char* column, const char* type);
 	void closeUniversalSearchPrefsDb();
+	void loadPreferences();
+	void preferencesChanged();
+	static std::string partitionPath(const std::string& locale);
+	bool checkpoint();
+	static void moveWal(const std::string& from, const std::string& to);
+	
+	void startWriter();
+	void stopWriter();
+	bool queueWrite(const Write& write);
+	void pushWriteOp(WriteOp* op);
+	void freeWriteOp(WriteOp* op);
+	
+	static gpointer writerThread(gpointer data);
+	bool executeWriteOps(const std::vector<WriteOp*>& ops);
 	
 
 private:
 	static UniversalSearchPrefsDb* s_uspDb_instance;
 	sqlite3* m_uspDb;
+	StatementCache m_readStatements;	//on m_uspDb
+	std::string m_locale;	//empty while the unpartitioned database is open
+	std::string m_dbPath;
+	unsigned int m_generation;
+	bool m_inTransaction;
+	
+	//Writer thread state. m_writerDb is only used by the writer thread, or inline
+	//on m_uspDb when the thread could not be started.
+	sqlite3* m_writerDb;
+	StatementCache m_writerStatements;
+	GThread* m_writerThread;
+	GAsyncQueue* m_writeQueue;
+	GMutex* m_barrierMutex;
+	GCond* m_barrierCond;
+	
+	std::vector<Write> m_transactionWrites;
+	PreferenceMap m_preferences;
+	PreferenceMap m_transactionPreferences;	//m_preferences at beginTransaction
+	std::string m_preferencesJson;
+	bool m_preferencesJsonValid;
 	
 };
 
@@ -31,6 +31,8 @@
 #include "SearchItemsManager.h"
 #include "SearchServiceManager.h"
 #include "OpenSearchHandler.h"
+#include "NotificationScheduler.h"
+#include "StartupPipeline.h"
 
 
 class UniversalSearchService {
@@ -46,10 +48,17 @@ public:
 	OpenSearchHandler* openSearchHandler;
 	
 	void postSearchListChange(const char* eventName);
+	void searchListSubscriptionAdded(const SearchItemsManager::SearchListSnapshot* snapshot);
+	void searchListDeltaSubscriptionAdded(const SearchItemsManager::SearchListSnapshot* snapshot);
 	//void postServiceListChange();
 	void postSearchPreferenceChange();
 	void postOptionalSearchListChange();
 	
+	//Called by the notification scheduler to send the coalesced changes.
+	void broadcastSearchListChange(const char* eventName);
+	void broadcastSearchPreferenceChange();
+	void broadcastOptionalSearchListChange();
+	
 	//Application Manager status - static
 	static bool cbAppMgrBusStatusNotification(LSHandle* lshandle, LSMessage *message,void *user_data);    
 	static bool cbAppMgrAppList(LSHandle* lshandle, LSMessage *message,void *user_data);
@@ -65,8 +74,10 @@ public:
 	
 	std::string getLocale();
 	void setLocale(const std::string& locale);
+	void switchLocale(const std::string& locale);
 	
 	LSHandle* getServiceHandle();
+	StartupPipeline* getStartupPipeline() { return m_startupPipeline; }
 	
 	UniversalSearchService();
 	~UniversalSearchService();
@@ -83,6 +94,17 @@ private:
 	LSHandle * m_serviceHandlePublic;
 	LSHandle * m_serviceHandlePrivate;
 	GMainLoop* m_mainLoop;
+	NotificationScheduler* m_notificationScheduler;
+	StartupPipeline* m_startupPipeline;
+	
+	//List generation of the last search list sent to the subscribers; it only advances
+	//when the content changed.
+	bool m_searchListPosted;
+	unsigned int m_postedSearchListGeneration;
+	
+	//Oldest list generation a delta subscriber may hold when the next change is posted.
+	bool m_deltaBaseValid;
+	unsigned int m_deltaBaseGeneration;
 };
 
 #endif
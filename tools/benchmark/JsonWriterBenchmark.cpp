@@ -0,0 +1,281 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+/*
+ * Compares writing the search list with JsonWriter against building a json_object
+ * tree and serializing it, as getSearchList did before.
+ *
+ *     universalsearch-json-benchmark [<items> ...]
+ *
+ * Times one reply of <items> search providers, for 50, 500 and 5000 providers by
+ * default, and checks that both give the same text. Then times decoding an item from
+ * an addSearchItem request with the request members found by name, as the field
+ * decoder first did, against the slot table of the fields.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <cjson/json.h>
+
+#include "ProviderList.h"
+#include "JsonWriter.h"
+#include "Payloads.h"
+
+struct Provider {
+	std::string id;
+	SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_MEMBER)
+	int position;
+	bool appExist;
+	bool dirty;
+};
+
+struct ProviderRecord {
+	std::string id;
+	std::string category;
+	SEARCH_PROVIDER_FIELDS(PROVIDER_FIELD_MEMBER)
+	bool hasPosition;
+	int position;
+};
+
+struct ProviderTraits {
+	typedef Provider Item;
+	typedef ProviderRecord Record;
+	typedef SearchProviderFields Fields;
+	typedef ProviderType<Provider> TypeOf;
+
+	static const char* category() { return "search"; }
+};
+
+typedef ProviderList<ProviderTraits> Providers;
+
+struct AllFields {
+	bool wants(const char* field) const { return true; }
+	bool inPage(int index) const { return true; }
+};
+
+static volatile gsize s_sink = 0;
+
+//The list reply as it used to be built.
+static std::string serializeTree(const Providers& providers)
+{
+	json_object* objArray = json_object_new_array();
+
+	for (Providers::const_iterator it = providers.begin(); it != providers.end(); ++it) {
+		json_object* infoObj = json_object_new_object();
+		json_object_object_add(infoObj, (char*) "id", json_object_new_string(it->id.c_str()));
+		json_object_object_add(infoObj, (char*) "displayName", json_object_new_string(it->displayName.c_str()));
+		json_object_object_add(infoObj, (char*) "iconFilePath", json_object_new_string(it->iconFilePath.c_str()));
+		json_object_object_add(infoObj, (char*) "url", json_object_new_string(it->url.c_str()));
+		json_object_object_add(infoObj, (char*) "suggestURL", json_object_new_string(it->suggestURL.c_str()));
+		json_object_object_add(infoObj, (char*) "launchParam", json_object_new_string(it->launchParam.c_str()));
+		json_object_object_add(infoObj, (char*) "type", json_object_new_string(it->type.c_str()));
+		json_object_object_add(infoObj, (char*) "enabled", json_object_new_boolean(it->enabled));
+		json_object_array_add(objArray, infoObj);
+	}
+
+	std::string serialized = json_object_to_json_string(objArray);
+	json_object_put(objArray);
+	return serialized;
+}
+
+static void fill(Providers& providers, int count)
+{
+	for (int i = 0; i < count; i++) {
+		Provider provider = Provider();
+		char buffer[128];
+
+		snprintf(buffer, sizeof(buffer), "com.example.provider.%d", i);
+		provider.id = buffer;
+		snprintf(buffer, sizeof(buffer), "Provider \"%d\"", i);
+		provider.displayName = buffer;
+		provider.iconFilePath = "/usr/palm/universalsearchmgr/resources/images/provider.png";
+		provider.url = "http://www.example.com/search?q=#{searchTerms}&client=palm";
+		provider.suggestURL = "http://suggest.example.com/complete?q=#{searchTerms}";
+		provider.launchParam = i % 3 == 0 ? "{\"query\": \"#{searchTerms}\"}" : "";
+		provider.type = i % 3 == 0 ? "app" : "web";
+		provider.enabled = i % 4 != 0;
+		provider.version = 1;
+		provider.position = i;
+		providers.push_back(provider);
+	}
+}
+
+//The same text but for '/', which json-c escapes.
+static bool sameText(const std::string& tree, const std::string& written)
+{
+	std::string unescaped;
+
+	unescaped.reserve(tree.size());
+	for (size_t i = 0; i < tree.size(); i++) {
+		if (tree[i] == '\\' && i + 1 < tree.size() && tree[i + 1] == '/')
+			continue;
+		unescaped += tree[i];
+		if (tree[i] == '\\' && i + 1 < tree.size())
+			unescaped += tree[++i];
+	}
+	return unescaped == written;
+}
+
+static void run(int count)
+{
+	Providers providers;
+	JsonWriter writer;
+	int replies = count <= 500 ? 20000 / (count / 50 + 1) : 100;
+	gint64 start, treeUs, writerUs;
+	gsize bytes = 0;
+
+	fill(providers, count);
+
+	start = g_get_monotonic_time();
+	for (int i = 0; i < replies; i++)
+		bytes += serializeTree(providers).size();
+	treeUs = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (int i = 0; i < replies; i++) {
+		writer.clear();
+		providers.write(writer, AllFields());
+		bytes += writer.size();
+	}
+	writerUs = g_get_monotonic_time() - start;
+
+	printf("%6d %8zu bytes %12.1f us %12.1f us %8.1fx%s\n", count, writer.size(),
+			(double) treeUs / replies, (double) writerUs / replies,
+			writerUs > 0 ? (double) treeUs / writerUs : 0.0,
+			sameText(serializeTree(providers), writer.str()) ? "" : "  (output differs)");
+	s_sink += bytes;
+}
+
+//The request member of each field looked up by name in the schema.
+struct NamedFieldDecoder {
+	NamedFieldDecoder(const ItemRequest& request) : request(request), index(0) {}
+
+	const PayloadValue* member(const char* name)
+	{
+		const PayloadSchema& schema = ItemPayload::schema();
+
+		for (int i = 0; i < schema.count; i++) {
+			if (strcmp(schema.fields[i].name, name) == 0 && request[i].present()) {
+				present.add(index++);
+				return &request[i];
+			}
+		}
+		index++;
+		return NULL;
+	}
+
+	template <class Reply>
+	void operator()(const char* name, PooledString& value, Reply)
+	{
+		const PayloadValue* label = member(name);
+		if (label)
+			value.assign(label->text, label->length);
+	}
+
+	template <class Reply>
+	void operator()(const char* name, bool& value, Reply)
+	{
+		const PayloadValue* label = member(name);
+		if (label)
+			value = label->boolean;
+	}
+
+	template <class Reply>
+	void operator()(const char* name, int& value, Reply)
+	{
+		const PayloadValue* label = member(name);
+		if (label)
+			value = label->toInt();
+	}
+
+	const ItemRequest& request;
+	int index;
+	ProviderFieldSet present;
+};
+
+static void runDecode()
+{
+	static const char* s_request = "{\"category\": \"search\", \"id\": \"com.example.provider\", "
+			"\"displayName\": \"Provider\", \"iconFilePath\": \"/usr/palm/universalsearchmgr/resources/images/provider.png\", "
+			"\"url\": \"http://www.example.com/search?q=#{searchTerms}\", \"type\": \"web\", \"enabled\": true, \"version\": 2}";
+	const int decodes = 200000;
+	RequestArena arena;
+	ItemRequest request(arena);
+	std::string error;
+	gint64 start, namedUs, slotUs;
+	gsize sum = 0;
+
+	if (!request.decode(s_request, error)) {
+		fprintf(stderr, "request: %s\n", error.c_str());
+		return;
+	}
+
+	start = g_get_monotonic_time();
+	for (int i = 0; i < decodes; i++) {
+		Provider provider = Provider();
+		NamedFieldDecoder decoder(request);
+		SearchProviderFields::visit(provider, decoder);
+		sum += provider.version;
+	}
+	namedUs = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (int i = 0; i < decodes; i++) {
+		Provider provider = Provider();
+		ProviderFieldSet present;
+		Providers::decode(request, provider, present);
+		sum += provider.version;
+	}
+	slotUs = g_get_monotonic_time() - start;
+
+	printf("\nitem decode: by name %.3f us, by slot %.3f us, %.1fx\n", (double) namedUs / decodes,
+			(double) slotUs / decodes, slotUs > 0 ? (double) namedUs / slotUs : 0.0);
+	s_sink += sum;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int> counts;
+
+	for (int i = 1; i < argc; i++) {
+		int count = atoi(argv[i]);
+		if (count <= 0) {
+			fprintf(stderr, "usage: %s [<items> ...]\n", argv[0]);
+			return 1;
+		}
+		counts.push_back(count);
+	}
+
+	if (counts.empty()) {
+		counts.push_back(50);
+		counts.push_back(500);
+		counts.push_back(5000);
+	}
+
+	printf(" items    reply size    json_object   JsonWriter  speedup\n");
+	for (size_t i = 0; i < counts.size(); i++)
+		run(counts[i]);
+
+	runDecode();
+
+	return 0;
+}
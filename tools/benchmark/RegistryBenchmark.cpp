@@ -0,0 +1,176 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+/*
+ * Compares the provider registry with the std::list and linear scans it replaced.
+ *
+ *     universalsearch-registry-benchmark [<items>]
+ *
+ * Fills both with <items> providers (10000 by default) and times lookups by id, a full
+ * iteration, a scan by type and a reorder in the middle of the list.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <list>
+#include <string>
+#include <vector>
+#include <glib.h>
+
+#include "ProviderRegistry.h"
+
+static const int s_lookups = 100000;
+
+struct Provider {
+	std::string id;
+	std::string type;
+	std::string url;
+	bool enabled;
+	int version;
+};
+
+typedef std::list<Provider> ProviderList;
+
+static volatile guint64 s_sink = 0;
+
+static void report(const char* name, gint64 listUs, gint64 registryUs, int operations)
+{
+	printf("%-12s %10.3f us %10.3f us %8.1fx\n", name,
+			(double) listUs / operations, (double) registryUs / operations,
+			registryUs > 0 ? (double) listUs / registryUs : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 10000;
+	std::vector<std::string> ids;
+	ProviderList list;
+	ProviderRegistry<Provider> registry;
+	gint64 start, listUs, registryUs;
+	guint64 sum;
+
+	if (count <= 0) {
+		fprintf(stderr, "usage: %s [<items>]\n", argv[0]);
+		return 1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		Provider provider;
+		char id[64];
+		snprintf(id, sizeof(id), "com.example.provider.%c.%d", 'a' + i % 26, i);
+		provider.id = id;
+		provider.type = i % 3 == 0 ? "app" : "web";
+		provider.url = "http://www.example.com/search?q=#{searchTerms}";
+		provider.enabled = i % 4 != 0;
+		provider.version = 1;
+
+		ids.push_back(provider.id);
+		list.push_back(provider);
+		registry.push_back(provider);
+	}
+
+	printf("%d items       std::list   registry  speedup\n", count);
+
+	//Lookups by id, spread over the whole list.
+	sum = 0;
+	start = g_get_monotonic_time();
+	for (int i = 0; i < s_lookups; i++) {
+		const std::string& id = ids[(i * 7919) % count];
+		for (ProviderList::iterator it = list.begin(); it != list.end(); ++it) {
+			if (it->id == id) {
+				sum += it->version;
+				break;
+			}
+		}
+	}
+	listUs = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (int i = 0; i < s_lookups; i++) {
+		ProviderRegistry<Provider>::iterator it = registry.find(ids[(i * 7919) % count]);
+		if (it != registry.end())
+			sum += it->version;
+	}
+	registryUs = g_get_monotonic_time() - start;
+	report("find", listUs, registryUs, s_lookups);
+
+	//Full iteration, as the list replies and the snapshot do.
+	start = g_get_monotonic_time();
+	for (int pass = 0; pass < 100; pass++)
+		for (ProviderList::const_iterator it = list.begin(); it != list.end(); ++it)
+			sum += it->enabled;
+	listUs = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (int pass = 0; pass < 100; pass++) {
+		const ProviderRegistry<Provider>& items = registry;
+		for (ProviderRegistry<Provider>::const_iterator it = items.begin(); it != items.end(); ++it)
+			sum += it->enabled;
+	}
+	registryUs = g_get_monotonic_time() - start;
+	report("iterate", listUs, registryUs, 100);
+
+	//Items of one type, as checkIntegrity walks the app items.
+	start = g_get_monotonic_time();
+	for (int pass = 0; pass < 100; pass++)
+		for (ProviderList::const_iterator it = list.begin(); it != list.end(); ++it)
+			if (it->type == "app")
+				sum += it->version;
+	listUs = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (int pass = 0; pass < 100; pass++) {
+		const ProviderRegistry<Provider>& items = registry;
+		const ProviderRegistry<Provider>::Positions& apps = items.positionsOfType("app");
+		for (size_t i = 0; i < apps.size(); i++)
+			sum += items[apps[i]].version;
+	}
+	registryUs = g_get_monotonic_time() - start;
+	report("by type", listUs, registryUs, 100);
+
+	//Reorder: find the item and move it by a few places, as reorderSearchItem does.
+	start = g_get_monotonic_time();
+	for (int i = 0; i < 1000; i++) {
+		const std::string& id = ids[(count / 2 + i) % count];
+		ProviderList::iterator from = list.begin(), to;
+		int fromIndex = 0;
+		while (from != list.end() && from->id != id) {
+			++from;
+			fromIndex++;
+		}
+		if (from == list.end())
+			continue;
+		to = list.begin();
+		std::advance(to, fromIndex >= 10 ? fromIndex - 10 : 0);
+		list.splice(to, list, from);
+	}
+	listUs = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (int i = 0; i < 1000; i++) {
+		ProviderRegistry<Provider>::size_type from = registry.indexOf(ids[(count / 2 + i) % count]);
+		if (from == ProviderRegistry<Provider>::npos)
+			continue;
+		registry.move(from, from >= 10 ? from - 10 : 0);
+	}
+	registryUs = g_get_monotonic_time() - start;
+	report("reorder", listUs, registryUs, 1000);
+
+	s_sink = sum;
+	return 0;
+}
@@ -0,0 +1,437 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <string.h>
+#include <map>
+#include <cjson/json.h>
+
+#include "LoopbackBus.h"
+
+static const char* s_failurePayload = "{\"returnValue\":false,\"errorCode\":-1,\"errorText\":\"Injected failure\"}";
+static char s_unreachableText[] = "Service is not running";
+
+struct LSHandle {
+	bool isPrivate;
+};
+
+struct LSPalmService {
+	LSHandle publicHandle;
+	LSHandle privateHandle;
+};
+
+struct LSMessage {
+	int refs;
+	std::string method;
+	std::string payload;
+	bool subscription;
+	LoopbackBus::ReplyFunc replyTo;
+	void* replyData;
+};
+
+struct LSSubscriptionIter {
+	std::vector<LSMessage*> messages;
+	std::vector<LSMessage*>::size_type next;
+};
+
+//An outgoing call of the service, kept for notify().
+struct PeerCall {
+	std::string uri;
+	std::string payload;
+	LSHandle* handle;
+	LSFilterFunc callback;
+	void* userData;
+};
+
+struct Delivery {
+	LSMessage* message;
+	LSHandle* handle;
+	LSFilterFunc callback;
+	void* userData;
+};
+
+struct ClientReply {
+	std::string payload;
+	LoopbackBus::ReplyFunc callback;
+	void* data;
+};
+
+typedef std::map<std::string, LSMethodFunction> MethodMap;
+typedef std::map<std::string, std::vector<LSMessage*> > SubscriptionMap;
+
+static LSPalmService s_service = { { false }, { true } };
+static MethodMap s_methods;
+static SubscriptionMap s_subscriptions;
+static std::vector<LoopbackBus::Peer> s_peers;
+static std::vector<PeerCall> s_peerCalls;
+static LoopbackBus::Counters s_counters = { 0, 0, 0, 0, 0, 0, 0 };
+
+static LSMessage* newMessage(const std::string& method, const std::string& payload, bool subscription)
+{
+	LSMessage* message = new LSMessage();
+	message->refs = 1;
+	message->method = method;
+	message->payload = payload;
+	message->subscription = subscription;
+	message->replyTo = NULL;
+	message->replyData = NULL;
+	return message;
+}
+
+static gboolean cbDeliver(gpointer data)
+{
+	Delivery* delivery = (Delivery*) data;
+
+	delivery->callback(delivery->handle, delivery->message, delivery->userData);
+	LSMessageUnref(delivery->message);
+	delete delivery;
+
+	return FALSE;
+}
+
+static void deliver(const std::string& uri, const std::string& payload, guint latencyMs, LSHandle* handle,
+		LSFilterFunc callback, void* userData)
+{
+	Delivery* delivery = new Delivery();
+	delivery->message = newMessage(uri, payload, false);
+	delivery->handle = handle;
+	delivery->callback = callback;
+	delivery->userData = userData;
+
+	if (latencyMs)
+		g_timeout_add(latencyMs, cbDeliver, delivery);
+	else
+		g_idle_add(cbDeliver, delivery);
+}
+
+static gboolean cbClientReply(gpointer data)
+{
+	ClientReply* reply = (ClientReply*) data;
+
+	reply->callback(reply->payload.c_str(), reply->data);
+	delete reply;
+
+	return FALSE;
+}
+
+static bool isSubscribe(const std::string& payload)
+{
+	bool subscribe = false;
+	json_object* root = json_tokener_parse(payload.c_str());
+
+	if (!root || is_error(root))
+		return false;
+
+	json_object* label = json_object_object_get(root, "subscribe");
+	if (label && !is_error(label))
+		subscribe = json_object_get_boolean(label);
+
+	json_object_put(root);
+	return subscribe;
+}
+
+LSMessage* LoopbackBus::request(const std::string& method, const std::string& payload, ReplyFunc callback, void* data)
+{
+	LSMessage* message = newMessage(method, payload, isSubscribe(payload));
+	message->replyTo = callback;
+	message->replyData = data;
+
+	s_counters.requests++;
+
+	LSMethodFunction function = findMethod(method);
+	if (function) {
+		function(&s_service.privateHandle, message, NULL);
+	}
+	else if (callback) {
+		ClientReply* reply = new ClientReply();
+		reply->payload = "{\"returnValue\":false,\"errorText\":\"Unknown method\"}";
+		reply->callback = callback;
+		reply->data = data;
+		g_idle_add(cbClientReply, reply);
+	}
+
+	return message;
+}
+
+LSMessage* LoopbackBus::createMessage(const std::string& method, const std::string& payload, bool subscription)
+{
+	return newMessage(method, payload, subscription);
+}
+
+LSMethodFunction LoopbackBus::findMethod(const std::string& method)
+{
+	MethodMap::const_iterator it = s_methods.find(method);
+	return it != s_methods.end() ? it->second : NULL;
+}
+
+LSHandle* LoopbackBus::privateHandle()
+{
+	return &s_service.privateHandle;
+}
+
+void LoopbackBus::addPeer(const Peer& peer)
+{
+	s_peers.push_back(peer);
+}
+
+bool LoopbackBus::loadScript(const char* path)
+{
+	bool success = false;
+	json_object* root = json_object_from_file((char*) path);
+	json_object* label;
+
+	if (!root || is_error(root) || !json_object_is_type(root, json_type_array)) {
+		fprintf(stderr, "%s is not a JSON array of peers\n", path);
+		goto Done;
+	}
+
+	for (int i = 0; i < json_object_array_length(root); i++) {
+		json_object* entry = json_object_array_get_idx(root, i);
+		Peer peer;
+
+		label = json_object_object_get(entry, "uri");
+		if (!label || is_error(label)) {
+			fprintf(stderr, "%s: peer %d has no uri\n", path, i);
+			goto Done;
+		}
+		peer.uri = json_object_get_string(label);
+
+		label = json_object_object_get(entry, "match");
+		if (label && !is_error(label))
+			peer.match = json_object_get_string(label);
+
+		label = json_object_object_get(entry, "latency");
+		peer.latencyMs = (label && !is_error(label)) ? json_object_get_int(label) : 0;
+
+		label = json_object_object_get(entry, "failureRate");
+		peer.failureRate = (label && !is_error(label)) ? json_object_get_double(label) : 0;
+
+		label = json_object_object_get(entry, "unreachable");
+		peer.unreachable = (label && !is_error(label)) ? json_object_get_boolean(label) : false;
+
+		label = json_object_object_get(entry, "replies");
+		if (label && !is_error(label) && json_object_is_type(label, json_type_array)) {
+			for (int j = 0; j < json_object_array_length(label); j++)
+				peer.replies.push_back(json_object_to_json_string(json_object_array_get_idx(label, j)));
+		}
+
+		addPeer(peer);
+	}
+
+	success = true;
+
+Done:
+	if (root && !is_error(root))
+		json_object_put(root);
+	return success;
+}
+
+int LoopbackBus::notify(const std::string& uri, const std::string& match, const std::string& payload)
+{
+	int count = 0;
+
+	for (std::vector<PeerCall>::const_iterator it = s_peerCalls.begin(); it != s_peerCalls.end(); ++it) {
+		if (it->uri != uri || (!match.empty() && it->payload.find(match) == std::string::npos))
+			continue;
+
+		deliver(uri, payload, 0, it->handle, it->callback, it->userData);
+		count++;
+	}
+
+	return count;
+}
+
+const LoopbackBus::Counters& LoopbackBus::counters()
+{
+	return s_counters;
+}
+
+bool LSErrorInit(LSError* lserror)
+{
+	memset(lserror, 0, sizeof(LSError));
+	return true;
+}
+
+void LSErrorFree(LSError* lserror)
+{
+	LSErrorInit(lserror);
+}
+
+void LSErrorPrint(LSError* lserror, FILE* out)
+{
+	if (lserror->message)
+		fprintf(out, "LSError: %s\n", lserror->message);
+}
+
+bool LSRegisterPalmService(const char* name, LSPalmService** ret_palm_service, LSError* lserror)
+{
+	*ret_palm_service = &s_service;
+	return true;
+}
+
+bool LSUnregisterPalmService(LSPalmService* psh, LSError* lserror)
+{
+	return true;
+}
+
+bool LSPalmServiceRegisterCategory(LSPalmService* psh, const char* category, LSMethod* methods_public,
+		LSMethod* methods_private, LSSignal* signals, void* category_user_data, LSError* lserror)
+{
+	for (LSMethod* method = methods_public; method && method->name; method++)
+		s_methods[method->name] = method->function;
+
+	for (LSMethod* method = methods_private; method && method->name; method++)
+		s_methods[method->name] = method->function;
+
+	return true;
+}
+
+bool LSGmainAttachPalmService(LSPalmService* psh, GMainLoop* mainLoop, LSError* lserror)
+{
+	return true;
+}
+
+LSHandle* LSPalmServiceGetPublicConnection(LSPalmService* psh)
+{
+	return &psh->publicHandle;
+}
+
+LSHandle* LSPalmServiceGetPrivateConnection(LSPalmService* psh)
+{
+	return &psh->privateHandle;
+}
+
+bool LSCall(LSHandle* sh, const char* uri, const char* payload, LSFilterFunc callback, void* user_data,
+		LSMessageToken* ret_token, LSError* lserror)
+{
+	const LoopbackBus::Peer* peer = NULL;
+
+	s_counters.calls++;
+	if (ret_token)
+		*ret_token = (LSMessageToken) s_counters.calls;
+
+	for (std::vector<LoopbackBus::Peer>::const_iterator it = s_peers.begin(); it != s_peers.end(); ++it) {
+		if (it->uri == uri && (it->match.empty() || strstr(payload, it->match.c_str()))) {
+			peer = &(*it);
+			break;
+		}
+	}
+
+	if (!peer) {
+		s_counters.unanswered++;
+		return true;
+	}
+
+	if (peer->unreachable) {
+		s_counters.injectedFailures++;
+		lserror->error_code = -1;
+		lserror->message = s_unreachableText;
+		return false;
+	}
+
+	if (peer->failureRate > 0 && g_random_double() < peer->failureRate) {
+		s_counters.injectedFailures++;
+		deliver(uri, s_failurePayload, peer->latencyMs, sh, callback, user_data);
+		return true;
+	}
+
+	for (std::vector<std::string>::const_iterator it = peer->replies.begin(); it != peer->replies.end(); ++it)
+		deliver(uri, *it, peer->latencyMs, sh, callback, user_data);
+
+	PeerCall call;
+	call.uri = uri;
+	call.payload = payload;
+	call.handle = sh;
+	call.callback = callback;
+	call.userData = user_data;
+	s_peerCalls.push_back(call);
+
+	return true;
+}
+
+const char* LSMessageGetPayload(LSMessage* message)
+{
+	return message->payload.c_str();
+}
+
+bool LSMessageIsSubscription(LSMessage* message)
+{
+	return message->subscription;
+}
+
+void LSMessageRef(LSMessage* message)
+{
+	message->refs++;
+}
+
+void LSMessageUnref(LSMessage* message)
+{
+	if (--message->refs == 0)
+		delete message;
+}
+
+bool LSMessageReply(LSHandle* sh, LSMessage* lsmsg, const char* replyPayload, LSError* lserror)
+{
+	s_counters.replies++;
+	s_counters.replyBytes += strlen(replyPayload);
+
+	if (lsmsg->replyTo) {
+		ClientReply* reply = new ClientReply();
+		reply->payload = replyPayload;
+		reply->callback = lsmsg->replyTo;
+		reply->data = lsmsg->replyData;
+		g_idle_add(cbClientReply, reply);
+	}
+
+	return true;
+}
+
+bool LSSubscriptionAdd(LSHandle* sh, const char* key, LSMessage* message, LSError* lserror)
+{
+	LSMessageRef(message);
+	s_subscriptions[key].push_back(message);
+	s_counters.subscriptions++;
+	return true;
+}
+
+bool LSSubscriptionAcquire(LSHandle* sh, const char* key, LSSubscriptionIter** ret_iter, LSError* lserror)
+{
+	LSSubscriptionIter* iter = new LSSubscriptionIter();
+	SubscriptionMap::const_iterator it = s_subscriptions.find(key);
+
+	if (it != s_subscriptions.end())
+		iter->messages = it->second;
+	iter->next = 0;
+
+	*ret_iter = iter;
+	return true;
+}
+
+bool LSSubscriptionHasNext(LSSubscriptionIter* iter)
+{
+	return iter->next < iter->messages.size();
+}
+
+LSMessage* LSSubscriptionNext(LSSubscriptionIter* iter)
+{
+	return iter->messages[iter->next++];
+}
+
+void LSSubscriptionRelease(LSSubscriptionIter* iter)
+{
+	delete iter;
+}
@@ -0,0 +1,83 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#ifndef __LoopbackBus_h__
+#define __LoopbackBus_h__
+
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <lunaservice.h>
+
+/*
+ * In-process stand-in for luna-service2, linked into the tools instead of LS2; the
+ * service code is the same as in the daemon.
+ *
+ * Clients call the service methods with request(), which dispatches into the method
+ * tables the service registered; replies come back through the main loop. Outgoing
+ * calls of the service go to scripted peers: every peer answers calls to one uri (and,
+ * optionally, only those whose payload contains a given string) with a fixed list of
+ * replies after a configurable latency, and can be made to fail. notify() sends later
+ * updates to the callers of a peer, as a subscription would. Calls no peer answers are
+ * counted and never replied to.
+ */
+class LoopbackBus {
+
+public:
+	struct Counters {
+		guint64 requests;
+		guint64 replies;
+		guint64 replyBytes;
+		guint64 subscriptions;
+		guint64 calls;
+		guint64 unanswered;
+		guint64 injectedFailures;
+	};
+
+	struct Peer {
+		std::string uri;
+		std::string match;					//empty matches every payload
+		std::vector<std::string> replies;
+		guint latencyMs;
+		double failureRate;					//share of calls answered with an error reply
+		bool unreachable;					//LSCall itself fails
+	};
+
+	typedef void (*ReplyFunc)(const char* payload, void* data);
+
+	//A client call; "subscribe":true in the payload makes it a subscription.
+	static LSMessage* request(const std::string& method, const std::string& payload, ReplyFunc callback, void* data);
+
+	//A message for a callback called directly; both are released with LSMessageUnref.
+	static LSMessage* createMessage(const std::string& method, const std::string& payload, bool subscription);
+
+	static LSMethodFunction findMethod(const std::string& method);
+	static LSHandle* privateHandle();
+
+	static void addPeer(const Peer& peer);
+
+	//A JSON array of peers: uri, match, replies, latency (ms), failureRate, unreachable.
+	static bool loadScript(const char* path);
+
+	//Returns the number of callers the update went to.
+	static int notify(const std::string& uri, const std::string& match, const std::string& payload);
+
+	static const Counters& counters();
+};
+
+#endif
@@ -0,0 +1,314 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2010-2013 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+/*
+ * Replays a capture written with UNIVERSALSEARCH_CAPTURE through the service handlers.
+ *
+ *     universalsearch-replay [-s <speed factor> | -f] <capture file>
+ *
+ * By default the messages are handed over with their original spacing; -s 10 replays
+ * ten times faster, -f back to back. The service runs as it would on the device (same
+ * database and resource files), so run it with the daemon stopped, on a scratch copy.
+ * The outgoing calls of the service go nowhere; their replies are in the capture.
+ * Reports the latency of every handler and the CPU time of the whole run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <cjson/json.h>
+
+#include "BusCapture.h"
+#include "LoopbackBus.h"
+#include "OpenSearchHandler.h"
+#include "UniversalSearchPrefsDb.h"
+#include "UniversalSearchService.h"
+
+GMainLoop* gMainLoop = NULL;
+
+//Time left to the notification scheduler and the startup jobs after the last message.
+static const guint s_drainMs = 1000;
+
+struct Record {
+	gint64 timeUs;
+	std::string handler;
+	bool subscription;
+	std::string payload;
+};
+
+struct HandlerTimes {
+	guint64 count;
+	guint64 totalUs;
+	guint64 maxUs;
+};
+
+static const struct {
+	const char* name;
+	LSFilterFunc callback;
+} s_callbacks[] = {
+	{ "cbSysServiceBusStatusNotification", UniversalSearchService::cbSysServiceBusStatusNotification },
+	{ "cbGetLocalePref", UniversalSearchService::cbGetLocalePref },
+	{ "cbAppMgrBusStatusNotification", UniversalSearchService::cbAppMgrBusStatusNotification },
+	{ "cbAppMgrAppList", UniversalSearchService::cbAppMgrAppList },
+	{ "cbAppMgrGetAppInfo", UniversalSearchService::cbAppMgrGetAppInfo },
+	{ "cbAppInstallerBusStatusNotification", UniversalSearchService::cbAppInstallerBusStatusNotification },
+	{ "cbAppInstallerNotifyOnChange", UniversalSearchService::cbAppInstallerNotifyOnChange },
+	{ "cbDownloadManagerUpdate", OpenSearchHandler::cbDownloadManagerUpdate },
+	{ "cbDownloadManagerIconUpdate", OpenSearchHandler::cbDownloadManagerIconUpdate },
+	{ 0, 0 }
+};
+
+static std::vector<Record> s_records;
+static std::vector<Record>::size_type s_next = 0;
+static double s_speed = 1.0;		//0 replays back to back
+static gint64 s_startUs = 0;
+static gint64 s_endUs = 0;
+static std::map<std::string, HandlerTimes> s_times;
+static guint64 s_unknown = 0;
+
+static bool readCapture(const char* path)
+{
+	gchar* contents = NULL;
+	gsize length = 0;
+	GError* error = NULL;
+	const char* line;
+	const char* end;
+
+	if (!g_file_get_contents(path, &contents, &length, &error)) {
+		fprintf(stderr, "Failed to read %s: %s\n", path, error ? error->message : "unknown error");
+		if (error)
+			g_error_free(error);
+		return false;
+	}
+
+	end = contents + length;
+	for (line = contents; line < end; ) {
+		const char* eol = (const char*) memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+
+		if (line != eol && *line != '#') {
+			const char* fields[3];
+			const char* pos = line;
+			int found = 0;
+
+			for (; found < 3; found++) {
+				fields[found] = (const char*) memchr(pos, '\t', eol - pos);
+				if (!fields[found])
+					break;
+				pos = fields[found] + 1;
+			}
+
+			if (found == 3) {
+				Record record;
+				record.timeUs = g_ascii_strtoll(line, NULL, 10);
+				record.handler.assign(fields[0] + 1, fields[1] - fields[0] - 1);
+				record.subscription = fields[1][1] == 's';
+				record.payload = BusCapture::unescape(fields[2] + 1, eol - fields[2] - 1);
+				s_records.push_back(record);
+			}
+			else {
+				fprintf(stderr, "Skipping malformed line %.*s\n", (int) (eol - line), line);
+			}
+		}
+
+		line = eol + 1;
+	}
+
+	g_free(contents);
+	return true;
+}
+
+static LSFilterFunc findCallback(const std::string& name)
+{
+	for (int i = 0; s_callbacks[i].name; i++) {
+		if (name == s_callbacks[i].name)
+			return s_callbacks[i].callback;
+	}
+
+	return NULL;
+}
+
+static void dispatch(const Record& record)
+{
+	LSFilterFunc callback = findCallback(record.handler);
+	LSMessage* message = NULL;
+	gint64 start;
+
+	if (!callback && !LoopbackBus::findMethod(record.handler)) {
+		s_unknown++;
+		return;
+	}
+
+	//Bus methods go through the loopback bus like any client call, replies of the
+	//peers straight to their callback.
+	start = g_get_monotonic_time();
+	if (callback) {
+		message = LoopbackBus::createMessage(record.handler, record.payload, record.subscription);
+		callback(LoopbackBus::privateHandle(), message, NULL);
+	}
+	else {
+		message = LoopbackBus::request(record.handler, record.payload, NULL, NULL);
+	}
+	guint64 elapsed = g_get_monotonic_time() - start;
+
+	LSMessageUnref(message);
+
+	HandlerTimes& times = s_times[record.handler];
+	times.count++;
+	times.totalUs += elapsed;
+	if (elapsed > times.maxUs)
+		times.maxUs = elapsed;
+}
+
+static gboolean cbNextRecord(gpointer data);
+
+static gboolean cbFinish(gpointer data)
+{
+	g_main_loop_quit(gMainLoop);
+	return FALSE;
+}
+
+static gint64 dueTime(const Record& record)
+{
+	return s_startUs + (gint64) (record.timeUs / s_speed);
+}
+
+static void scheduleNext()
+{
+	if (s_next == s_records.size()) {
+		s_endUs = g_get_monotonic_time();
+		g_timeout_add(s_drainMs, cbFinish, NULL);
+	}
+	else if (s_speed > 0) {
+		gint64 wait = dueTime(s_records[s_next]) - g_get_monotonic_time();
+		g_timeout_add(wait > 0 ? (guint) ((wait + 999) / 1000) : 0, cbNextRecord, NULL);
+	}
+	else {
+		g_idle_add(cbNextRecord, NULL);
+	}
+}
+
+static gboolean cbNextRecord(gpointer data)
+{
+	if (s_speed > 0) {
+		gint64 now = g_get_monotonic_time();
+		while (s_next < s_records.size() && dueTime(s_records[s_next]) <= now)
+			dispatch(s_records[s_next++]);
+	}
+	else {
+		//One message per main loop iteration, idle work interleaves as it would.
+		dispatch(s_records[s_next++]);
+	}
+
+	scheduleNext();
+	return FALSE;
+}
+
+static double milliseconds(const struct timeval& tv)
+{
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void report(gint64 wallUs)
+{
+	struct rusage usage;
+	const LoopbackBus::Counters& counters = LoopbackBus::counters();
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("%-36s %8s %10s %10s %12s\n", "handler", "count", "mean us", "max us", "total ms");
+	for (std::map<std::string, HandlerTimes>::const_iterator it = s_times.begin(); it != s_times.end(); ++it) {
+		const HandlerTimes& times = it->second;
+		printf("%-36s %8llu %10llu %10llu %12.1f\n", it->first.c_str(), (unsigned long long) times.count,
+				(unsigned long long) (times.totalUs / times.count), (unsigned long long) times.maxUs,
+				times.totalUs / 1000.0);
+	}
+
+	printf("\n%u messages replayed, %llu with an unknown handler\n", (unsigned int) s_records.size(),
+			(unsigned long long) s_unknown);
+	printf("%llu replies (%llu bytes), %llu outgoing calls, %llu subscriptions\n",
+			(unsigned long long) counters.replies, (unsigned long long) counters.replyBytes,
+			(unsigned long long) counters.calls, (unsigned long long) counters.subscriptions);
+	printf("wall %.1f ms, cpu user %.1f ms, system %.1f ms\n", wallUs / 1000.0,
+			milliseconds(usage.ru_utime), milliseconds(usage.ru_stime));
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-s <speed factor> | -f] <capture file>\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0) {
+			s_speed = 0;
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			s_speed = g_ascii_strtod(argv[++i], NULL);
+			if (s_speed <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!path && argv[i][0] != '-') {
+			path = argv[i];
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!path) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!readCapture(path))
+		return 1;
+
+	if (s_records.empty()) {
+		fprintf(stderr, "%s holds no messages\n", path);
+		return 1;
+	}
+
+	gMainLoop = g_main_loop_new(NULL, FALSE);
+	g_thread_init(NULL);
+
+	UniversalSearchService::instance();
+
+	s_startUs = g_get_monotonic_time();
+	scheduleNext();
+	g_main_loop_run(gMainLoop);
+
+	//Database writes are part of the cost.
+	UniversalSearchPrefsDb::instance()->flush();
+
+	report(s_endUs - s_startUs);
+
+	return 0;
+}